@@ -0,0 +1,46 @@
+{
+	"targets": [
+		{
+			"target_name": "bench",
+			"cflags": [
+				"-Wall",
+				"-Wextra",
+				"-Werror",
+			],
+			"xcode_settings": {
+				"OTHER_CFLAGS": [
+					"-Wall",
+					"-Wextra",
+					"-Werror",
+				]
+			},
+			"sources": [
+				"../src/bench.cc",
+				"../src/convert.cc",
+				"../src/intern.cc",
+				"../src/flat.c"
+			],
+			"include_dirs": [
+				"<!(node -e \"require('nan')\")"
+			],
+			"conditions": [
+				[ "OS=='solaris'", {
+					"libraries": [
+						"-lnvpair"
+					]
+				} ],
+				[ "OS=='linux'", {
+					"sources": [
+						"../shim/libnvpair.c"
+					],
+					"include_dirs": [
+						"../shim"
+					],
+					"defines": [
+						"_GNU_SOURCE"
+					]
+				} ]
+			]
+		}
+	]
+}
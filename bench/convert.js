@@ -0,0 +1,280 @@
+#!/usr/bin/env node
+/* vim: set ts=8 sts=8 sw=8 noet: */
+
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2022 Joyent, Inc.
+ */
+
+/*
+ * Microbenchmarks for the conversion of events into Javascript values, run
+ * by the separate "bench" addon built from "src/bench.cc" (see there for the
+ * workloads and strategies).  Each strategy converts each workload in
+ * isolation, on the event loop thread, with no delivery machinery involved.
+ *
+ * The addon is not built on install: "npm run bench-convert" builds it
+ * (with "bench/binding.gyp", into "bench/build") and then runs this with the
+ * default options.  Usage, once built:
+ *
+ *	node bench/convert.js [--workloads=header,zfs,large]
+ *	    [--strategies=eager,interned,templated,packed,flatten]
+ *	    [--count=200000] [--output=FILE]
+ *	    [--baseline=FILE] [--tolerance=10]
+ *
+ * Results are written as JSON to "--output", or to stdout.  Each result
+ * describes one workload converted with one strategy:
+ *
+ *	name		"<workload>/<strategy>"
+ *
+ *	events		the number of conversions timed
+ *
+ *	nsPerEvent	the mean time taken by each
+ *
+ *	heapBytesPerEvent the mean number of bytes each allocated on the V8
+ *			heap; approximate, as batches of conversions during
+ *			which a garbage collection ran are left out
+ *
+ *	packedBytes	the size of the workload's packed form
+ *
+ * With "--baseline", results are compared with those of the same name in an
+ * earlier result file: a rise in "nsPerEvent" of more than "--tolerance"
+ * percent is reported in "regressions", and the process exits with status 1.
+ */
+
+var mod_fs = require('fs');
+var mod_os = require('os');
+
+var mod_bench = require('bindings')({
+	bindings: 'bench',
+	module_root: __dirname
+});
+
+var RESULTS_VERSION = 1;
+
+var DEFAULTS = {
+	workloads: mod_bench.workloads,
+	strategies: mod_bench.strategies,
+	count: 200000,
+	output: null,
+	baseline: null,
+	tolerance: 10
+};
+
+function
+usage(msg)
+{
+	if (msg) {
+		console.error('convert: %s', msg);
+	}
+	console.error('usage: convert [--workloads=%s]\n' +
+	    '    [--strategies=%s]\n' +
+	    '    [--count=N] [--output=FILE] [--baseline=FILE] ' +
+	    '[--tolerance=PERCENT]', mod_bench.workloads.join(','),
+	    mod_bench.strategies.join(','));
+	process.exit(2);
+}
+
+function
+parseNames(name, val, known)
+{
+	return (val.split(',').map(function (v) {
+		if (known.indexOf(v) === -1) {
+			usage('unknown ' + name + ' "' + v + '"');
+		}
+		return (v);
+	}));
+}
+
+function
+parseNumber(name, val, min)
+{
+	var n = Number(val);
+
+	if (val === '' || !Number.isFinite(n) || n < min) {
+		usage('--' + name + ' must be a number no less than ' + min);
+	}
+	return (n);
+}
+
+function
+parseArgs(argv)
+{
+	var opts = {};
+	var k;
+
+	for (k in DEFAULTS) {
+		opts[k] = DEFAULTS[k];
+	}
+
+	argv.forEach(function (arg) {
+		var m = /^--([a-z-]+)=(.*)$/.exec(arg);
+
+		if (arg === '--help' || arg === '-h') {
+			usage();
+		}
+		if (m === null) {
+			usage('unexpected argument "' + arg + '"');
+		}
+
+		switch (m[1]) {
+		case 'workloads':
+			opts.workloads = parseNames('workload', m[2],
+			    mod_bench.workloads);
+			break;
+		case 'strategies':
+			opts.strategies = parseNames('strategy', m[2],
+			    mod_bench.strategies);
+			break;
+		case 'count':
+			opts.count = parseNumber(m[1], m[2], 1);
+			if (!Number.isInteger(opts.count)) {
+				usage('--count must be an integer');
+			}
+			break;
+		case 'tolerance':
+			opts.tolerance = parseNumber(m[1], m[2], 0);
+			break;
+		case 'output':
+		case 'baseline':
+			opts[m[1]] = m[2];
+			break;
+		default:
+			usage('unknown option "--' + m[1] + '"');
+		}
+	});
+
+	return (opts);
+}
+
+function
+compare(results, baseline, tolerance)
+{
+	var byname = {};
+	var frac = tolerance / 100;
+
+	baseline.results.forEach(function (r) {
+		byname[r.name] = r;
+	});
+
+	return (results.filter(function (r) {
+		var b = byname[r.name];
+
+		return (b !== undefined &&
+		    r.nsPerEvent > b.nsPerEvent * (1 + frac));
+	}).map(function (r) {
+		return ({
+			name: r.name,
+			metric: 'nsPerEvent',
+			baseline: byname[r.name].nsPerEvent,
+			value: r.nsPerEvent
+		});
+	}));
+}
+
+function
+main()
+{
+	var opts = parseArgs(process.argv.slice(2));
+	var results = [];
+	var baseline = null;
+	var cpus = mod_os.cpus();
+
+	if (opts.baseline !== null) {
+		baseline = JSON.parse(mod_fs.readFileSync(opts.baseline,
+		    'utf8'));
+		if (baseline.version !== RESULTS_VERSION ||
+		    !Array.isArray(baseline.results)) {
+			usage('"' + opts.baseline + '" is not a result file');
+		}
+	}
+
+	opts.workloads.forEach(function (workload) {
+		opts.strategies.forEach(function (strategy) {
+			var name = workload + '/' + strategy;
+			var r;
+
+			/*
+			 * Start each run with as little garbage about as
+			 * we can, where "--expose-gc" allows it.
+			 */
+			if (typeof (global.gc) === 'function') {
+				global.gc();
+			}
+
+			r = mod_bench.run(workload, strategy, opts.count);
+			results.push({
+				name: name,
+				workload: workload,
+				strategy: strategy,
+				events: r.events,
+				nsPerEvent: Math.round(r.ns / r.events * 10) /
+				    10,
+				heapBytesPerEvent: (r.heapEvents > 0 ?
+				    Math.round(r.heapBytes / r.heapEvents) :
+				    null),
+				packedBytes: r.packedBytes
+			});
+			console.error('%s: %d ns/event, %s heap bytes/event',
+			    name, results[results.length - 1].nsPerEvent,
+			    results[results.length - 1].heapBytesPerEvent);
+		});
+	});
+
+	var out = {
+		version: RESULTS_VERSION,
+		date: new Date().toISOString(),
+		host: {
+			platform: process.platform,
+			arch: process.arch,
+			release: mod_os.release(),
+			node: process.version,
+			cpus: cpus.length,
+			cpuModel: (cpus.length > 0 ? cpus[0].model : null)
+		},
+		options: {
+			count: opts.count
+		},
+		results: results
+	};
+
+	if (baseline !== null) {
+		out.regressions = compare(results, baseline, opts.tolerance);
+	}
+
+	var json = JSON.stringify(out, null, 4) + '\n';
+	if (opts.output !== null) {
+		mod_fs.writeFileSync(opts.output, json);
+	} else {
+		process.stdout.write(json);
+	}
+
+	if (baseline !== null && out.regressions.length > 0) {
+		out.regressions.forEach(function (rg) {
+			console.error('regression: %s %s: %s -> %s',
+			    rg.name, rg.metric, rg.baseline, rg.value);
+		});
+		process.exitCode = 1;
+	}
+}
+
+main();
@@ -0,0 +1,666 @@
+#!/usr/bin/env node
+/* vim: set ts=8 sts=8 sw=8 noet: */
+
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2022 Joyent, Inc.
+ */
+
+/*
+ * Throughput and latency benchmark for the delivery pipeline.  Events are
+ * made up by the native "synthetic" source (see "src/synth.c"), on producer
+ * threads, and travel the same path as events from libsysevent: packing,
+ * the crossthread queue ("crossthread_post()"), "nsev_drain()" on the event
+ * loop thread, conversion, and fan-out to each stream in "index.js".  Every
+ * synthetic event carries in its "time" attribute the hrtime at which it was
+ * made; as the event loop's hrtime is read from the same clock, the latency
+ * of an event is the difference between the two when it reaches the first
+ * stream's "data" handler.
+ *
+ * Each scenario is run twice: once with the source unthrottled, to find the
+ * throughput the pipeline can sustain, and once at a fixed "--rate" to
+ * measure latency without queueing.  The unthrottled runs use the "block"
+ * overload policy, so that producers wait for the event loop rather than
+ * events being discarded.
+ *
+ * Each of "--paths" is run too.  On the "direct" path (the default),
+ * producers hand events straight to the pipeline.  On the "posted" path,
+ * available only on Linux, they publish them through the bundled
+ * libsysevent stand-in ("shim/libsysevent.c"), and the events are received
+ * by the libsysevent handler in "src/sysevent.c" as live events are, so the
+ * whole native path is exercised.  Usage:
+ *
+ *	node bench/pipeline.js [--modes=eager,lazy,packed]
+ *	    [--paths=direct,posted]
+ *	    [--attributes=2,8,32] [--streams=1,4] [--threads=1,4]
+ *	    [--rate=10000] [--duration=2000] [--warmup=500]
+ *	    [--queue-limit=16384] [--output=FILE]
+ *	    [--baseline=FILE] [--tolerance=10]
+ *
+ * Results are written as JSON to "--output", or to stdout; progress goes to
+ * stderr.  Each result describes one run:
+ *
+ *	name		"<mode>/a<attributes>/s<streams>/t<threads>/r<rate>",
+ *			with "/posted" appended for the "posted" path, which
+ *			identifies the run across result files
+ *
+ *	events,		events received by the first stream during the run,
+ *	eventsPerSec	and the rate at which they were received
+ *
+ *	deliveriesPerSec the rate at which events were received, summed
+ *			across every stream
+ *
+ *	latencyUs	"{ samples, min, mean, p50, p90, p99, p999, max }",
+ *			in microseconds, from the producer to the first
+ *			stream's handler (in "packed" mode, after the handler
+ *			has decoded the event to find its time)
+ *
+ *	dropped		events discarded for any stream during the run
+ *
+ *	cpuUserMs,	CPU time consumed by the process (including the
+ *	cpuSystemMs	producer threads) during the run
+ *
+ * With "--baseline", results are compared with those of the same name in an
+ * earlier result file: a fall in "eventsPerSec" of an unthrottled run, or a
+ * rise in the 99th percentile latency of a throttled run, of more than
+ * "--tolerance" percent is reported in "regressions", and the process exits
+ * with status 1.
+ */
+
+var mod_fs = require('fs');
+var mod_os = require('os');
+
+var mod_sysevent = require('../index');
+
+var RESULTS_VERSION = 1;
+
+var DEFAULTS = {
+	modes: [ 'eager', 'lazy', 'packed' ],
+	paths: [ 'direct' ],
+	attributes: [ 2, 8, 32 ],
+	streams: [ 1, 4 ],
+	threads: [ 1, 4 ],
+	rate: 10000,
+	duration: 2000,
+	warmup: 500,
+	queueLimit: 16384,
+	output: null,
+	baseline: null,
+	tolerance: 10
+};
+
+var HAVE_BIGINT = (typeof (BigInt) === 'function' &&
+    typeof (process.hrtime.bigint) === 'function');
+
+var PATHS = [ 'direct', 'posted' ];
+
+/*
+ * Synthetic events always carry "seq" and "time" as their first two
+ * attributes.
+ */
+var ATTRIBUTES_MIN = 2;
+
+/*
+ * How each delivery mode's consumer finds the producer's timestamp.
+ */
+var TIME_OF = {
+	eager: function (ev) {
+		return (ev.nvl1.time);
+	},
+	lazy: function (ev) {
+		return (ev.nvl1.get('time'));
+	},
+	packed: function (ev) {
+		return (mod_sysevent.decodePacked(ev).nvl1.time);
+	}
+};
+
+function
+now()
+{
+	if (HAVE_BIGINT) {
+		return (process.hrtime.bigint());
+	}
+
+	var t = process.hrtime();
+	return (t[0] * 1e9 + t[1]);
+}
+
+/*
+ * Nanoseconds elapsed since "then", a value returned by "now()" or an hrtime
+ * attribute: a BigInt where the runtime supports them, and a Number
+ * elsewhere.
+ */
+function
+since(then)
+{
+	if (typeof (then) === 'bigint') {
+		return (Number(process.hrtime.bigint() - then));
+	}
+
+	var t = process.hrtime();
+	return (t[0] * 1e9 + t[1] - then);
+}
+
+/*
+ * A histogram of latencies in nanoseconds.  Buckets are one nanosecond wide
+ * below HIST_LINEAR, then each power of two is divided into HIST_SUB
+ * buckets, so percentiles are accurate to within about 3%.
+ */
+var HIST_SUB = 32;
+var HIST_LINEAR = 2 * HIST_SUB;
+var HIST_SHIFT = 6;
+var HIST_BUCKETS = HIST_LINEAR + (53 - HIST_SHIFT) * HIST_SUB;
+
+function
+Histogram()
+{
+	this.h_counts = new Float64Array(HIST_BUCKETS);
+	this.h_n = 0;
+	this.h_sum = 0;
+	this.h_min = Infinity;
+	this.h_max = 0;
+}
+
+Histogram.prototype.record = function (ns) {
+	var idx, e;
+
+	/*
+	 * The clocks agree, but guard against a producer timestamp taken
+	 * just after ours on another CPU.
+	 */
+	ns = Math.max(0, Math.floor(ns));
+
+	if (ns < HIST_LINEAR) {
+		idx = ns;
+	} else {
+		e = Math.floor(Math.log2(ns));
+		if (Math.pow(2, e) > ns) {
+			e--;
+		} else if (Math.pow(2, e + 1) <= ns) {
+			e++;
+		}
+		idx = HIST_LINEAR + (e - HIST_SHIFT) * HIST_SUB +
+		    Math.floor(ns / Math.pow(2, e - 5)) - HIST_SUB;
+	}
+
+	this.h_counts[Math.min(idx, HIST_BUCKETS - 1)]++;
+	this.h_n++;
+	this.h_sum += ns;
+	this.h_min = Math.min(this.h_min, ns);
+	this.h_max = Math.max(this.h_max, ns);
+};
+
+/*
+ * The midpoint of bucket "idx".
+ */
+Histogram.prototype.value = function (idx) {
+	var k, width;
+
+	if (idx < HIST_LINEAR) {
+		return (idx);
+	}
+
+	k = idx - HIST_LINEAR;
+	width = Math.pow(2, HIST_SHIFT + Math.floor(k / HIST_SUB) - 5);
+	return ((HIST_SUB + k % HIST_SUB) * width + width / 2);
+};
+
+Histogram.prototype.percentile = function (p) {
+	var rank = Math.max(1, Math.ceil(this.h_n * p / 100));
+	var seen = 0;
+	var i;
+
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		seen += this.h_counts[i];
+		if (seen >= rank) {
+			return (Math.min(Math.max(this.value(i), this.h_min),
+			    this.h_max));
+		}
+	}
+
+	return (this.h_max);
+};
+
+Histogram.prototype.summary = function () {
+	var us = function (ns) {
+		return (Math.round(ns) / 1000);
+	};
+
+	if (this.h_n === 0) {
+		return ({ samples: 0 });
+	}
+
+	return ({
+		samples: this.h_n,
+		min: us(this.h_min),
+		mean: us(this.h_sum / this.h_n),
+		p50: us(this.percentile(50)),
+		p90: us(this.percentile(90)),
+		p99: us(this.percentile(99)),
+		p999: us(this.percentile(99.9)),
+		max: us(this.h_max)
+	});
+};
+
+function
+usage(msg)
+{
+	if (msg) {
+		console.error('pipeline: %s', msg);
+	}
+	console.error('usage: pipeline [--modes=eager,lazy,packed] ' +
+	    '[--paths=direct,posted]\n' +
+	    '    [--attributes=N,...] [--streams=N,...] ' +
+	    '[--threads=N,...]\n' +
+	    '    [--rate=N] [--duration=MS] [--warmup=MS] ' +
+	    '[--queue-limit=N]\n' +
+	    '    [--output=FILE] [--baseline=FILE] ' +
+	    '[--tolerance=PERCENT]');
+	process.exit(2);
+}
+
+function
+parseList(name, val)
+{
+	return (val.split(',').map(function (v) {
+		var n = Number(v);
+
+		if (v === '' || !Number.isInteger(n) || n < 1) {
+			usage('--' + name + ' must be a list of positive ' +
+			    'integers');
+		}
+		return (n);
+	}));
+}
+
+function
+parseNumber(name, val, min)
+{
+	var n = Number(val);
+
+	if (val === '' || !Number.isFinite(n) || n < min) {
+		usage('--' + name + ' must be a number no less than ' + min);
+	}
+	return (n);
+}
+
+function
+parseArgs(argv)
+{
+	var opts = {};
+	var k;
+
+	for (k in DEFAULTS) {
+		opts[k] = DEFAULTS[k];
+	}
+
+	argv.forEach(function (arg) {
+		var m = /^--([a-z-]+)=(.*)$/.exec(arg);
+
+		if (arg === '--help' || arg === '-h') {
+			usage();
+		}
+		if (m === null) {
+			usage('unexpected argument "' + arg + '"');
+		}
+
+		switch (m[1]) {
+		case 'modes':
+			opts.modes = m[2].split(',');
+			opts.modes.forEach(function (mode) {
+				if (!TIME_OF.hasOwnProperty(mode)) {
+					usage('unknown mode "' + mode + '"');
+				}
+			});
+			break;
+		case 'paths':
+			opts.paths = m[2].split(',');
+			opts.paths.forEach(function (path) {
+				if (PATHS.indexOf(path) === -1) {
+					usage('unknown path "' + path + '"');
+				}
+				if (path === 'posted' &&
+				    process.platform !== 'linux') {
+					usage('the "posted" path is only ' +
+					    'available on Linux');
+				}
+			});
+			break;
+		case 'attributes':
+			opts.attributes = parseList(m[1], m[2]);
+			opts.attributes.forEach(function (n) {
+				if (n < ATTRIBUTES_MIN) {
+					usage('--attributes must be at ' +
+					    'least ' + ATTRIBUTES_MIN);
+				}
+			});
+			break;
+		case 'streams':
+		case 'threads':
+			opts[m[1]] = parseList(m[1], m[2]);
+			break;
+		case 'rate':
+			opts.rate = parseNumber(m[1], m[2], 1);
+			break;
+		case 'duration':
+			opts.duration = parseNumber(m[1], m[2], 1);
+			break;
+		case 'warmup':
+			opts.warmup = parseNumber(m[1], m[2], 0);
+			break;
+		case 'queue-limit':
+			opts.queueLimit = parseNumber(m[1], m[2], 1);
+			break;
+		case 'tolerance':
+			opts.tolerance = parseNumber(m[1], m[2], 0);
+			break;
+		case 'output':
+		case 'baseline':
+			opts[m[1]] = m[2];
+			break;
+		default:
+			usage('unknown option "--' + m[1] + '"');
+		}
+	});
+
+	return (opts);
+}
+
+function
+scenarios(opts)
+{
+	var list = [];
+
+	opts.paths.forEach(function (path) {
+	    opts.modes.forEach(function (mode) {
+		opts.attributes.forEach(function (attributes) {
+		    opts.streams.forEach(function (streams) {
+			opts.threads.forEach(function (threads) {
+			    [ 0, opts.rate ].forEach(function (rate) {
+				list.push({
+					name: mode + '/a' + attributes +
+					    '/s' + streams + '/t' + threads +
+					    '/r' + rate + (path === 'direct' ?
+					    '' : '/' + path),
+					path: path,
+					mode: mode,
+					attributes: attributes,
+					streams: streams,
+					threads: threads,
+					rate: rate
+				});
+			    });
+			});
+		    });
+		});
+	    });
+	});
+
+	return (list);
+}
+
+function
+droppedSince(streams, before)
+{
+	return (streams.reduce(function (sum, s, i) {
+		var st = s.getStats();
+
+		return (sum + (st.dropped - before[i].dropped) +
+		    (st.coalesced - before[i].coalesced));
+	}, 0));
+}
+
+function
+runScenario(opts, sc, callback)
+{
+	var streams = [];
+	var counts = [];
+	var hist = new Histogram();
+	var timeOf = TIME_OF[sc.mode];
+	var measuring = false;
+	var before, start, cpu;
+	var s, i;
+
+	mod_sysevent.configure({
+		source: 'synthetic',
+		synthetic: {
+			rate: sc.rate,
+			threads: sc.threads,
+			attributes: sc.attributes,
+			post: (sc.path === 'posted')
+		}
+	});
+
+	var handler = function (idx) {
+		if (idx !== 0) {
+			return (function () {
+				if (measuring) {
+					counts[idx]++;
+				}
+			});
+		}
+
+		return (function (ev) {
+			if (measuring) {
+				counts[0]++;
+				hist.record(since(timeOf(ev)));
+			}
+		});
+	};
+
+	for (i = 0; i < sc.streams; i++) {
+		s = mod_sysevent.createSyseventStream({
+			lazy: (sc.mode === 'lazy'),
+			packed: (sc.mode === 'packed')
+		});
+
+		s.on('data', handler(i));
+		streams.push(s);
+		counts.push(0);
+	}
+
+	setTimeout(function () {
+		before = streams.map(function (st) {
+			return (st.getStats());
+		});
+		cpu = process.cpuUsage();
+		start = now();
+		measuring = true;
+
+		setTimeout(function () {
+			var elapsed, used, dropped, secs;
+
+			measuring = false;
+			elapsed = since(start);
+			used = process.cpuUsage(cpu);
+			dropped = droppedSince(streams, before);
+			secs = elapsed / 1e9;
+
+			streams.forEach(function (st) {
+				st.destroy();
+			});
+
+			/*
+			 * Let events still queued for the destroyed streams
+			 * drain before the next run begins.
+			 */
+			setImmediate(callback, null, {
+				name: sc.name,
+				path: sc.path,
+				mode: sc.mode,
+				attributes: sc.attributes,
+				streams: sc.streams,
+				threads: sc.threads,
+				rate: sc.rate,
+				durationMs: Math.round(elapsed / 1e6),
+				events: counts[0],
+				eventsPerSec: Math.round(counts[0] / secs),
+				deliveriesPerSec: Math.round(counts.reduce(
+				    function (a, b) {
+					return (a + b);
+				}, 0) / secs),
+				latencyUs: hist.summary(),
+				dropped: dropped,
+				cpuUserMs: Math.round(used.user / 1000),
+				cpuSystemMs: Math.round(used.system / 1000)
+			});
+		}, opts.duration);
+	}, opts.warmup);
+}
+
+/*
+ * Compare results with those of the same name in "baseline", returning a
+ * description of each regression beyond the tolerance.
+ */
+function
+compare(results, baseline, tolerance)
+{
+	var byname = {};
+	var regressions = [];
+	var frac = tolerance / 100;
+
+	baseline.results.forEach(function (r) {
+		byname[r.name] = r;
+	});
+
+	results.forEach(function (r) {
+		var b = byname[r.name];
+
+		if (b === undefined) {
+			return;
+		}
+
+		if (r.rate === 0 &&
+		    r.eventsPerSec < b.eventsPerSec * (1 - frac)) {
+			regressions.push({
+				name: r.name,
+				metric: 'eventsPerSec',
+				baseline: b.eventsPerSec,
+				value: r.eventsPerSec
+			});
+		}
+
+		if (r.rate !== 0 && b.latencyUs.samples > 0 &&
+		    r.latencyUs.samples > 0 &&
+		    r.latencyUs.p99 > b.latencyUs.p99 * (1 + frac)) {
+			regressions.push({
+				name: r.name,
+				metric: 'latencyUs.p99',
+				baseline: b.latencyUs.p99,
+				value: r.latencyUs.p99
+			});
+		}
+	});
+
+	return (regressions);
+}
+
+function
+main()
+{
+	var opts = parseArgs(process.argv.slice(2));
+	var list = scenarios(opts);
+	var results = [];
+	var baseline = null;
+	var cpus = mod_os.cpus();
+
+	if (opts.baseline !== null) {
+		baseline = JSON.parse(mod_fs.readFileSync(opts.baseline,
+		    'utf8'));
+		if (baseline.version !== RESULTS_VERSION ||
+		    !Array.isArray(baseline.results)) {
+			usage('"' + opts.baseline + '" is not a result file');
+		}
+	}
+
+	mod_sysevent.configure({
+		queueLimit: opts.queueLimit,
+		overload: 'block'
+	});
+
+	var next = function () {
+		var sc = list[results.length];
+
+		if (sc === undefined) {
+			finish();
+			return;
+		}
+
+		console.error('[%d/%d] %s', results.length + 1, list.length,
+		    sc.name);
+		runScenario(opts, sc, function (_, r) {
+			console.error('\t%d events/s, p50 %s us, p99 %s us',
+			    r.eventsPerSec, r.latencyUs.p50, r.latencyUs.p99);
+			results.push(r);
+			next();
+		});
+	};
+
+	var finish = function () {
+		var out = {
+			version: RESULTS_VERSION,
+			date: new Date().toISOString(),
+			host: {
+				platform: process.platform,
+				arch: process.arch,
+				release: mod_os.release(),
+				node: process.version,
+				cpus: cpus.length,
+				cpuModel: (cpus.length > 0 ? cpus[0].model :
+				    null)
+			},
+			options: {
+				rate: opts.rate,
+				duration: opts.duration,
+				warmup: opts.warmup,
+				queueLimit: opts.queueLimit
+			},
+			results: results
+		};
+
+		if (baseline !== null) {
+			out.regressions = compare(results, baseline,
+			    opts.tolerance);
+		}
+
+		var json = JSON.stringify(out, null, 4) + '\n';
+		if (opts.output !== null) {
+			mod_fs.writeFileSync(opts.output, json);
+		} else {
+			process.stdout.write(json);
+		}
+
+		if (baseline !== null && out.regressions.length > 0) {
+			out.regressions.forEach(function (rg) {
+				console.error('regression: %s %s: %s -> %s',
+				    rg.name, rg.metric, rg.baseline, rg.value);
+			});
+			process.exitCode = 1;
+		}
+	};
+
+	next();
+}
+
+main();
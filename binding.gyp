@@ -16,16 +16,41 @@
 			},
 			"sources": [
 				"src/module.cc",
+				"src/convert.cc",
+				"src/intern.cc",
 				"src/more.c",
+				"src/filter.c",
+				"src/pool.c",
+				"src/flat.c",
+				"src/journal.c",
+				"src/replay.c",
+				"src/sysevent.c",
+				"src/synth.c",
 				"src/illumos_list.c",
 				"src/crossthread.c"
 			],
-			"libraries": [
-				"-lnvpair",
-				"-lsysevent"
-			],
 			"include_dirs": [
 				"<!(node -e \"require('nan')\")"
+			],
+			"conditions": [
+				[ "OS=='solaris'", {
+					"libraries": [
+						"-lnvpair",
+						"-lsysevent"
+					]
+				} ],
+				[ "OS=='linux'", {
+					"sources": [
+						"shim/libnvpair.c",
+						"shim/libsysevent.c"
+					],
+					"include_dirs": [
+						"shim"
+					],
+					"defines": [
+						"_GNU_SOURCE"
+					]
+				} ]
 			]
 		}
 	]
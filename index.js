@@ -28,67 +28,353 @@
 
 var mod_stream = require('stream');
 
-var SyseventImpl = require('bindings')('module').SyseventImpl;
+var mod_native = require('bindings')('module');
+var mod_packed = require('./packed');
+var mod_journal = require('./journal');
 
-var NEXT_ID = 1;
-var STREAMS = [];
-
-var SYSEVENT_IMPL = null;
+var SyseventImpl = mod_native.SyseventImpl;
 
+/*
+ * Each stream has its own native subscription, so that it receives only the
+ * events it asked for.  Options:
+ *
+ *	classes		An object mapping sysevent class names (e.g.
+ *			"EC_zfs") to either true, to receive every
+ *			subclass, or an array of subclass names.  If not
+ *			provided, events of every class are delivered; an
+ *			empty object selects no events at all.
+ *
+ *	vendors		A non-empty array of vendor names (e.g. "SUNW").
+ *
+ *	publishers	A non-empty array of publisher name prefixes.
+ *
+ *	attributes	An object mapping attribute names to the value the
+ *			attribute must have: a string, boolean or integer,
+ *			or "{ prefix: '...' }" to match the start of a
+ *			string attribute.
+ *
+ *	lazy		If true, "nvl1" is delivered as an attribute list
+ *			object with "get(name)", "has(name)", "keys()" and
+ *			"toObject()" methods.  Attributes are only converted
+ *			to Javascript values when asked for, which is much
+ *			cheaper for consumers that discard most events after
+ *			looking at the header in "nvl0".  Each attribute list
+ *			keeps the packed form of its event in native memory
+ *			(counted in "packedInUse") until it is collected, but
+ *			not the event's slot in the pool.
+ *
+ *	packed		If true, each event is delivered as a Buffer holding
+ *			the event in a compact binary format (see
+ *			"src/flat.h"), rather than as a record object; no
+ *			Javascript values are created for the event at all.
+ *			"decodePacked()" converts such a Buffer into the
+ *			record that would otherwise have been delivered.
+ *			The Buffer refers directly to native memory, without
+ *			a copy, and is shared with other packed streams that
+ *			receive the event; it must not be modified.  Cannot
+ *			be combined with "lazy" or "coalesce".
+ *
+ *	coalesce	An object, "{ attributes, window }", to collapse
+ *			bursts of similar events.  Events with the same
+ *			class, subclass and values for each of the named
+ *			"attributes" that arrive within "window"
+ *			milliseconds (default 100) of the first are
+ *			delivered once, at the end of the window: the
+ *			record holds the latest such event, and its
+ *			"repeat" property counts the events it stands for.
+ *			Events in which a named attribute is an array or
+ *			nested nvlist are not coalesced.
+ *
+ *	highWaterMark	The number of events the stream buffers before
+ *			delivery from the native layer is paused; see
+ *			"stream.Readable".
+ *
+ *	holdLimit	The number of events held in native memory while
+ *			delivery is paused (default 1024).  Once this many
+ *			are held, the oldest are discarded and counted as
+ *			"dropped", unless the "block" overload policy is in
+ *			effect with a "queueLimit": then further events wait
+ *			in the module-wide queue until the stream resumes,
+ *			and once that queue is full the publishers wait too,
+ *			delaying delivery to every stream.  See
+ *			"configure()".
+ *
+ * Filtering is performed in the native layer, before any Javascript objects
+ * are created for an event.  Each event is converted once, and every stream
+ * that receives it is given the same record object.  Records, and their
+ * "nvl0" and "nvl1" objects, are frozen, as they may be shared; values nested
+ * within "nvl1" are not frozen, but must not be modified either.
+ *
+ * Attributes of every nvpair type are converted: 64-bit integers and hrtime
+ * values become BigInts (where the runtime supports them), nested nvlists
+ * become objects and array types become arrays.
+ */
 function
-ensureImplExists()
+createSyseventStream(opts)
 {
-	if (SYSEVENT_IMPL !== null) {
-		return;
-	}
+	var impl;
+	var implopts = {};
 
-	SYSEVENT_IMPL = new SyseventImpl(function (nvl0, nvl1) {
-		STREAMS.forEach(function (s) {
-			s.push({
-				nvl0: nvl0,
-				nvl1: nvl1
-			});
+	if (opts !== undefined && opts !== null) {
+		if (typeof (opts) !== 'object') {
+			throw (new TypeError('opts must be an object'));
+		}
+		[ 'classes', 'vendors', 'publishers', 'attributes',
+		    'lazy', 'packed', 'coalesce', 'holdLimit' ].forEach(
+		    function (k) {
+			if (opts[k] !== undefined) {
+				implopts[k] = opts[k];
+			}
 		});
+	}
+
+	var sopts = {
+		objectMode: true
+	};
+	if (opts && opts.highWaterMark !== undefined) {
+		sopts.highWaterMark = opts.highWaterMark;
+	}
+
+	var s = new mod_stream.Readable(sopts);
+	var paused = false;
+
+	/*
+	 * Events are delivered in batches: each call receives an array of
+	 * frozen "{ nvl0, nvl1 }" records, shared with any other stream that
+	 * received the same events.  Once the stream's buffer is full, we ask
+	 * the native layer to hold further events until "_read()" is called.
+	 */
+	impl = new SyseventImpl(implopts, function (events) {
+		var more = true;
+
+		for (var i = 0; i < events.length; i++) {
+			more = s.push(events[i]);
+		}
+
+		if (!more && !paused && impl !== null) {
+			paused = true;
+			impl.pause();
+		}
 	});
+
+	s._read = function () {
+		if (paused && impl !== null) {
+			paused = false;
+			impl.resume();
+		}
+	};
+
+	/*
+	 * Returns counters for events that matched this stream's filters:
+	 * "delivered" to the stream, or discarded by the overload policy (or
+	 * a full hold, or an exhausted pool) as "dropped" or "coalesced"; and
+	 * the number of events "held" while the stream is paused.
+	 */
+	var laststats = null;
+	s.getStats = function () {
+		return (impl !== null ? impl.stats() : laststats);
+	};
+	s.destroy = function () {
+		if (impl !== null) {
+			laststats = impl.stats();
+			impl.destroy();
+			impl = null;
+		}
+	};
+
+	return (s);
 }
 
+/*
+ * Returns counters describing the operation of the native layer:
+ *
+ *	unknownTypes	attributes skipped because their nvpair data type
+ *			could not be converted
+ *
+ *	internHits,	lookups in the cache of property name strings that
+ *	internMisses	were satisfied from the cache, or were not
+ *
+ *	internEvictions	cache entries displaced by other names
+ *
+ *	poolSize,	the number of preallocated in-flight event records,
+ *	poolInUse	and the number currently in use
+ *
+ *	poolFallbacks	in-flight events allocated from the heap because the
+ *			pool was exhausted
+ *
+ *	packedInUse	packed events in native memory, including those
+ *			still referred to by a Buffer delivered in "packed"
+ *			mode
+ *
+ *	poolDrops	events discarded because the pool was exhausted (with
+ *			the "drop" policy) or memory could not be allocated
+ *
+ *	queued,		the number of events waiting for delivery to
+ *	queueLimit	Javascript, and the configured limit
+ *
+ *	queueDrops,	events discarded, or collapsed into a newer event,
+ *	queueCoalesced	by the overload policy
+ *
+ *	journalAppended	events written to the journal, and events that
+ *	journalErrors	could not be (because they were too large)
+ *
+ *	subscribeErrors	the number of times libsysevent refused to subscribe
+ *			to a class; events of that class are not received
+ *			until the subscriptions next change
+ */
 function
-checkImplStillNeeded()
+stats()
 {
-	if (SYSEVENT_IMPL === null) {
-		return;
-	}
+	return (mod_native.stats());
+}
 
-	if (STREAMS.length === 0) {
-		SYSEVENT_IMPL.destroy();
-		SYSEVENT_IMPL = null;
-	}
+/*
+ * Adjusts module-wide tuning.  Options that are not provided are unchanged:
+ *
+ *	poolSize	the number of in-flight events (received from
+ *			libsysevent, but not yet delivered to every stream)
+ *			for which records are preallocated; default 1024
+ *
+ *	poolExhausted	"malloc" (the default) to allocate records from the
+ *			heap once the pool is exhausted, or "drop" to discard
+ *			events that arrive while it is exhausted.  These are
+ *			counted as "dropped" by the streams that would have
+ *			received them (other than streams that filter on
+ *			attributes, which cannot be evaluated), but are not
+ *			journaled.
+ *
+ *	queueLimit	the number of events that may be waiting for delivery
+ *			to Javascript; 0 (the default) for no limit
+ *
+ *	overload	what to do once "queueLimit" events are waiting:
+ *
+ *			"block" (the default): libsysevent waits for room,
+ *			pushing back on the publishers
+ *
+ *			"drop-newest": discard arriving events
+ *
+ *			"drop-oldest": discard the oldest waiting events
+ *
+ *			"coalesce": discard waiting events for which a newer
+ *			event with the same class, subclass, vendor and
+ *			publisher is also waiting, then the oldest as needed
+ *
+ *	batchWindow	if non-zero, the minimum interval in milliseconds
+ *			between deliveries of events to Javascript; events
+ *			that arrive sooner are delivered together at the end
+ *			of the interval.  The default, 0, delivers events as
+ *			soon as possible.
+ *
+ *	batchSize	the number of waiting events that cuts short the
+ *			"batchWindow" interval (default 256)
+ *
+ *	journal		"{ path, size, syncInterval }" to record every event
+ *			received in a journal file at "path", which can be
+ *			read with "createJournalStream()", or null to stop.
+ *			The journal is a ring of "size" bytes (default 16MB);
+ *			once full, the oldest events are discarded.  Events
+ *			are numbered in sequence, continuing from those
+ *			already in an existing journal of the same size.  The
+ *			file is synced every "syncInterval" milliseconds
+ *			(default 1000; 0 leaves it to the system), but never
+ *			as events are written.
+ *
+ *	source		where events come from: "sysevent" (the default) to
+ *			receive events from libsysevent; "synthetic" to
+ *			receive events made up by the module itself, for
+ *			testing and benchmarking; or "replay" to receive only
+ *			the events replayed by "replay()".  Only the
+ *			"sysevent" source subscribes to libsysevent.
+ *
+ *	synthetic	"{ rate, threads, attributes, stringLength, classes,
+ *			post }" to configure the "synthetic" source.  "threads"
+ *			producer threads (default 1) between them make up
+ *			"rate" events per second (default 1000; 0 for as
+ *			many as can be delivered).  Each event's class and
+ *			subclass are chosen from "classes", an array of
+ *			"{ class, subclass, weight }" objects, in proportion
+ *			to their weights.  Events have "attributes"
+ *			attributes (default 8): "seq", a sequence number;
+ *			"time", the hrtime at which the event was made; then
+ *			alternately strings of "stringLength" characters
+ *			(default 16) and integers.  On Linux only, "post:
+ *			true" publishes the events through the bundled
+ *			libsysevent stand-in, from which they are received as
+ *			the "sysevent" source receives live events, rather
+ *			than handing them to the module directly.
+ *
+ * The pool can only be resized, and the source and its configuration
+ * changed, while no streams exist; the other settings may be changed at any
+ * time.  Discarded events are counted against each stream that would have
+ * received them; see the "getStats()" method of the stream.
+ *
+ * Every option is validated before any is applied, so an invalid option, or
+ * one that cannot be changed while streams exist, changes nothing.  A journal
+ * that cannot be opened is only discovered once the pool and source have
+ * been changed, which then remain changed.
+ */
+function
+configure(opts)
+{
+	mod_native.configure(opts);
 }
 
+/*
+ * Replays the events recorded in the journal at "path" (see the "journal"
+ * option to "configure()") to every stream, through the same filters and
+ * overload policy as live events.  Options:
+ *
+ *	from		the sequence number of the first event to replay;
+ *			by default, the oldest in the journal
+ *
+ *	speed		the rate of replay relative to the rate at which the
+ *			events were recorded: 1 (the default) preserves the
+ *			original timing, 10 replays ten times as fast, and 0
+ *			replays events as fast as they can be delivered
+ *
+ * "callback(err, count)" is called once the replay ends, with the number of
+ * events replayed.  Only one replay may run at a time.  A replay reads the
+ * events in the journal when it starts; events journaled afterwards are not
+ * replayed.  If the journal is still being written, and the writer overwrites
+ * events before they have been replayed, the replay ends early with an
+ * ESTALE error.
+ */
 function
-createSyseventStream()
+replay(path, opts, callback)
 {
-	ensureImplExists();
+	if (typeof (opts) === 'function' && callback === undefined) {
+		callback = opts;
+		opts = {};
+	}
+	if (typeof (path) !== 'string') {
+		throw (new TypeError('path must be a string'));
+	}
+	if (opts === undefined || opts === null) {
+		opts = {};
+	}
+	if (typeof (callback) !== 'function') {
+		throw (new TypeError('callback must be a function'));
+	}
 
-	var s = new mod_stream.Readable({
-		objectMode: true
-	});
-	s._stream_id = NEXT_ID++;
-	s._read = function () {};
-	s.destroy = function () {
-		for (var i = 0; i < STREAMS.length; i++) {
-			if (STREAMS[i]._stream_id === s._stream_id) {
-				STREAMS.splice(i, 1);
-				break;
-			}
-		}
-		checkImplStillNeeded();
-	};
-	STREAMS.push(s);
+	mod_native.replay(path, opts, callback);
+}
 
-	return (s);
+/*
+ * Stops the running replay; its callback is called with an ECANCELED error.
+ * Returns false if no replay was running.
+ */
+function
+stopReplay()
+{
+	return (mod_native.stopReplay());
 }
 
 module.exports = {
-	createSyseventStream: createSyseventStream
+	configure: configure,
+	createJournalStream: mod_journal.createJournalStream,
+	createSyseventStream: createSyseventStream,
+	decodePacked: mod_packed.decodePacked,
+	replay: replay,
+	stats: stats,
+	stopReplay: stopReplay
 };
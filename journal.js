@@ -0,0 +1,476 @@
+/* vim: set ts=8 sts=8 sw=8 noet: */
+
+
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2022 Joyent, Inc.
+ */
+
+/*
+ * Reader for the event journal written by the native layer when it is
+ * configured with the "journal" option; see "src/journal.c" for the format.
+ */
+
+var mod_fs = require('fs');
+var mod_os = require('os');
+var mod_stream = require('stream');
+
+var mod_packed = require('./packed');
+
+var JOURNAL_MAGIC = 0x4e534a4c;
+var JOURNAL_VERSION = 1;
+var JOURNAL_REC_MAGIC = 0x4e53524b;
+var JOURNAL_PAD_MAGIC = 0x4e535044;
+
+var JOURNAL_HDRSIZE = 4096;
+var JOURNAL_RECHDRLEN = 24;
+
+var LE = (mod_os.endianness() === 'LE');
+var HAVE_BIGINT = (typeof (BigInt) === 'function' &&
+    typeof (Buffer.prototype.readBigInt64LE) === 'function');
+
+function
+u32(buf, off)
+{
+	return (LE ? buf.readUInt32LE(off) : buf.readUInt32BE(off));
+}
+
+/*
+ * Positions and sequence numbers fit comfortably in a Number.
+ */
+function
+u64(buf, off)
+{
+	var hi = u32(buf, LE ? off + 4 : off);
+	var lo = u32(buf, LE ? off : off + 4);
+
+	return (hi * 0x100000000 + lo);
+}
+
+function
+hrtime(buf, off)
+{
+	if (HAVE_BIGINT) {
+		return (LE ? buf.readBigInt64LE(off) :
+		    buf.readBigInt64BE(off));
+	}
+
+	return (u64(buf, off));
+}
+
+/*
+ * The record area is read in chunks of this many bytes (or of one record, if
+ * that is larger), so that memory use does not grow with the journal.
+ */
+var JOURNAL_CHUNK = 1024 * 1024;
+
+function
+allocBuffer(n)
+{
+	return (typeof (Buffer.alloc) === 'function' ? Buffer.alloc(n) :
+	    new Buffer(n));
+}
+
+/*
+ * The errors with which a stream ends early, named as the native replay
+ * names them: ESTALE if the writer has overtaken the reader, and overwritten
+ * records it had yet to read; EINVAL if the journal is inconsistent.
+ */
+function
+journalError(code)
+{
+	var err = new Error(code === 'ESTALE' ?
+	    'sysevent journal overwritten while it was read' :
+	    'sysevent journal is inconsistent');
+
+	err.code = code;
+	return (err);
+}
+
+/*
+ * A reader of the journal open on "fd", visiting the records that were in
+ * the journal when "open()" read its header, oldest first, as
+ * "nsev_journal_reader_next()" in "src/journal.c" does.  The record area is
+ * read into a chunk, and the head read again afterwards: records in the
+ * chunk at or after that head were not overwritten while they were read.
+ * The journal may be written meanwhile, by this or another process.
+ */
+function
+JournalReader(fd)
+{
+	this.jr_fd = fd;
+	this.jr_size = 0;
+	this.jr_pos = 0;
+	this.jr_tail = 0;
+	this.jr_seq = 0;
+	this.jr_chunk = null;	/* the bytes most recently read ... */
+	this.jr_chunkpos = 0;	/* ... from this position ... */
+	this.jr_chunkhead = 0;	/* ... and the head read after them */
+}
+
+/*
+ * Read exactly "len" bytes at "off" in the file into a new Buffer.
+ */
+JournalReader.prototype.read = function (off, len, callback) {
+	var buf = allocBuffer(len);
+
+	mod_fs.read(this.jr_fd, buf, 0, len, off, function (err, n) {
+		if (err) {
+			callback(err);
+		} else if (n < len) {
+			callback(new Error('truncated sysevent journal'));
+		} else {
+			callback(null, buf);
+		}
+	});
+};
+
+/*
+ * Read and check the header, which determines the records to visit.
+ */
+JournalReader.prototype.open = function (callback) {
+	var self = this;
+
+	mod_fs.fstat(self.jr_fd, function (err, st) {
+		if (err) {
+			callback(err);
+			return;
+		}
+		if (st.size < JOURNAL_HDRSIZE) {
+			callback(new Error('not a sysevent journal'));
+			return;
+		}
+
+		self.read(0, 48, function (err2, hdr) {
+			if (err2) {
+				callback(err2);
+				return;
+			}
+			if (u32(hdr, 0) !== JOURNAL_MAGIC) {
+				callback(new Error('not a sysevent journal'));
+				return;
+			}
+			if (u32(hdr, 4) !== JOURNAL_VERSION) {
+				callback(new Error('unsupported sysevent ' +
+				    'journal version ' + u32(hdr, 4)));
+				return;
+			}
+
+			self.jr_size = u64(hdr, 8);
+			self.jr_pos = u64(hdr, 16);
+			self.jr_tail = u64(hdr, 24);
+			self.jr_seq = u64(hdr, 32);
+
+			if (st.size < JOURNAL_HDRSIZE + self.jr_size) {
+				callback(new Error('truncated sysevent ' +
+				    'journal'));
+				return;
+			}
+			if (self.jr_size === 0 || self.jr_pos > self.jr_tail ||
+			    self.jr_tail - self.jr_pos > self.jr_size) {
+				callback(journalError('EINVAL'));
+				return;
+			}
+			callback(null);
+		});
+	});
+};
+
+/*
+ * Read the chunk of the record area starting at position "pos", which must
+ * hold at least "need" bytes, then the head.
+ */
+JournalReader.prototype.fill = function (pos, need, callback) {
+	var self = this;
+	var off = pos % self.jr_size;
+	var len = Math.min(Math.max(JOURNAL_CHUNK, need), self.jr_size - off,
+	    self.jr_tail - pos);
+
+	if (len < need) {
+		callback(journalError('EINVAL'));
+		return;
+	}
+
+	self.read(JOURNAL_HDRSIZE + off, len, function (err, chunk) {
+		if (err) {
+			callback(err);
+			return;
+		}
+
+		self.read(16, 8, function (err2, head) {
+			if (err2) {
+				callback(err2);
+				return;
+			}
+
+			self.jr_chunk = chunk;
+			self.jr_chunkpos = pos;
+			self.jr_chunkhead = u64(head, 0);
+			callback(null);
+		});
+	});
+};
+
+/*
+ * Call "callback(err, rec)" with the next event record, as
+ * "{ seq, time, event }"; or with a null "rec" once every record has been
+ * visited.  Fails with an ESTALE or EINVAL error (see "journalError()") if
+ * the remaining records cannot all be read.
+ */
+JournalReader.prototype.next = function (callback) {
+	var self = this;
+	var pos, off, coff, magic, rsize, seq, rec;
+
+	while (self.jr_pos < self.jr_tail) {
+		pos = self.jr_pos;
+		off = pos % self.jr_size;
+
+		if (self.jr_size - off < JOURNAL_RECHDRLEN) {
+			self.jr_pos += self.jr_size - off;
+			continue;
+		}
+
+		coff = pos - self.jr_chunkpos;
+		if (self.jr_chunk === null || pos < self.jr_chunkpos ||
+		    coff + JOURNAL_RECHDRLEN > self.jr_chunk.length) {
+			self.fill(pos, JOURNAL_RECHDRLEN, function (err) {
+				if (err) {
+					callback(err);
+				} else {
+					self.next(callback);
+				}
+			});
+			return;
+		}
+
+		magic = u32(self.jr_chunk, coff);
+		rsize = u32(self.jr_chunk, coff + 4);
+		if (rsize < JOURNAL_RECHDRLEN || rsize > self.jr_size - off ||
+		    (magic !== JOURNAL_REC_MAGIC &&
+		    magic !== JOURNAL_PAD_MAGIC)) {
+			callback(journalError(pos < self.jr_chunkhead ?
+			    'ESTALE' : 'EINVAL'));
+			return;
+		}
+
+		if (coff + rsize > self.jr_chunk.length) {
+			self.fill(pos, rsize, function (err) {
+				if (err) {
+					callback(err);
+				} else {
+					self.next(callback);
+				}
+			});
+			return;
+		}
+
+		if (pos < self.jr_chunkhead) {
+			callback(journalError('ESTALE'));
+			return;
+		}
+		self.jr_pos += rsize;
+
+		if (magic === JOURNAL_PAD_MAGIC) {
+			continue;
+		}
+
+		seq = u64(self.jr_chunk, coff + 8);
+		if (seq !== self.jr_seq) {
+			callback(journalError('EINVAL'));
+			return;
+		}
+		self.jr_seq++;
+
+		rec = {
+			seq: seq,
+			time: hrtime(self.jr_chunk, coff + 16),
+			event: self.jr_chunk.slice(coff + JOURNAL_RECHDRLEN,
+			    coff + rsize)
+		};
+		setImmediate(callback, null, rec);
+		return;
+	}
+
+	setImmediate(callback, null, null);
+};
+
+/*
+ * Create a stream of the events recorded in the journal at "path", from
+ * the oldest still in the journal, or from sequence number "from" if that is
+ * later.  Each event is delivered as "{ seq, time, nvl0, nvl1 }", where
+ * "seq" is the sequence number assigned to the event when it was
+ * journaled and "time" the gethrtime() value at that moment; or, with
+ * "packed: true", as "{ seq, time, event }", where "event" is the packed
+ * Buffer (see "decodePacked()").
+ *
+ * The stream ends at the end of the journal as it was when the stream
+ * started reading it; events journaled after that are not included.  The
+ * journal is read in chunks, and may be written meanwhile: each chunk is
+ * checked against the head once it has been read, so no event is delivered
+ * from bytes the writer overwrote.  If the writer overtakes the stream,
+ * discarding events it had yet to deliver, the stream emits an error with
+ * code ESTALE; if the journal is inconsistent (corrupt, or not one sequence
+ * of events), one with code EINVAL.  Either way, events were lost, as they
+ * are by a replay that fails in the same way.
+ */
+function
+createJournalStream(path, opts)
+{
+	var from = 0;
+	var packed = false;
+
+	if (typeof (path) !== 'string') {
+		throw (new TypeError('path must be a string'));
+	}
+	if (opts !== undefined && opts !== null) {
+		if (typeof (opts) !== 'object') {
+			throw (new TypeError('opts must be an object'));
+		}
+		if (opts.from !== undefined) {
+			if (typeof (opts.from) !== 'number' || opts.from < 0 ||
+			    Math.floor(opts.from) !== opts.from) {
+				throw (new TypeError('"from" must be a ' +
+				    'non-negative integer'));
+			}
+			from = opts.from;
+		}
+		if (opts.packed !== undefined) {
+			if (typeof (opts.packed) !== 'boolean') {
+				throw (new TypeError('"packed" must be a ' +
+				    'boolean'));
+			}
+			packed = opts.packed;
+		}
+	}
+
+	var s = new mod_stream.Readable({ objectMode: true });
+	var jr = null;
+	var busy = false;
+	var done = false;
+
+	function
+	finish(err)
+	{
+		done = true;
+		if (jr !== null) {
+			mod_fs.close(jr.jr_fd, function () {});
+			jr = null;
+		}
+		if (err) {
+			s.emit('error', err);
+		} else {
+			s.push(null);
+		}
+	}
+
+	function
+	pump()
+	{
+		busy = true;
+		jr.next(function (err, rec) {
+			var more;
+
+			busy = false;
+			if (done) {
+				return;
+			}
+			if (err) {
+				finish(err);
+				return;
+			}
+			if (rec === null) {
+				finish(null);
+				return;
+			}
+			if (rec.seq < from) {
+				pump();
+				return;
+			}
+
+			if (!packed) {
+				try {
+					var r = mod_packed.decodePacked(
+					    rec.event);
+					rec = { seq: rec.seq, time: rec.time,
+					    nvl0: r.nvl0, nvl1: r.nvl1 };
+				} catch (err2) {
+					finish(err2);
+					return;
+				}
+			}
+
+			more = s.push(rec);
+			if (more) {
+				pump();
+			}
+		});
+	}
+
+	s._read = function () {
+		if (busy || done) {
+			return;
+		}
+		if (jr !== null) {
+			pump();
+			return;
+		}
+
+		busy = true;
+		mod_fs.open(path, 'r', function (err, fd) {
+			if (err) {
+				busy = false;
+				finish(err);
+				return;
+			}
+			if (done) {
+				mod_fs.close(fd, function () {});
+				return;
+			}
+
+			jr = new JournalReader(fd);
+			jr.open(function (err2) {
+				busy = false;
+				if (err2) {
+					finish(err2);
+				} else if (!done) {
+					pump();
+				}
+			});
+		});
+	};
+
+	s._destroy = function (err, callback) {
+		done = true;
+		if (jr !== null) {
+			mod_fs.close(jr.jr_fd, function () {});
+			jr = null;
+		}
+		callback(err);
+	};
+
+	return (s);
+}
+
+module.exports = {
+	createJournalStream: createJournalStream
+};
@@ -0,0 +1,402 @@
+/* vim: set ts=8 sts=8 sw=8 noet: */
+
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2022 Joyent, Inc.
+ */
+
+/*
+ * Decoder for events delivered by streams in "packed" mode.  Each event is a
+ * Buffer in the format described in "src/flat.h": a fixed header, the four
+ * names from the event header, then the attribute list as a sequence of
+ * type-tagged records.  Values are in the byte order of the host that
+ * produced the Buffer.
+ */
+
+var mod_os = require('os');
+
+var PACKED_MAGIC = 0x4e534556;
+var PACKED_VERSION = 1;
+var PACKED_F_KERNEL = 0x1;
+
+var PACKED_HDRLEN = 24;
+var RECORD_HDRLEN = 16;
+var FLAT_HDRLEN = 8;
+
+/*
+ * The deepest nesting of nvlists accepted; see NSEV_FLAT_MAXDEPTH in
+ * "flat.h".
+ */
+var FLAT_MAXDEPTH = 32;
+
+/*
+ * The libnvpair "data_type_t" values used as record types:
+ */
+var DATA_TYPE_BOOLEAN = 1;
+var DATA_TYPE_BYTE = 2;
+var DATA_TYPE_INT16 = 3;
+var DATA_TYPE_UINT16 = 4;
+var DATA_TYPE_INT32 = 5;
+var DATA_TYPE_UINT32 = 6;
+var DATA_TYPE_INT64 = 7;
+var DATA_TYPE_UINT64 = 8;
+var DATA_TYPE_STRING = 9;
+var DATA_TYPE_BYTE_ARRAY = 10;
+var DATA_TYPE_INT16_ARRAY = 11;
+var DATA_TYPE_UINT16_ARRAY = 12;
+var DATA_TYPE_INT32_ARRAY = 13;
+var DATA_TYPE_UINT32_ARRAY = 14;
+var DATA_TYPE_INT64_ARRAY = 15;
+var DATA_TYPE_UINT64_ARRAY = 16;
+var DATA_TYPE_STRING_ARRAY = 17;
+var DATA_TYPE_HRTIME = 18;
+var DATA_TYPE_NVLIST = 19;
+var DATA_TYPE_NVLIST_ARRAY = 20;
+var DATA_TYPE_BOOLEAN_VALUE = 21;
+var DATA_TYPE_INT8 = 22;
+var DATA_TYPE_UINT8 = 23;
+var DATA_TYPE_BOOLEAN_ARRAY = 24;
+var DATA_TYPE_INT8_ARRAY = 25;
+var DATA_TYPE_UINT8_ARRAY = 26;
+var DATA_TYPE_DOUBLE = 27;
+
+var LE = (mod_os.endianness() === 'LE');
+var HAVE_BIGINT = (typeof (BigInt) === 'function' &&
+    typeof (Buffer.prototype.readBigInt64LE) === 'function');
+
+function
+u16(buf, off)
+{
+	return (LE ? buf.readUInt16LE(off) : buf.readUInt16BE(off));
+}
+
+function
+u32(buf, off)
+{
+	return (LE ? buf.readUInt32LE(off) : buf.readUInt32BE(off));
+}
+
+function
+i32(buf, off)
+{
+	return (LE ? buf.readInt32LE(off) : buf.readInt32BE(off));
+}
+
+/*
+ * 64-bit integers become BigInts where the runtime supports them, and
+ * Numbers (with a possible loss of precision) elsewhere, as in the native
+ * conversion.
+ */
+function
+i64(buf, off)
+{
+	if (HAVE_BIGINT) {
+		return (LE ? buf.readBigInt64LE(off) :
+		    buf.readBigInt64BE(off));
+	}
+
+	var hi = LE ? buf.readInt32LE(off + 4) : buf.readInt32BE(off);
+	var lo = LE ? buf.readUInt32LE(off) : buf.readUInt32BE(off + 4);
+	return (hi * 0x100000000 + lo);
+}
+
+function
+u64(buf, off)
+{
+	if (HAVE_BIGINT) {
+		return (LE ? buf.readBigUInt64LE(off) :
+		    buf.readBigUInt64BE(off));
+	}
+
+	var hi = LE ? buf.readUInt32LE(off + 4) : buf.readUInt32BE(off);
+	var lo = LE ? buf.readUInt32LE(off) : buf.readUInt32BE(off + 4);
+	return (hi * 0x100000000 + lo);
+}
+
+function
+align8(n)
+{
+	return ((n + 7) & ~7);
+}
+
+function
+malformed()
+{
+	return (new Error('malformed packed sysevent'));
+}
+
+/*
+ * Read the NUL-terminated string at "off", which must end before "lim";
+ * returns the string and the offset just past its NUL.
+ */
+function
+cstring(buf, off, lim)
+{
+	var end = off;
+
+	while (end < lim && buf[end] !== 0) {
+		end++;
+	}
+	if (end >= lim) {
+		throw (malformed());
+	}
+
+	return ({ str: buf.toString('utf8', off, end), next: end + 1 });
+}
+
+/*
+ * For each scalar type (and the corresponding array type), the size of one
+ * element and a function to read it.
+ */
+var SCALARS = {};
+SCALARS[DATA_TYPE_BOOLEAN_VALUE] = [ 4, function (b, o) {
+	return (i32(b, o) !== 0); } ];
+SCALARS[DATA_TYPE_BYTE] = [ 1, function (b, o) { return (b.readUInt8(o)); } ];
+SCALARS[DATA_TYPE_INT8] = [ 1, function (b, o) { return (b.readInt8(o)); } ];
+SCALARS[DATA_TYPE_UINT8] = [ 1, function (b, o) {
+	return (b.readUInt8(o)); } ];
+SCALARS[DATA_TYPE_INT16] = [ 2, function (b, o) {
+	return (LE ? b.readInt16LE(o) : b.readInt16BE(o)); } ];
+SCALARS[DATA_TYPE_UINT16] = [ 2, u16 ];
+SCALARS[DATA_TYPE_INT32] = [ 4, i32 ];
+SCALARS[DATA_TYPE_UINT32] = [ 4, u32 ];
+SCALARS[DATA_TYPE_INT64] = [ 8, i64 ];
+SCALARS[DATA_TYPE_UINT64] = [ 8, u64 ];
+SCALARS[DATA_TYPE_HRTIME] = [ 8, i64 ];
+SCALARS[DATA_TYPE_DOUBLE] = [ 8, function (b, o) {
+	return (LE ? b.readDoubleLE(o) : b.readDoubleBE(o)); } ];
+
+var ARRAYS = {};
+ARRAYS[DATA_TYPE_BOOLEAN_ARRAY] = DATA_TYPE_BOOLEAN_VALUE;
+ARRAYS[DATA_TYPE_BYTE_ARRAY] = DATA_TYPE_BYTE;
+ARRAYS[DATA_TYPE_INT8_ARRAY] = DATA_TYPE_INT8;
+ARRAYS[DATA_TYPE_UINT8_ARRAY] = DATA_TYPE_UINT8;
+ARRAYS[DATA_TYPE_INT16_ARRAY] = DATA_TYPE_INT16;
+ARRAYS[DATA_TYPE_UINT16_ARRAY] = DATA_TYPE_UINT16;
+ARRAYS[DATA_TYPE_INT32_ARRAY] = DATA_TYPE_INT32;
+ARRAYS[DATA_TYPE_UINT32_ARRAY] = DATA_TYPE_UINT32;
+ARRAYS[DATA_TYPE_INT64_ARRAY] = DATA_TYPE_INT64;
+ARRAYS[DATA_TYPE_UINT64_ARRAY] = DATA_TYPE_UINT64;
+
+/*
+ * Read the header of the record at "off", which must lie entirely before
+ * "lim", checking it as "nsev_flat_check_recs()" does.
+ */
+function
+readRecord(buf, off, lim)
+{
+	var rec, namelen;
+
+	if (lim - off < RECORD_HDRLEN) {
+		throw (malformed());
+	}
+
+	namelen = u16(buf, off + 6);
+	rec = {
+		size: u32(buf, off),
+		type: u16(buf, off + 4),
+		nelem: u32(buf, off + 8),
+		vlen: u32(buf, off + 12),
+		value: off + RECORD_HDRLEN + align8(namelen)
+	};
+
+	if (rec.size > lim - off || namelen === 0 ||
+	    rec.size !== RECORD_HDRLEN + align8(namelen) + align8(rec.vlen) ||
+	    buf[off + RECORD_HDRLEN + namelen - 1] !== 0) {
+		throw (malformed());
+	}
+	rec.name = buf.toString('utf8', off + RECORD_HDRLEN,
+	    off + RECORD_HDRLEN + namelen - 1);
+
+	return (rec);
+}
+
+/*
+ * Decode the value of the record "rec", which is nested in "depth" nvlists.
+ * Returns undefined for types we do not know how to decode; such attributes
+ * are skipped, as they are by the native conversion.
+ */
+function
+decodeValue(buf, rec, depth)
+{
+	var off = rec.value;
+	var lim = rec.value + rec.vlen;
+	var arr, s, e, i;
+
+	if (SCALARS.hasOwnProperty(rec.type)) {
+		s = SCALARS[rec.type];
+		if (rec.vlen !== s[0]) {
+			throw (malformed());
+		}
+		return (s[1](buf, off));
+	}
+
+	if (ARRAYS.hasOwnProperty(rec.type)) {
+		s = SCALARS[ARRAYS[rec.type]];
+		if (rec.vlen !== rec.nelem * s[0]) {
+			throw (malformed());
+		}
+		arr = [];
+		for (i = 0; i < rec.nelem; i++) {
+			arr.push(s[1](buf, off + i * s[0]));
+		}
+		return (arr);
+	}
+
+	switch (rec.type) {
+	case DATA_TYPE_BOOLEAN:
+		return (true);
+
+	case DATA_TYPE_STRING:
+		return (cstring(buf, off, lim).str);
+
+	case DATA_TYPE_STRING_ARRAY:
+		arr = [];
+		for (i = 0; i < rec.nelem; i++) {
+			s = cstring(buf, off, lim);
+			arr.push(s.str);
+			off = s.next;
+		}
+		return (arr);
+
+	case DATA_TYPE_NVLIST:
+		return (decodeRecords(buf, off, lim, rec.nelem, depth + 1));
+
+	case DATA_TYPE_NVLIST_ARRAY:
+		arr = [];
+		for (i = 0; i < rec.nelem; i++) {
+			e = readRecord(buf, off, lim);
+			if (e.type !== DATA_TYPE_NVLIST) {
+				throw (malformed());
+			}
+			arr.push(decodeRecords(buf, e.value,
+			    e.value + e.vlen, e.nelem, depth + 1));
+			off += e.size;
+		}
+		return (arr);
+
+	default:
+		return (undefined);
+	}
+}
+
+/*
+ * Decode "count" consecutive records, starting at "off" and ending before
+ * "lim" and nested in "depth" nvlists, into an object.
+ */
+function
+decodeRecords(buf, off, lim, count, depth)
+{
+	var obj = {};
+	var i;
+
+	if (depth > FLAT_MAXDEPTH) {
+		throw (malformed());
+	}
+
+	for (i = 0; i < count; i++) {
+		var rec = readRecord(buf, off, lim);
+		var val = decodeValue(buf, rec, depth);
+
+		if (val !== undefined) {
+			obj[rec.name] = val;
+		}
+		off += rec.size;
+	}
+
+	return (obj);
+}
+
+/*
+ * Decode a packed event into the "{ nvl0, nvl1 }" record that would have
+ * been delivered had "packed" mode not been used.  Throws if the Buffer is
+ * not a packed event, is of a version this decoder does not understand, or
+ * is truncated or malformed.
+ */
+function
+decodePacked(buf)
+{
+	var names = [];
+	var size, attrs, end, off, s, i;
+
+	if (!Buffer.isBuffer(buf) || buf.length < PACKED_HDRLEN ||
+	    u32(buf, 0) !== PACKED_MAGIC) {
+		throw (new TypeError('not a packed sysevent'));
+	}
+	if (u16(buf, 4) !== PACKED_VERSION) {
+		throw (new Error('unsupported packed sysevent version ' +
+		    u16(buf, 4)));
+	}
+	size = u32(buf, 8);
+	if (size > buf.length) {
+		throw (new Error('truncated packed sysevent'));
+	}
+	if (size < PACKED_HDRLEN) {
+		throw (malformed());
+	}
+
+	/*
+	 * The four names must each be terminated before the attribute list
+	 * (or the end of the event, if there is none).
+	 */
+	attrs = u32(buf, 16);
+	end = attrs !== 0 ? attrs : size;
+	if (end > size) {
+		throw (malformed());
+	}
+	off = PACKED_HDRLEN;
+	for (i = 0; i < 4; i++) {
+		s = cstring(buf, off, end);
+		names.push(s.str);
+		off = s.next;
+	}
+
+	var nvl0 = {
+		class_name: names[0],
+		subclass_name: names[1],
+		vendor_name: names[2],
+		publisher_name: names[3],
+		source: (u16(buf, 6) & PACKED_F_KERNEL) ? 'kernel' : 'user',
+		pid: i32(buf, 12)
+	};
+
+	var nvl1 = {};
+	if (attrs !== 0) {
+		if (attrs !== align8(attrs) || size - attrs < FLAT_HDRLEN) {
+			throw (malformed());
+		}
+		var flatsz = u32(buf, attrs);
+		if (flatsz < FLAT_HDRLEN || flatsz > size - attrs) {
+			throw (malformed());
+		}
+		nvl1 = decodeRecords(buf, attrs + FLAT_HDRLEN, attrs + flatsz,
+		    u32(buf, attrs + 4), 0);
+	}
+
+	return ({ nvl0: nvl0, nvl1: nvl1 });
+}
+
+module.exports = {
+	decodePacked: decodePacked,
+	PACKED_VERSION: PACKED_VERSION
+};
@@ -0,0 +1,150 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2022 Joyent, Inc.
+ */
+
+/*
+ * A stand-in for the atomic operations in <atomic.h> on illumos, built on the
+ * compiler's __atomic builtins.  The operations are sequentially consistent,
+ * which is at least as strong as the illumos versions.
+ */
+
+#ifndef	_SHIM_ATOMIC_H
+#define	_SHIM_ATOMIC_H
+
+#include <stdint.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+static inline void
+atomic_inc_32(volatile uint32_t *target)
+{
+	(void) __atomic_add_fetch(target, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline void
+atomic_dec_32(volatile uint32_t *target)
+{
+	(void) __atomic_sub_fetch(target, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline void
+atomic_add_32(volatile uint32_t *target, int32_t delta)
+{
+	(void) __atomic_add_fetch(target, delta, __ATOMIC_SEQ_CST);
+}
+
+static inline uint32_t
+atomic_inc_32_nv(volatile uint32_t *target)
+{
+	return (__atomic_add_fetch(target, 1, __ATOMIC_SEQ_CST));
+}
+
+static inline uint32_t
+atomic_dec_32_nv(volatile uint32_t *target)
+{
+	return (__atomic_sub_fetch(target, 1, __ATOMIC_SEQ_CST));
+}
+
+static inline uint32_t
+atomic_add_32_nv(volatile uint32_t *target, int32_t delta)
+{
+	return (__atomic_add_fetch(target, delta, __ATOMIC_SEQ_CST));
+}
+
+static inline void
+atomic_inc_64(volatile uint64_t *target)
+{
+	(void) __atomic_add_fetch(target, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline void
+atomic_dec_64(volatile uint64_t *target)
+{
+	(void) __atomic_sub_fetch(target, 1, __ATOMIC_SEQ_CST);
+}
+
+static inline void
+atomic_add_64(volatile uint64_t *target, int64_t delta)
+{
+	(void) __atomic_add_fetch(target, delta, __ATOMIC_SEQ_CST);
+}
+
+static inline uint64_t
+atomic_inc_64_nv(volatile uint64_t *target)
+{
+	return (__atomic_add_fetch(target, 1, __ATOMIC_SEQ_CST));
+}
+
+static inline uint64_t
+atomic_add_64_nv(volatile uint64_t *target, int64_t delta)
+{
+	return (__atomic_add_fetch(target, delta, __ATOMIC_SEQ_CST));
+}
+
+static inline void *
+atomic_cas_ptr(volatile void *target, void *cmp, void *newval)
+{
+	(void) __atomic_compare_exchange_n((void *volatile *)target, &cmp,
+	    newval, 0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+	return (cmp);
+}
+
+static inline void *
+atomic_swap_ptr(volatile void *target, void *newval)
+{
+	return (__atomic_exchange_n((void *volatile *)target, newval,
+	    __ATOMIC_SEQ_CST));
+}
+
+static inline void
+membar_producer(void)
+{
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void
+membar_consumer(void)
+{
+	__atomic_thread_fence(__ATOMIC_ACQUIRE);
+}
+
+static inline void
+membar_enter(void)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+static inline void
+membar_exit(void)
+{
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* !_SHIM_ATOMIC_H */
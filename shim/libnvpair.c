@@ -0,0 +1,703 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2022 Joyent, Inc.
+ */
+
+/*
+ * A minimal, in-memory implementation of the libnvpair interfaces this module
+ * uses, so that it can be built and exercised on systems without libnvpair.
+ * An nvlist is a singly-linked list of pairs, in the order they were added.
+ * As in libnvpair, values are copied when they are added, and lookups return
+ * pointers into the list; adding a pair to a list created with
+ * NV_UNIQUE_NAME (or NV_UNIQUE_NAME_TYPE) first removes any pair of the same
+ * name (and type).  Packing, and the allocator interfaces, are not provided.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+
+#include "libnvpair.h"
+
+struct nvpair {
+	nvpair_t *nvp_next;
+	char *nvp_name;
+	data_type_t nvp_type;
+	uint_t nvp_nelem;
+	union {
+		uint64_t nvpu_scalar;	/* every scalar fits in 8 bytes */
+		double nvpu_double;
+		char *nvpu_string;
+		nvlist_t *nvpu_nvlist;
+		void *nvpu_array;	/* scalar, string and nvlist arrays */
+	} nvp_u;
+};
+
+struct nvlist {
+	uint_t nvl_flag;
+	nvpair_t *nvl_head;
+	nvpair_t *nvl_tail;
+};
+
+/*
+ * The size of one element of a scalar, or scalar array, type; 0 for other
+ * types.
+ */
+static size_t
+nvpair_elem_size(data_type_t type)
+{
+	switch (type) {
+	case DATA_TYPE_BOOLEAN_VALUE:
+	case DATA_TYPE_BOOLEAN_ARRAY:
+		return (sizeof (boolean_t));
+	case DATA_TYPE_BYTE:
+	case DATA_TYPE_BYTE_ARRAY:
+	case DATA_TYPE_INT8:
+	case DATA_TYPE_INT8_ARRAY:
+	case DATA_TYPE_UINT8:
+	case DATA_TYPE_UINT8_ARRAY:
+		return (1);
+	case DATA_TYPE_INT16:
+	case DATA_TYPE_INT16_ARRAY:
+	case DATA_TYPE_UINT16:
+	case DATA_TYPE_UINT16_ARRAY:
+		return (2);
+	case DATA_TYPE_INT32:
+	case DATA_TYPE_INT32_ARRAY:
+	case DATA_TYPE_UINT32:
+	case DATA_TYPE_UINT32_ARRAY:
+		return (4);
+	case DATA_TYPE_INT64:
+	case DATA_TYPE_INT64_ARRAY:
+	case DATA_TYPE_UINT64:
+	case DATA_TYPE_UINT64_ARRAY:
+	case DATA_TYPE_HRTIME:
+		return (8);
+	case DATA_TYPE_DOUBLE:
+		return (sizeof (double));
+	default:
+		return (0);
+	}
+}
+
+static int
+nvpair_is_array(data_type_t type)
+{
+	switch (type) {
+	case DATA_TYPE_BOOLEAN_ARRAY:
+	case DATA_TYPE_BYTE_ARRAY:
+	case DATA_TYPE_INT8_ARRAY:
+	case DATA_TYPE_UINT8_ARRAY:
+	case DATA_TYPE_INT16_ARRAY:
+	case DATA_TYPE_UINT16_ARRAY:
+	case DATA_TYPE_INT32_ARRAY:
+	case DATA_TYPE_UINT32_ARRAY:
+	case DATA_TYPE_INT64_ARRAY:
+	case DATA_TYPE_UINT64_ARRAY:
+	case DATA_TYPE_STRING_ARRAY:
+	case DATA_TYPE_NVLIST_ARRAY:
+		return (1);
+	default:
+		return (0);
+	}
+}
+
+static void
+nvpair_free(nvpair_t *nvp)
+{
+	uint_t i;
+
+	switch (nvp->nvp_type) {
+	case DATA_TYPE_STRING:
+		free(nvp->nvp_u.nvpu_string);
+		break;
+	case DATA_TYPE_NVLIST:
+		nvlist_free(nvp->nvp_u.nvpu_nvlist);
+		break;
+	case DATA_TYPE_STRING_ARRAY:
+		for (i = 0; nvp->nvp_u.nvpu_array != NULL &&
+		    i < nvp->nvp_nelem; i++) {
+			free(((char **)nvp->nvp_u.nvpu_array)[i]);
+		}
+		free(nvp->nvp_u.nvpu_array);
+		break;
+	case DATA_TYPE_NVLIST_ARRAY:
+		for (i = 0; nvp->nvp_u.nvpu_array != NULL &&
+		    i < nvp->nvp_nelem; i++) {
+			nvlist_free(((nvlist_t **)nvp->nvp_u.nvpu_array)[i]);
+		}
+		free(nvp->nvp_u.nvpu_array);
+		break;
+	default:
+		if (nvpair_is_array(nvp->nvp_type)) {
+			free(nvp->nvp_u.nvpu_array);
+		}
+		break;
+	}
+
+	free(nvp->nvp_name);
+	free(nvp);
+}
+
+/*
+ * Copy "nelem" elements of "data" into the new pair "nvp", of type "type".
+ * For scalar types, "data" points to the value; for strings and nvlists, it
+ * is the string or nvlist itself; for arrays, it points to the first element.
+ */
+static int
+nvpair_fill(nvpair_t *nvp, data_type_t type, uint_t nelem, const void *data)
+{
+	size_t sz = nvpair_elem_size(type);
+	uint_t i;
+
+	nvp->nvp_type = type;
+	nvp->nvp_nelem = nelem;
+
+	switch (type) {
+	case DATA_TYPE_BOOLEAN:
+		nvp->nvp_nelem = 0;
+		return (0);
+
+	case DATA_TYPE_STRING:
+		if (data == NULL) {
+			return (EINVAL);
+		}
+		if ((nvp->nvp_u.nvpu_string = strdup(data)) == NULL) {
+			return (ENOMEM);
+		}
+		return (0);
+
+	case DATA_TYPE_NVLIST:
+		return (nvlist_dup((nvlist_t *)data,
+		    &nvp->nvp_u.nvpu_nvlist, 0));
+
+	case DATA_TYPE_STRING_ARRAY:
+	case DATA_TYPE_NVLIST_ARRAY:
+		if (nelem == 0) {
+			return (0);
+		}
+		if (data == NULL) {
+			return (EINVAL);
+		}
+		if ((nvp->nvp_u.nvpu_array = calloc(nelem,
+		    sizeof (void *))) == NULL) {
+			return (ENOMEM);
+		}
+		for (i = 0; i < nelem; i++) {
+			void *e = ((void *const *)data)[i];
+			void **dst = (void **)nvp->nvp_u.nvpu_array + i;
+
+			if (e == NULL) {
+				return (EINVAL);
+			}
+			if (type == DATA_TYPE_STRING_ARRAY) {
+				if ((*dst = strdup(e)) == NULL) {
+					return (ENOMEM);
+				}
+			} else if (nvlist_dup(e, (nvlist_t **)dst, 0) != 0) {
+				return (ENOMEM);
+			}
+		}
+		return (0);
+
+	default:
+		if (sz == 0) {
+			return (EINVAL);
+		}
+		if (!nvpair_is_array(type)) {
+			nvp->nvp_nelem = 1;
+			bcopy(data, &nvp->nvp_u, sz);
+			return (0);
+		}
+		if (nelem == 0) {
+			return (0);
+		}
+		if (data == NULL) {
+			return (EINVAL);
+		}
+		if ((nvp->nvp_u.nvpu_array = malloc(sz * nelem)) == NULL) {
+			return (ENOMEM);
+		}
+		bcopy(data, nvp->nvp_u.nvpu_array, sz * nelem);
+		return (0);
+	}
+}
+
+/*
+ * The "data" argument to "nvpair_fill()" that would copy the value of "nvp".
+ */
+static const void *
+nvpair_data(nvpair_t *nvp)
+{
+	switch (nvp->nvp_type) {
+	case DATA_TYPE_STRING:
+		return (nvp->nvp_u.nvpu_string);
+	case DATA_TYPE_NVLIST:
+		return (nvp->nvp_u.nvpu_nvlist);
+	default:
+		if (nvpair_is_array(nvp->nvp_type)) {
+			return (nvp->nvp_u.nvpu_array);
+		}
+		return (&nvp->nvp_u);
+	}
+}
+
+static void
+nvlist_unlink(nvlist_t *nvl, nvpair_t *prev, nvpair_t *nvp)
+{
+	if (prev == NULL) {
+		nvl->nvl_head = nvp->nvp_next;
+	} else {
+		prev->nvp_next = nvp->nvp_next;
+	}
+	if (nvl->nvl_tail == nvp) {
+		nvl->nvl_tail = prev;
+	}
+	nvpair_free(nvp);
+}
+
+static int
+nvlist_add_common(nvlist_t *nvl, const char *name, data_type_t type,
+    uint_t nelem, const void *data)
+{
+	nvpair_t *nvp, *prev, *next;
+	int e;
+
+	if (nvl == NULL || name == NULL) {
+		return (EINVAL);
+	}
+
+	if ((nvp = calloc(1, sizeof (*nvp))) == NULL) {
+		return (ENOMEM);
+	}
+	if ((nvp->nvp_name = strdup(name)) == NULL) {
+		free(nvp);
+		return (ENOMEM);
+	}
+	if ((e = nvpair_fill(nvp, type, nelem, data)) != 0) {
+		nvpair_free(nvp);
+		return (e);
+	}
+
+	if (nvl->nvl_flag & (NV_UNIQUE_NAME | NV_UNIQUE_NAME_TYPE)) {
+		for (prev = NULL, next = nvl->nvl_head; next != NULL; ) {
+			nvpair_t *cur = next;
+
+			next = cur->nvp_next;
+			if (strcmp(cur->nvp_name, name) == 0 &&
+			    ((nvl->nvl_flag & NV_UNIQUE_NAME) ||
+			    cur->nvp_type == type)) {
+				nvlist_unlink(nvl, prev, cur);
+			} else {
+				prev = cur;
+			}
+		}
+	}
+
+	if (nvl->nvl_tail == NULL) {
+		nvl->nvl_head = nvp;
+	} else {
+		nvl->nvl_tail->nvp_next = nvp;
+	}
+	nvl->nvl_tail = nvp;
+
+	return (0);
+}
+
+static int
+nvlist_lookup_common(nvlist_t *nvl, const char *name, data_type_t type,
+    nvpair_t **nvpp)
+{
+	nvpair_t *nvp;
+
+	if (nvl == NULL || name == NULL) {
+		return (EINVAL);
+	}
+
+	for (nvp = nvl->nvl_head; nvp != NULL; nvp = nvp->nvp_next) {
+		if (strcmp(nvp->nvp_name, name) == 0 &&
+		    nvp->nvp_type == type) {
+			*nvpp = nvp;
+			return (0);
+		}
+	}
+
+	return (ENOENT);
+}
+
+int
+nvlist_alloc(nvlist_t **nvlp, uint_t nvflag, int kmflag)
+{
+	nvlist_t *nvl;
+
+	(void) kmflag;
+
+	if (nvlp == NULL) {
+		return (EINVAL);
+	}
+	if ((nvl = calloc(1, sizeof (*nvl))) == NULL) {
+		return (ENOMEM);
+	}
+	nvl->nvl_flag = nvflag;
+
+	*nvlp = nvl;
+	return (0);
+}
+
+void
+nvlist_free(nvlist_t *nvl)
+{
+	nvpair_t *nvp, *next;
+
+	if (nvl == NULL) {
+		return;
+	}
+
+	for (nvp = nvl->nvl_head; nvp != NULL; nvp = next) {
+		next = nvp->nvp_next;
+		nvpair_free(nvp);
+	}
+	free(nvl);
+}
+
+int
+nvlist_dup(nvlist_t *nvl, nvlist_t **nvlp, int kmflag)
+{
+	nvlist_t *dup;
+	nvpair_t *nvp;
+	int e;
+
+	if (nvl == NULL || nvlp == NULL) {
+		return (EINVAL);
+	}
+	if ((e = nvlist_alloc(&dup, nvl->nvl_flag, kmflag)) != 0) {
+		return (e);
+	}
+
+	for (nvp = nvl->nvl_head; nvp != NULL; nvp = nvp->nvp_next) {
+		if ((e = nvlist_add_common(dup, nvp->nvp_name, nvp->nvp_type,
+		    nvp->nvp_nelem, nvpair_data(nvp))) != 0) {
+			nvlist_free(dup);
+			return (e);
+		}
+	}
+
+	*nvlp = dup;
+	return (0);
+}
+
+int
+nvlist_remove_all(nvlist_t *nvl, const char *name)
+{
+	nvpair_t *nvp, *prev, *next;
+	int e = ENOENT;
+
+	if (nvl == NULL || name == NULL) {
+		return (EINVAL);
+	}
+
+	for (prev = NULL, nvp = nvl->nvl_head; nvp != NULL; nvp = next) {
+		next = nvp->nvp_next;
+		if (strcmp(nvp->nvp_name, name) == 0) {
+			nvlist_unlink(nvl, prev, nvp);
+			e = 0;
+		} else {
+			prev = nvp;
+		}
+	}
+
+	return (e);
+}
+
+boolean_t
+nvlist_exists(nvlist_t *nvl, const char *name)
+{
+	nvpair_t *nvp;
+
+	if (nvl == NULL || name == NULL) {
+		return (B_FALSE);
+	}
+
+	for (nvp = nvl->nvl_head; nvp != NULL; nvp = nvp->nvp_next) {
+		if (strcmp(nvp->nvp_name, name) == 0) {
+			return (B_TRUE);
+		}
+	}
+
+	return (B_FALSE);
+}
+
+nvpair_t *
+nvlist_next_nvpair(nvlist_t *nvl, nvpair_t *nvp)
+{
+	if (nvl == NULL) {
+		return (NULL);
+	}
+
+	return (nvp == NULL ? nvl->nvl_head : nvp->nvp_next);
+}
+
+char *
+nvpair_name(nvpair_t *nvp)
+{
+	return (nvp->nvp_name);
+}
+
+data_type_t
+nvpair_type(nvpair_t *nvp)
+{
+	return (nvp->nvp_type);
+}
+
+int
+nvlist_add_boolean(nvlist_t *nvl, const char *name)
+{
+	return (nvlist_add_common(nvl, name, DATA_TYPE_BOOLEAN, 0, NULL));
+}
+
+int
+nvlist_add_string(nvlist_t *nvl, const char *name, const char *val)
+{
+	return (nvlist_add_common(nvl, name, DATA_TYPE_STRING, 1, val));
+}
+
+int
+nvlist_add_string_array(nvlist_t *nvl, const char *name, char *const *val,
+    uint_t nelem)
+{
+	return (nvlist_add_common(nvl, name, DATA_TYPE_STRING_ARRAY, nelem,
+	    val));
+}
+
+int
+nvlist_add_nvlist(nvlist_t *nvl, const char *name, nvlist_t *val)
+{
+	return (nvlist_add_common(nvl, name, DATA_TYPE_NVLIST, 1, val));
+}
+
+int
+nvlist_add_nvlist_array(nvlist_t *nvl, const char *name, nvlist_t **val,
+    uint_t nelem)
+{
+	return (nvlist_add_common(nvl, name, DATA_TYPE_NVLIST_ARRAY, nelem,
+	    val));
+}
+
+int
+nvlist_lookup_boolean(nvlist_t *nvl, const char *name)
+{
+	nvpair_t *nvp;
+
+	return (nvlist_lookup_common(nvl, name, DATA_TYPE_BOOLEAN, &nvp));
+}
+
+int
+nvpair_value_string(nvpair_t *nvp, char **val)
+{
+	if (nvp == NULL || nvp->nvp_type != DATA_TYPE_STRING) {
+		return (EINVAL);
+	}
+
+	*val = nvp->nvp_u.nvpu_string;
+	return (0);
+}
+
+int
+nvpair_value_nvlist(nvpair_t *nvp, nvlist_t **val)
+{
+	if (nvp == NULL || nvp->nvp_type != DATA_TYPE_NVLIST) {
+		return (EINVAL);
+	}
+
+	*val = nvp->nvp_u.nvpu_nvlist;
+	return (0);
+}
+
+int
+nvpair_value_string_array(nvpair_t *nvp, char ***val, uint_t *nelem)
+{
+	if (nvp == NULL || nvp->nvp_type != DATA_TYPE_STRING_ARRAY) {
+		return (EINVAL);
+	}
+
+	*val = nvp->nvp_u.nvpu_array;
+	*nelem = nvp->nvp_nelem;
+	return (0);
+}
+
+int
+nvpair_value_nvlist_array(nvpair_t *nvp, nvlist_t ***val, uint_t *nelem)
+{
+	if (nvp == NULL || nvp->nvp_type != DATA_TYPE_NVLIST_ARRAY) {
+		return (EINVAL);
+	}
+
+	*val = nvp->nvp_u.nvpu_array;
+	*nelem = nvp->nvp_nelem;
+	return (0);
+}
+
+int
+nvlist_lookup_string(nvlist_t *nvl, const char *name, char **val)
+{
+	nvpair_t *nvp;
+	int e;
+
+	if ((e = nvlist_lookup_common(nvl, name, DATA_TYPE_STRING,
+	    &nvp)) != 0) {
+		return (e);
+	}
+	return (nvpair_value_string(nvp, val));
+}
+
+int
+nvlist_lookup_nvlist(nvlist_t *nvl, const char *name, nvlist_t **val)
+{
+	nvpair_t *nvp;
+	int e;
+
+	if ((e = nvlist_lookup_common(nvl, name, DATA_TYPE_NVLIST,
+	    &nvp)) != 0) {
+		return (e);
+	}
+	return (nvpair_value_nvlist(nvp, val));
+}
+
+int
+nvlist_lookup_string_array(nvlist_t *nvl, const char *name, char ***val,
+    uint_t *nelem)
+{
+	nvpair_t *nvp;
+	int e;
+
+	if ((e = nvlist_lookup_common(nvl, name, DATA_TYPE_STRING_ARRAY,
+	    &nvp)) != 0) {
+		return (e);
+	}
+	return (nvpair_value_string_array(nvp, val, nelem));
+}
+
+int
+nvlist_lookup_nvlist_array(nvlist_t *nvl, const char *name, nvlist_t ***val,
+    uint_t *nelem)
+{
+	nvpair_t *nvp;
+	int e;
+
+	if ((e = nvlist_lookup_common(nvl, name, DATA_TYPE_NVLIST_ARRAY,
+	    &nvp)) != 0) {
+		return (e);
+	}
+	return (nvpair_value_nvlist_array(nvp, val, nelem));
+}
+
+/*
+ * The scalar types, whose values are stored in the pair itself:
+ */
+#define	NVPAIR_SCALAR(name, ctype, dtype)				\
+int									\
+nvlist_add_##name(nvlist_t *nvl, const char *n, ctype val)		\
+{									\
+	return (nvlist_add_common(nvl, n, dtype, 1, &val));		\
+}									\
+									\
+int									\
+nvpair_value_##name(nvpair_t *nvp, ctype *val)				\
+{									\
+	if (nvp == NULL || nvp->nvp_type != dtype) {			\
+		return (EINVAL);					\
+	}								\
+	bcopy(&nvp->nvp_u, val, sizeof (ctype));			\
+	return (0);							\
+}									\
+									\
+int									\
+nvlist_lookup_##name(nvlist_t *nvl, const char *n, ctype *val)		\
+{									\
+	nvpair_t *nvp;							\
+	int e;								\
+									\
+	if ((e = nvlist_lookup_common(nvl, n, dtype, &nvp)) != 0) {	\
+		return (e);						\
+	}								\
+	return (nvpair_value_##name(nvp, val));				\
+}
+
+/*
+ * The scalar array types, whose values are copied to a separate allocation:
+ */
+#define	NVPAIR_ARRAY(name, ctype, dtype)				\
+int									\
+nvlist_add_##name(nvlist_t *nvl, const char *n, ctype *val, uint_t nelem) \
+{									\
+	return (nvlist_add_common(nvl, n, dtype, nelem, val));		\
+}									\
+									\
+int									\
+nvpair_value_##name(nvpair_t *nvp, ctype **val, uint_t *nelem)		\
+{									\
+	if (nvp == NULL || nvp->nvp_type != dtype) {			\
+		return (EINVAL);					\
+	}								\
+	*val = nvp->nvp_u.nvpu_array;					\
+	*nelem = nvp->nvp_nelem;					\
+	return (0);							\
+}									\
+									\
+int									\
+nvlist_lookup_##name(nvlist_t *nvl, const char *n, ctype **val,		\
+    uint_t *nelem)							\
+{									\
+	nvpair_t *nvp;							\
+	int e;								\
+									\
+	if ((e = nvlist_lookup_common(nvl, n, dtype, &nvp)) != 0) {	\
+		return (e);						\
+	}								\
+	return (nvpair_value_##name(nvp, val, nelem));			\
+}
+
+NVPAIR_SCALAR(boolean_value, boolean_t, DATA_TYPE_BOOLEAN_VALUE)
+NVPAIR_SCALAR(byte, uchar_t, DATA_TYPE_BYTE)
+NVPAIR_SCALAR(int8, int8_t, DATA_TYPE_INT8)
+NVPAIR_SCALAR(uint8, uint8_t, DATA_TYPE_UINT8)
+NVPAIR_SCALAR(int16, int16_t, DATA_TYPE_INT16)
+NVPAIR_SCALAR(uint16, uint16_t, DATA_TYPE_UINT16)
+NVPAIR_SCALAR(int32, int32_t, DATA_TYPE_INT32)
+NVPAIR_SCALAR(uint32, uint32_t, DATA_TYPE_UINT32)
+NVPAIR_SCALAR(int64, int64_t, DATA_TYPE_INT64)
+NVPAIR_SCALAR(uint64, uint64_t, DATA_TYPE_UINT64)
+NVPAIR_SCALAR(hrtime, hrtime_t, DATA_TYPE_HRTIME)
+NVPAIR_SCALAR(double, double, DATA_TYPE_DOUBLE)
+NVPAIR_ARRAY(boolean_array, boolean_t, DATA_TYPE_BOOLEAN_ARRAY)
+NVPAIR_ARRAY(byte_array, uchar_t, DATA_TYPE_BYTE_ARRAY)
+NVPAIR_ARRAY(int8_array, int8_t, DATA_TYPE_INT8_ARRAY)
+NVPAIR_ARRAY(uint8_array, uint8_t, DATA_TYPE_UINT8_ARRAY)
+NVPAIR_ARRAY(int16_array, int16_t, DATA_TYPE_INT16_ARRAY)
+NVPAIR_ARRAY(uint16_array, uint16_t, DATA_TYPE_UINT16_ARRAY)
+NVPAIR_ARRAY(int32_array, int32_t, DATA_TYPE_INT32_ARRAY)
+NVPAIR_ARRAY(uint32_array, uint32_t, DATA_TYPE_UINT32_ARRAY)
+NVPAIR_ARRAY(int64_array, int64_t, DATA_TYPE_INT64_ARRAY)
+NVPAIR_ARRAY(uint64_array, uint64_t, DATA_TYPE_UINT64_ARRAY)
@@ -0,0 +1,418 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2022 Joyent, Inc.
+ */
+
+/*
+ * A minimal stand-in for libsysevent.  Events are published within the
+ * process by "sysevent_post_event()", and delivered to every bound handle
+ * subscribed to their class and subclass.  As with libsysevent, the handler
+ * of each handle runs on a delivery thread of its own, never on the thread
+ * that posted the event, and unbinding a handle waits for its handler to
+ * return.  Events queued for a handle that is unbound are discarded.
+ *
+ * Publishing in libsysevent waits for delivery to the subscribers, so a slow
+ * subscriber pushes back on publishers.  Here, a publisher waits instead
+ * while any handle subscribed to its event has SHIM_QUEUE_MAX events queued.
+ * A handler must therefore not publish events to its own handle.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/debug.h>
+#include <sys/time.h>
+
+#include "libsysevent.h"
+
+#define	SHIM_QUEUE_MAX	1024
+
+struct sysevent {
+	sysevent_t *se_next;
+	char *se_class;
+	char *se_subclass;
+	char *se_vendor;
+	char *se_publisher;
+	pid_t se_pid;
+	uint64_t se_seq;
+	hrtime_t se_time;
+	nvlist_t *se_attrs;
+};
+
+struct sysevent_handle {
+	sysevent_handle_t *sh_next;
+	void (*sh_handler)(sysevent_t *);
+	nvlist_t *sh_classes;	/* class -> subclass array */
+	pthread_t sh_thread;
+	pthread_cond_t sh_cv;
+	sysevent_t *sh_head;
+	sysevent_t *sh_tail;
+	uint_t sh_queued;
+	int sh_unbinding;
+};
+
+/*
+ * "g_shim_lock" protects the list of handles, and the subscriptions and
+ * queues of every handle.  Publishers wait on "g_shim_room_cv" for room in
+ * the queues.
+ */
+static pthread_mutex_t g_shim_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t g_shim_room_cv = PTHREAD_COND_INITIALIZER;
+static sysevent_handle_t *g_shim_handles = NULL;
+static uint64_t g_shim_seq = 0;
+
+static void
+sysevent_free(sysevent_t *ev)
+{
+	free(ev->se_class);
+	free(ev->se_subclass);
+	free(ev->se_vendor);
+	free(ev->se_publisher);
+	nvlist_free(ev->se_attrs);
+	free(ev);
+}
+
+static void *
+sysevent_deliver_thread(void *arg)
+{
+	sysevent_handle_t *sh = arg;
+	sysevent_t *ev;
+
+	VERIFY0(pthread_mutex_lock(&g_shim_lock));
+	for (;;) {
+		while (sh->sh_head == NULL && !sh->sh_unbinding) {
+			VERIFY0(pthread_cond_wait(&sh->sh_cv, &g_shim_lock));
+		}
+		if (sh->sh_unbinding) {
+			break;
+		}
+
+		ev = sh->sh_head;
+		if ((sh->sh_head = ev->se_next) == NULL) {
+			sh->sh_tail = NULL;
+		}
+		if (sh->sh_queued-- == SHIM_QUEUE_MAX) {
+			VERIFY0(pthread_cond_broadcast(&g_shim_room_cv));
+		}
+
+		VERIFY0(pthread_mutex_unlock(&g_shim_lock));
+		sh->sh_handler(ev);
+		sysevent_free(ev);
+		VERIFY0(pthread_mutex_lock(&g_shim_lock));
+	}
+	VERIFY0(pthread_mutex_unlock(&g_shim_lock));
+
+	return (NULL);
+}
+
+sysevent_handle_t *
+sysevent_bind_handle(void (*handler)(sysevent_t *))
+{
+	sysevent_handle_t *sh;
+	int e;
+
+	if (handler == NULL) {
+		errno = EINVAL;
+		return (NULL);
+	}
+
+	if ((sh = calloc(1, sizeof (*sh))) == NULL) {
+		return (NULL);
+	}
+	sh->sh_handler = handler;
+	if ((e = nvlist_alloc(&sh->sh_classes, NV_UNIQUE_NAME, 0)) != 0) {
+		free(sh);
+		errno = e;
+		return (NULL);
+	}
+	VERIFY0(pthread_cond_init(&sh->sh_cv, NULL));
+
+	if ((e = pthread_create(&sh->sh_thread, NULL, sysevent_deliver_thread,
+	    sh)) != 0) {
+		VERIFY0(pthread_cond_destroy(&sh->sh_cv));
+		nvlist_free(sh->sh_classes);
+		free(sh);
+		errno = e;
+		return (NULL);
+	}
+
+	VERIFY0(pthread_mutex_lock(&g_shim_lock));
+	sh->sh_next = g_shim_handles;
+	g_shim_handles = sh;
+	VERIFY0(pthread_mutex_unlock(&g_shim_lock));
+
+	return (sh);
+}
+
+void
+sysevent_unbind_handle(sysevent_handle_t *sh)
+{
+	sysevent_handle_t **shp;
+	sysevent_t *ev;
+
+	VERIFY0(pthread_mutex_lock(&g_shim_lock));
+	for (shp = &g_shim_handles; *shp != sh; shp = &(*shp)->sh_next) {
+		VERIFY(*shp != NULL);
+	}
+	*shp = sh->sh_next;
+	sh->sh_unbinding = 1;
+	VERIFY0(pthread_cond_signal(&sh->sh_cv));
+	VERIFY0(pthread_cond_broadcast(&g_shim_room_cv));
+	VERIFY0(pthread_mutex_unlock(&g_shim_lock));
+
+	VERIFY0(pthread_join(sh->sh_thread, NULL));
+
+	while ((ev = sh->sh_head) != NULL) {
+		sh->sh_head = ev->se_next;
+		sysevent_free(ev);
+	}
+	VERIFY0(pthread_cond_destroy(&sh->sh_cv));
+	nvlist_free(sh->sh_classes);
+	free(sh);
+}
+
+int
+sysevent_subscribe_event(sysevent_handle_t *sh, const char *class,
+    const char **subclasses, int nsubclasses)
+{
+	int e;
+
+	if (sh == NULL || class == NULL || subclasses == NULL ||
+	    nsubclasses <= 0) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	VERIFY0(pthread_mutex_lock(&g_shim_lock));
+	e = nvlist_add_string_array(sh->sh_classes, class,
+	    (char *const *)subclasses, (uint_t)nsubclasses);
+	VERIFY0(pthread_mutex_unlock(&g_shim_lock));
+
+	if (e != 0) {
+		errno = e;
+		return (-1);
+	}
+	return (0);
+}
+
+void
+sysevent_unsubscribe_event(sysevent_handle_t *sh, const char *class)
+{
+	nvlist_t *nvl;
+
+	VERIFY0(pthread_mutex_lock(&g_shim_lock));
+	if (class == NULL || strcmp(class, EC_ALL) == 0) {
+		VERIFY0(nvlist_alloc(&nvl, NV_UNIQUE_NAME, 0));
+		nvlist_free(sh->sh_classes);
+		sh->sh_classes = nvl;
+	} else {
+		(void) nvlist_remove_all(sh->sh_classes, class);
+	}
+	VERIFY0(pthread_mutex_unlock(&g_shim_lock));
+}
+
+/*
+ * Returns 1 if the handle "sh" is subscribed to events of this class and
+ * subclass.  Called with "g_shim_lock" held.
+ */
+static int
+sysevent_subscribed(sysevent_handle_t *sh, const char *class,
+    const char *subclass)
+{
+	char **subs;
+	uint_t nsubs, i;
+
+	if (nvlist_exists(sh->sh_classes, EC_ALL)) {
+		return (1);
+	}
+
+	if (nvlist_lookup_string_array(sh->sh_classes, class, &subs,
+	    &nsubs) != 0) {
+		return (0);
+	}
+	for (i = 0; i < nsubs; i++) {
+		if (strcmp(subs[i], EC_SUB_ALL) == 0 ||
+		    strcmp(subs[i], subclass) == 0) {
+			return (1);
+		}
+	}
+
+	return (0);
+}
+
+/*
+ * Returns 1 if a handle subscribed to events of this class and subclass has
+ * no room for another.  Called with "g_shim_lock" held.
+ */
+static int
+sysevent_full(const char *class, const char *subclass)
+{
+	sysevent_handle_t *sh;
+
+	for (sh = g_shim_handles; sh != NULL; sh = sh->sh_next) {
+		if (sh->sh_queued >= SHIM_QUEUE_MAX &&
+		    sysevent_subscribed(sh, class, subclass)) {
+			return (1);
+		}
+	}
+
+	return (0);
+}
+
+/*
+ * Publish an event.  Each subscribed handle is given its own copy, so
+ * "attrs" (which may be NULL) remains owned by the caller.
+ */
+int
+sysevent_post_event(char *class, char *subclass, char *vendor, char *pub,
+    nvlist_t *attrs, sysevent_id_t *eid)
+{
+	sysevent_handle_t *sh;
+	hrtime_t now;
+	uint64_t seq;
+	int e = 0;
+
+	if (class == NULL || subclass == NULL || vendor == NULL ||
+	    pub == NULL) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	VERIFY0(pthread_mutex_lock(&g_shim_lock));
+	while (sysevent_full(class, subclass)) {
+		VERIFY0(pthread_cond_wait(&g_shim_room_cv, &g_shim_lock));
+	}
+	now = gethrtime();
+	seq = ++g_shim_seq;
+	for (sh = g_shim_handles; sh != NULL; sh = sh->sh_next) {
+		sysevent_t *ev;
+
+		if (!sysevent_subscribed(sh, class, subclass)) {
+			continue;
+		}
+
+		if ((ev = calloc(1, sizeof (*ev))) == NULL ||
+		    (ev->se_class = strdup(class)) == NULL ||
+		    (ev->se_subclass = strdup(subclass)) == NULL ||
+		    (ev->se_vendor = strdup(vendor)) == NULL ||
+		    (ev->se_publisher = strdup(pub)) == NULL ||
+		    (attrs != NULL && nvlist_dup(attrs, &ev->se_attrs,
+		    0) != 0)) {
+			if (ev != NULL) {
+				sysevent_free(ev);
+			}
+			e = ENOMEM;
+			continue;
+		}
+		ev->se_pid = getpid();
+		ev->se_seq = seq;
+		ev->se_time = now;
+
+		if (sh->sh_tail == NULL) {
+			sh->sh_head = ev;
+		} else {
+			sh->sh_tail->se_next = ev;
+		}
+		sh->sh_tail = ev;
+		sh->sh_queued++;
+		VERIFY0(pthread_cond_signal(&sh->sh_cv));
+	}
+	VERIFY0(pthread_mutex_unlock(&g_shim_lock));
+
+	if (eid != NULL) {
+		eid->eid_seq = seq;
+		eid->eid_ts = now;
+	}
+
+	if (e != 0) {
+		errno = e;
+		return (-1);
+	}
+	return (0);
+}
+
+char *
+sysevent_get_class_name(sysevent_t *ev)
+{
+	return (ev->se_class);
+}
+
+char *
+sysevent_get_subclass_name(sysevent_t *ev)
+{
+	return (ev->se_subclass);
+}
+
+char *
+sysevent_get_vendor_name(sysevent_t *ev)
+{
+	return (ev->se_vendor);
+}
+
+char *
+sysevent_get_pub_name(sysevent_t *ev)
+{
+	return (ev->se_publisher);
+}
+
+void
+sysevent_get_pid(sysevent_t *ev, pid_t *pidp)
+{
+	*pidp = ev->se_pid;
+}
+
+uint64_t
+sysevent_get_seq(sysevent_t *ev)
+{
+	return (ev->se_seq);
+}
+
+void
+sysevent_get_time(sysevent_t *ev, hrtime_t *timep)
+{
+	*timep = ev->se_time;
+}
+
+/*
+ * As in libsysevent, the caller gets a copy of the attribute list, which it
+ * must free.
+ */
+int
+sysevent_get_attr_list(sysevent_t *ev, nvlist_t **nvlp)
+{
+	int e;
+
+	if (ev->se_attrs == NULL) {
+		errno = ENOENT;
+		return (-1);
+	}
+
+	if ((e = nvlist_dup(ev->se_attrs, nvlp, 0)) != 0) {
+		errno = e;
+		return (-1);
+	}
+	return (0);
+}
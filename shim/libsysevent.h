@@ -0,0 +1,82 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2022 Joyent, Inc.
+ */
+
+/*
+ * A minimal stand-in for libsysevent, for building on systems other than
+ * illumos; see "libsysevent.c".  Events are published within the process
+ * with "sysevent_post_event()".
+ */
+
+#ifndef	_SHIM_LIBSYSEVENT_H
+#define	_SHIM_LIBSYSEVENT_H
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <libnvpair.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#define	EC_ALL		"register_all_classes"
+#define	EC_SUB_ALL	"register_all_subclasses"
+
+#define	SE_KERN_PID	0
+
+#define	MAX_CLASS_LEN		64
+#define	MAX_SUBCLASS_LEN	64
+#define	MAX_PUB_LEN		128
+
+typedef struct sysevent sysevent_t;
+typedef struct sysevent_handle sysevent_handle_t;
+
+typedef struct sysevent_id {
+	uint64_t eid_seq;
+	hrtime_t eid_ts;
+} sysevent_id_t;
+
+sysevent_handle_t *sysevent_bind_handle(void (*)(sysevent_t *));
+void sysevent_unbind_handle(sysevent_handle_t *);
+int sysevent_subscribe_event(sysevent_handle_t *, const char *,
+    const char **, int);
+void sysevent_unsubscribe_event(sysevent_handle_t *, const char *);
+
+char *sysevent_get_class_name(sysevent_t *);
+char *sysevent_get_subclass_name(sysevent_t *);
+char *sysevent_get_vendor_name(sysevent_t *);
+char *sysevent_get_pub_name(sysevent_t *);
+void sysevent_get_pid(sysevent_t *, pid_t *);
+uint64_t sysevent_get_seq(sysevent_t *);
+void sysevent_get_time(sysevent_t *, hrtime_t *);
+int sysevent_get_attr_list(sysevent_t *, nvlist_t **);
+
+int sysevent_post_event(char *, char *, char *, char *, nvlist_t *,
+    sysevent_id_t *);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* !_SHIM_LIBSYSEVENT_H */
@@ -0,0 +1,75 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2022 Joyent, Inc.
+ */
+
+/*
+ * A stand-in for the assertion macros in <sys/debug.h> on illumos.  As there,
+ * VERIFY() is checked in every build.
+ */
+
+#ifndef	_SHIM_SYS_DEBUG_H
+#define	_SHIM_SYS_DEBUG_H
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+static inline void
+shim_assfail(const char *expr, const char *file, int line)
+{
+	(void) fprintf(stderr, "assertion failed: %s, file: %s, line: %d\n",
+	    expr, file, line);
+	abort();
+}
+
+#define	VERIFY(EX)	((void)((EX) || (shim_assfail(#EX, __FILE__, \
+	__LINE__), 0)))
+#define	VERIFY0(EX)	((void)((EX) == 0 || (shim_assfail(#EX " == 0", \
+	__FILE__, __LINE__), 0)))
+
+#define	VERIFY3_IMPL(LEFT, OP, RIGHT, TYPE)	((void)(		\
+	(TYPE)(LEFT) OP (TYPE)(RIGHT) ||				\
+	(shim_assfail(#LEFT " " #OP " " #RIGHT, __FILE__, __LINE__), 0)))
+
+#define	VERIFY3S(x, y, z)	VERIFY3_IMPL(x, y, z, int64_t)
+#define	VERIFY3U(x, y, z)	VERIFY3_IMPL(x, y, z, uint64_t)
+#define	VERIFY3P(x, y, z)	VERIFY3_IMPL(x, y, z, uintptr_t)
+
+#ifdef	DEBUG
+#define	ASSERT(EX)	VERIFY(EX)
+#define	ASSERT0(EX)	VERIFY0(EX)
+#else
+#define	ASSERT(EX)	((void)0)
+#define	ASSERT0(EX)	((void)0)
+#endif
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* !_SHIM_SYS_DEBUG_H */
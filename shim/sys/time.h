@@ -0,0 +1,60 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2022 Joyent, Inc.
+ */
+
+/*
+ * A stand-in for the high-resolution timer interfaces in <sys/time.h> on
+ * illumos.
+ */
+
+#ifndef	_SHIM_SYS_TIME_H
+#define	_SHIM_SYS_TIME_H
+
+#include_next <sys/time.h>
+#include <sys/types.h>
+#include <time.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+#define	SEC		1
+#define	MILLISEC	1000
+#define	MICROSEC	1000000
+#define	NANOSEC		1000000000LL
+
+static inline hrtime_t
+gethrtime(void)
+{
+	struct timespec ts;
+
+	(void) clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ((hrtime_t)ts.tv_sec * NANOSEC + ts.tv_nsec);
+}
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* !_SHIM_SYS_TIME_H */
@@ -0,0 +1,672 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2022 Joyent, Inc.
+ */
+
+/*
+ * Microbenchmarks for the conversion of events into Javascript values.  This
+ * is built as a separate addon, "bench", from "bench/binding.gyp" (only when
+ * the benchmark is run), and driven by "bench/convert.js"; it is not part of
+ * the module itself.
+ *
+ * Each workload is a representative event, built once as an nvlist, and
+ * packed (see "flat.h") as it would be on the delivery thread.  Each strategy
+ * turns a workload into the value a stream would receive for it:
+ *
+ *	eager		walk the nvlist with libnvpair, into plain objects,
+ *			creating a new string for every property name
+ *
+ *	interned	as "eager", but with property names from the intern
+ *			cache; see "intern.cc"
+ *
+ *	templated	convert the packed event as delivery does: the
+ *			flattened attribute list with interned names, and
+ *			the header and record from object templates; see
+ *			"convert.cc"
+ *
+ *	packed		wrap the packed event in an external Buffer, as
+ *			streams in "packed" mode receive it
+ *
+ *	flatten		no conversion at all, but the work done on the
+ *			delivery thread for the "templated" and "packed"
+ *			strategies: packing the nvlist
+ *
+ * The records made by the first three strategies are frozen, as delivered
+ * records are.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+
+#include <nan.h>
+#include <sys/debug.h>
+#include <libnvpair.h>
+
+#include "convert.h"
+#include "intern.h"
+#include "flat.h"
+
+using v8::Local;
+using v8::Object;
+using v8::Value;
+using v8::Array;
+
+/*
+ * Events are converted in batches of NODE_SYSEVENT_BENCH_BATCH, each within
+ * its own HandleScope.  The V8 heap is measured either side of each batch;
+ * batches during which a garbage collection reclaimed more than the batch
+ * allocated are left out of the count of bytes allocated, which is therefore
+ * approximate.  Every strategy first runs NODE_SYSEVENT_BENCH_WARMUP events
+ * that are not counted at all.
+ */
+#define	NODE_SYSEVENT_BENCH_BATCH	64
+#define	NODE_SYSEVENT_BENCH_WARMUP	1024
+#define	NODE_SYSEVENT_BENCH_MAX		(100 * 1000 * 1000)
+
+typedef struct node_sysevent_bench_workload {
+	const char *nsbw_name;
+	nsev_header_t nsbw_header;
+	void (*nsbw_build)(nvlist_t *);	/* NULL if no attributes */
+
+	nvlist_t *nsbw_nvl;
+	nsev_packed_t *nsbw_packed;
+	nsev_packed_t *nsbw_scratch;	/* for "flatten" */
+	size_t nsbw_size;
+} node_sysevent_bench_workload_t;
+
+typedef Local<Value> (node_sysevent_bench_func_t)(
+    node_sysevent_bench_workload_t *);
+
+typedef Local<v8::String> (node_sysevent_bench_key_t)(const char *);
+
+/*
+ * A ZFS ereport, of the kind posted for a checksum error: about twenty
+ * attributes, mostly integers and short strings, and a small nested
+ * "detector" nvlist.
+ */
+static void
+node_sysevent_bench_zfs(nvlist_t *nvl)
+{
+	nvlist_t *det;
+
+	VERIFY0(nvlist_alloc(&det, NV_UNIQUE_NAME, 0));
+	VERIFY0(nvlist_add_uint8(det, "version", 0));
+	VERIFY0(nvlist_add_string(det, "scheme", "zfs"));
+	VERIFY0(nvlist_add_uint64(det, "pool", 0x3c8a52f0d1e94b17ULL));
+	VERIFY0(nvlist_add_uint64(det, "vdev", 0x1f2e3d4c5b6a7988ULL));
+
+	VERIFY0(nvlist_add_uint8(nvl, "version", 0));
+	VERIFY0(nvlist_add_string(nvl, "class",
+	    "ereport.fs.zfs.checksum"));
+	VERIFY0(nvlist_add_uint64(nvl, "ena", 0x8e5ab2a1c6e00401ULL));
+	VERIFY0(nvlist_add_nvlist(nvl, "detector", det));
+	VERIFY0(nvlist_add_string(nvl, "pool", "zones"));
+	VERIFY0(nvlist_add_uint64(nvl, "pool_guid", 0x3c8a52f0d1e94b17ULL));
+	VERIFY0(nvlist_add_int32(nvl, "pool_context", 0));
+	VERIFY0(nvlist_add_string(nvl, "pool_failmode", "wait"));
+	VERIFY0(nvlist_add_uint64(nvl, "vdev_guid", 0x1f2e3d4c5b6a7988ULL));
+	VERIFY0(nvlist_add_string(nvl, "vdev_type", "disk"));
+	VERIFY0(nvlist_add_string(nvl, "vdev_path",
+	    "/dev/dsk/c0t5000CCA0496A1E5Dd0s0"));
+	VERIFY0(nvlist_add_string(nvl, "vdev_devid",
+	    "id1,sd@n5000cca0496a1e5d/a"));
+	VERIFY0(nvlist_add_uint64(nvl, "parent_guid", 0x6d5c4b3a29180716ULL));
+	VERIFY0(nvlist_add_string(nvl, "parent_type", "raidz"));
+	VERIFY0(nvlist_add_int32(nvl, "zio_err", 50));
+	VERIFY0(nvlist_add_int32(nvl, "zio_flags", 0x100080));
+	VERIFY0(nvlist_add_uint32(nvl, "zio_stage", 0x200000));
+	VERIFY0(nvlist_add_uint32(nvl, "zio_pipeline", 0x3e00000));
+	VERIFY0(nvlist_add_uint64(nvl, "zio_delay", 0));
+	VERIFY0(nvlist_add_hrtime(nvl, "zio_timestamp", 0x2b1d8e0f6a4cLL));
+	VERIFY0(nvlist_add_uint64(nvl, "zio_offset", 0x1a2b3c4000ULL));
+	VERIFY0(nvlist_add_uint64(nvl, "zio_size", 131072));
+	VERIFY0(nvlist_add_uint64(nvl, "zio_objset", 21));
+	VERIFY0(nvlist_add_uint64(nvl, "zio_object", 8));
+	VERIFY0(nvlist_add_int64(nvl, "zio_level", 0));
+	VERIFY0(nvlist_add_uint64(nvl, "zio_blkid", 1473));
+
+	nvlist_free(det);
+}
+
+/*
+ * An event carrying bulk data: numeric and string arrays, an array of
+ * nvlists, and nvlists nested several deep.
+ */
+static void
+node_sysevent_bench_large(nvlist_t *nvl)
+{
+	uint64_t hist[64];
+	uchar_t label[256];
+	char paths[32][40];
+	char *pathp[32];
+	nvlist_t *children[16];
+	nvlist_t *config, *tree, *stats;
+	uint_t i;
+
+	for (i = 0; i < 64; i++) {
+		hist[i] = (uint64_t)i * 0x9e3779b97f4a7c15ULL;
+	}
+	for (i = 0; i < 256; i++) {
+		label[i] = (uchar_t)i;
+	}
+	for (i = 0; i < 32; i++) {
+		(void) snprintf(paths[i], sizeof (paths[i]),
+		    "/dev/dsk/c0t5000CCA04%07Xd0s0", i);
+		pathp[i] = paths[i];
+	}
+	for (i = 0; i < 16; i++) {
+		VERIFY0(nvlist_alloc(&children[i], NV_UNIQUE_NAME, 0));
+		VERIFY0(nvlist_add_uint64(children[i], "guid",
+		    (uint64_t)(i + 1) * 0x6d5c4b3a29180716ULL));
+		VERIFY0(nvlist_add_string(children[i], "path", paths[i]));
+		VERIFY0(nvlist_add_string(children[i], "type", "disk"));
+		VERIFY0(nvlist_add_uint64(children[i], "state", 7));
+		VERIFY0(nvlist_add_uint64(children[i], "ashift", 12));
+		VERIFY0(nvlist_add_boolean_value(children[i], "is_log",
+		    B_FALSE));
+	}
+
+	VERIFY0(nvlist_alloc(&stats, NV_UNIQUE_NAME, 0));
+	VERIFY0(nvlist_add_int64(stats, "read_errors", 0));
+	VERIFY0(nvlist_add_int64(stats, "write_errors", 0));
+	VERIFY0(nvlist_add_int64(stats, "checksum_errors", 3));
+	VERIFY0(nvlist_add_uint64_array(stats, "ops", hist, 8));
+
+	VERIFY0(nvlist_alloc(&tree, NV_UNIQUE_NAME, 0));
+	VERIFY0(nvlist_add_string(tree, "type", "root"));
+	VERIFY0(nvlist_add_nvlist(tree, "stats", stats));
+	VERIFY0(nvlist_add_nvlist_array(tree, "children", children, 16));
+
+	VERIFY0(nvlist_alloc(&config, NV_UNIQUE_NAME, 0));
+	VERIFY0(nvlist_add_string(config, "name", "zones"));
+	VERIFY0(nvlist_add_uint64(config, "txg", 48213377));
+	VERIFY0(nvlist_add_nvlist(config, "vdev_tree", tree));
+
+	VERIFY0(nvlist_add_string(nvl, "class", "resource.fs.zfs.statechange"));
+	VERIFY0(nvlist_add_uint64_array(nvl, "histogram", hist, 64));
+	VERIFY0(nvlist_add_byte_array(nvl, "label", label, 256));
+	VERIFY0(nvlist_add_string_array(nvl, "paths", pathp, 32));
+	VERIFY0(nvlist_add_nvlist(nvl, "config", config));
+
+	for (i = 0; i < 16; i++) {
+		nvlist_free(children[i]);
+	}
+	nvlist_free(stats);
+	nvlist_free(tree);
+	nvlist_free(config);
+}
+
+static node_sysevent_bench_workload_t node_sysevent_bench_workloads[] = {
+	{ "header", { "EC_dev_add", "disk", "SUNW",
+	    "SUNW:usr:devfsadmd:101", 101, 0 }, NULL,
+	    NULL, NULL, NULL, 0 },
+	{ "zfs", { "EC_zfs", "ESC_ZFS_checksum", "SUNW",
+	    "SUNW:kern:zfs-diagnosis", 0, 1 }, node_sysevent_bench_zfs,
+	    NULL, NULL, NULL, 0 },
+	{ "large", { "EC_zfs", "ESC_ZFS_config_sync", "SUNW",
+	    "SUNW:kern:zfs", 0, 1 }, node_sysevent_bench_large,
+	    NULL, NULL, NULL, 0 }
+};
+
+#define	NODE_SYSEVENT_BENCH_NWORKLOADS	\
+	(sizeof (node_sysevent_bench_workloads) / \
+	sizeof (node_sysevent_bench_workloads[0]))
+
+static Local<v8::String>
+node_sysevent_bench_key_new(const char *name)
+{
+	return (Nan::New(name).ToLocalChecked());
+}
+
+static Local<Value>
+node_sysevent_bench_int64(int64_t v)
+{
+#ifdef NODE_SYSEVENT_HAVE_BIGINT
+	return (v8::BigInt::New(v8::Isolate::GetCurrent(), v));
+#else
+	return (Nan::New<v8::Number>((double)v));
+#endif
+}
+
+static Local<Value>
+node_sysevent_bench_uint64(uint64_t v)
+{
+#ifdef NODE_SYSEVENT_HAVE_BIGINT
+	return (v8::BigInt::NewFromUnsigned(v8::Isolate::GetCurrent(), v));
+#else
+	return (Nan::New<v8::Number>((double)v));
+#endif
+}
+
+static Local<Object> node_sysevent_bench_nvlist(nvlist_t *,
+    node_sysevent_bench_key_t *);
+
+/*
+ * Convert an array nvpair of type T, with the libnvpair accessor GET, into a
+ * Javascript array of values made by MAKE.
+ */
+#define	NSB_ARRAY(T, GET, MAKE)						\
+	{								\
+		T *vs;							\
+		Local<Array> arr;					\
+									\
+		VERIFY0(GET(nvp, &vs, &n));				\
+		arr = Nan::New<Array>(n);				\
+		for (i = 0; i < n; i++) {				\
+			Nan::Set(arr, i, MAKE);				\
+		}							\
+		return (arr);						\
+	}
+
+/*
+ * Convert an nvpair directly, as events were converted before attribute
+ * lists were flattened.  Only the types the workloads use are supported;
+ * others become undefined.
+ */
+static Local<Value>
+node_sysevent_bench_nvpair(nvpair_t *nvp, node_sysevent_bench_key_t *key)
+{
+	uint_t i, n;
+
+	switch (nvpair_type(nvp)) {
+	case DATA_TYPE_BOOLEAN_VALUE: {
+		boolean_t v;
+
+		VERIFY0(nvpair_value_boolean_value(nvp, &v));
+		return (Nan::New<v8::Boolean>(v == B_TRUE));
+	}
+	case DATA_TYPE_UINT8: {
+		uint8_t v;
+
+		VERIFY0(nvpair_value_uint8(nvp, &v));
+		return (Nan::New<v8::Uint32>((uint32_t)v));
+	}
+	case DATA_TYPE_INT32: {
+		int32_t v;
+
+		VERIFY0(nvpair_value_int32(nvp, &v));
+		return (Nan::New<v8::Integer>(v));
+	}
+	case DATA_TYPE_UINT32: {
+		uint32_t v;
+
+		VERIFY0(nvpair_value_uint32(nvp, &v));
+		return (Nan::New<v8::Uint32>(v));
+	}
+	case DATA_TYPE_INT64: {
+		int64_t v;
+
+		VERIFY0(nvpair_value_int64(nvp, &v));
+		return (node_sysevent_bench_int64(v));
+	}
+	case DATA_TYPE_UINT64: {
+		uint64_t v;
+
+		VERIFY0(nvpair_value_uint64(nvp, &v));
+		return (node_sysevent_bench_uint64(v));
+	}
+	case DATA_TYPE_HRTIME: {
+		hrtime_t v;
+
+		VERIFY0(nvpair_value_hrtime(nvp, &v));
+		return (node_sysevent_bench_int64((int64_t)v));
+	}
+	case DATA_TYPE_STRING: {
+		char *v;
+
+		VERIFY0(nvpair_value_string(nvp, &v));
+		return (Nan::New(v).ToLocalChecked());
+	}
+	case DATA_TYPE_NVLIST: {
+		nvlist_t *v;
+
+		VERIFY0(nvpair_value_nvlist(nvp, &v));
+		return (node_sysevent_bench_nvlist(v, key));
+	}
+	case DATA_TYPE_BYTE_ARRAY:
+		NSB_ARRAY(uchar_t, nvpair_value_byte_array,
+		    Nan::New<v8::Uint32>((uint32_t)vs[i]));
+	case DATA_TYPE_UINT64_ARRAY:
+		NSB_ARRAY(uint64_t, nvpair_value_uint64_array,
+		    node_sysevent_bench_uint64(vs[i]));
+	case DATA_TYPE_STRING_ARRAY:
+		NSB_ARRAY(char *, nvpair_value_string_array,
+		    Nan::New(vs[i]).ToLocalChecked());
+	case DATA_TYPE_NVLIST_ARRAY:
+		NSB_ARRAY(nvlist_t *, nvpair_value_nvlist_array,
+		    node_sysevent_bench_nvlist(vs[i], key));
+	default:
+		return (Nan::Undefined());
+	}
+}
+
+static Local<Object>
+node_sysevent_bench_nvlist(nvlist_t *nvl, node_sysevent_bench_key_t *key)
+{
+	Local<Object> obj = Nan::New<Object>();
+	nvpair_t *nvp = NULL;
+
+	while ((nvp = nvlist_next_nvpair(nvl, nvp)) != NULL) {
+		Nan::Set(obj, key(nvpair_name(nvp)),
+		    node_sysevent_bench_nvpair(nvp, key));
+	}
+
+	return (obj);
+}
+
+static Local<Value>
+node_sysevent_bench_plain(node_sysevent_bench_workload_t *w,
+    node_sysevent_bench_key_t *key)
+{
+	const nsev_header_t *nsh = &w->nsbw_header;
+	Local<Object> obj0 = Nan::New<Object>();
+	Local<Object> obj1, rec;
+
+	Nan::Set(obj0, key("class_name"),
+	    Nan::New(nsh->nsh_class).ToLocalChecked());
+	Nan::Set(obj0, key("subclass_name"),
+	    Nan::New(nsh->nsh_subclass).ToLocalChecked());
+	Nan::Set(obj0, key("vendor_name"),
+	    Nan::New(nsh->nsh_vendor).ToLocalChecked());
+	Nan::Set(obj0, key("publisher_name"),
+	    Nan::New(nsh->nsh_publisher).ToLocalChecked());
+	Nan::Set(obj0, key("source"), key(nsh->nsh_kernel ? "kernel" : "user"));
+	Nan::Set(obj0, key("pid"), Nan::New<v8::Integer>(nsh->nsh_pid));
+	node_sysevent_freeze(obj0);
+
+	obj1 = w->nsbw_nvl != NULL ?
+	    node_sysevent_bench_nvlist(w->nsbw_nvl, key) : Nan::New<Object>();
+	node_sysevent_freeze(obj1);
+
+	rec = Nan::New<Object>();
+	Nan::Set(rec, key("nvl0"), obj0);
+	Nan::Set(rec, key("nvl1"), obj1);
+	node_sysevent_freeze(rec);
+
+	return (rec);
+}
+
+static Local<Value>
+node_sysevent_bench_eager(node_sysevent_bench_workload_t *w)
+{
+	return (node_sysevent_bench_plain(w, node_sysevent_bench_key_new));
+}
+
+static Local<Value>
+node_sysevent_bench_interned(node_sysevent_bench_workload_t *w)
+{
+	return (node_sysevent_bench_plain(w, node_sysevent_intern));
+}
+
+/*
+ * This is "node_sysevent_record()" in "module.cc", without the per-event
+ * cache.
+ */
+static Local<Value>
+node_sysevent_bench_templated(node_sysevent_bench_workload_t *w)
+{
+	const nsev_packed_t *npk = w->nsbw_packed;
+	Local<Object> obj0, obj1, rec;
+
+	obj0 = node_sysevent_header_to_object(&w->nsbw_header);
+	node_sysevent_freeze(obj0);
+
+	obj1 = Nan::New<Object>();
+	if (npk->npk_attrs != 0) {
+		VERIFY0(node_sysevent_flat_to_object((const nsev_flat_t *)
+		    ((const char *)npk + npk->npk_attrs), obj1));
+	}
+	node_sysevent_freeze(obj1);
+
+	rec = node_sysevent_record_new(obj0, obj1);
+	node_sysevent_freeze(rec);
+
+	return (rec);
+}
+
+/*
+ * The packed events belong to the workloads, which live as long as the
+ * process; but account for the external memory as delivery does.
+ */
+static void
+node_sysevent_bench_packed_free(char *, void *arg)
+{
+	Nan::AdjustExternalMemory(-(int)(uintptr_t)arg);
+}
+
+static Local<Value>
+node_sysevent_bench_packed(node_sysevent_bench_workload_t *w)
+{
+	Local<Object> buf = Nan::NewBuffer((char *)w->nsbw_packed,
+	    w->nsbw_size, node_sysevent_bench_packed_free,
+	    (void *)(uintptr_t)w->nsbw_size).ToLocalChecked();
+
+	Nan::AdjustExternalMemory((int)w->nsbw_size);
+
+	return (buf);
+}
+
+static Local<Value>
+node_sysevent_bench_flatten(node_sysevent_bench_workload_t *w)
+{
+	const nsev_header_t *nsh = &w->nsbw_header;
+	const char *names[] = { nsh->nsh_class, nsh->nsh_subclass,
+	    nsh->nsh_vendor, nsh->nsh_publisher };
+	size_t sz = nsev_packed_size(names, w->nsbw_nvl);
+
+	nsev_packed_fill(w->nsbw_scratch, sz, names, nsh->nsh_pid,
+	    nsh->nsh_kernel ? NSEV_PACKED_F_KERNEL : 0, w->nsbw_nvl);
+
+	return (Nan::Undefined());
+}
+
+static const struct {
+	const char *nsbs_name;
+	node_sysevent_bench_func_t *nsbs_func;
+} node_sysevent_bench_strategies[] = {
+	{ "eager", node_sysevent_bench_eager },
+	{ "interned", node_sysevent_bench_interned },
+	{ "templated", node_sysevent_bench_templated },
+	{ "packed", node_sysevent_bench_packed },
+	{ "flatten", node_sysevent_bench_flatten },
+	{ NULL, NULL }
+};
+
+/*
+ * Run "n" events through "func", adding the time taken to "*nsp".  If "heapp"
+ * is not NULL, the bytes allocated on the V8 heap are added to it, and the
+ * number of events they were measured over to "*heapnp".
+ */
+static void
+node_sysevent_bench_loop(node_sysevent_bench_workload_t *w,
+    node_sysevent_bench_func_t *func, uint32_t n, uint64_t *nsp,
+    uint64_t *heapp, uint64_t *heapnp)
+{
+	v8::HeapStatistics before, after;
+	uint32_t i, m;
+	hrtime_t start;
+
+	while (n > 0) {
+		Nan::HandleScope scope;
+
+		m = n < NODE_SYSEVENT_BENCH_BATCH ? n :
+		    NODE_SYSEVENT_BENCH_BATCH;
+		n -= m;
+
+		Nan::GetHeapStatistics(&before);
+		start = gethrtime();
+		for (i = 0; i < m; i++) {
+			(void) func(w);
+		}
+		*nsp += gethrtime() - start;
+		Nan::GetHeapStatistics(&after);
+
+		if (heapp != NULL &&
+		    after.used_heap_size() >= before.used_heap_size()) {
+			*heapp += after.used_heap_size() -
+			    before.used_heap_size();
+			*heapnp += m;
+		}
+	}
+}
+
+/*
+ * The "run(workload, strategy, count)" function: converts the workload
+ * "count" times with the strategy, and returns "{ events, ns, heapBytes,
+ * heapEvents, packedBytes }": the time taken in all, and the bytes allocated
+ * on the V8 heap over "heapEvents" of the events.
+ */
+static
+NAN_METHOD(node_sysevent_bench_run)
+{
+	node_sysevent_bench_workload_t *w = NULL;
+	node_sysevent_bench_func_t *func = NULL;
+	uint64_t ns = 0, warm = 0, heap = 0, heapn = 0;
+	Local<Object> res;
+	uint32_t count;
+	uint_t i;
+
+	if (info.Length() != 3 || !info[0]->IsString() ||
+	    !info[1]->IsString() || !info[2]->IsUint32()) {
+		Nan::ThrowTypeError("usage: run(workload, strategy, count)");
+		return;
+	}
+
+	Nan::Utf8String wname(info[0]);
+	Nan::Utf8String sname(info[1]);
+	count = Nan::To<uint32_t>(info[2]).FromJust();
+
+	for (i = 0; i < NODE_SYSEVENT_BENCH_NWORKLOADS; i++) {
+		if (strcmp(*wname, node_sysevent_bench_workloads[i].nsbw_name)
+		    == 0) {
+			w = &node_sysevent_bench_workloads[i];
+		}
+	}
+	for (i = 0; node_sysevent_bench_strategies[i].nsbs_name != NULL; i++) {
+		if (strcmp(*sname, node_sysevent_bench_strategies[i].nsbs_name)
+		    == 0) {
+			func = node_sysevent_bench_strategies[i].nsbs_func;
+		}
+	}
+	if (w == NULL || func == NULL) {
+		Nan::ThrowError("unknown workload or strategy");
+		return;
+	}
+	if (count == 0 || count > NODE_SYSEVENT_BENCH_MAX) {
+		Nan::ThrowRangeError("count out of range");
+		return;
+	}
+
+	node_sysevent_bench_loop(w, func, NODE_SYSEVENT_BENCH_WARMUP, &warm,
+	    NULL, NULL);
+	node_sysevent_bench_loop(w, func, count, &ns, &heap, &heapn);
+
+	res = Nan::New<Object>();
+	Nan::Set(res, Nan::New("events").ToLocalChecked(),
+	    Nan::New<v8::Number>((double)count));
+	Nan::Set(res, Nan::New("ns").ToLocalChecked(),
+	    Nan::New<v8::Number>((double)ns));
+	Nan::Set(res, Nan::New("heapBytes").ToLocalChecked(),
+	    Nan::New<v8::Number>((double)heap));
+	Nan::Set(res, Nan::New("heapEvents").ToLocalChecked(),
+	    Nan::New<v8::Number>((double)heapn));
+	Nan::Set(res, Nan::New("packedBytes").ToLocalChecked(),
+	    Nan::New<v8::Number>((double)w->nsbw_size));
+
+	info.GetReturnValue().Set(res);
+}
+
+static Local<Array>
+node_sysevent_bench_names(const char *(*name)(uint_t))
+{
+	Local<Array> arr = Nan::New<Array>();
+	uint_t i;
+
+	for (i = 0; name(i) != NULL; i++) {
+		Nan::Set(arr, i, Nan::New(name(i)).ToLocalChecked());
+	}
+
+	return (arr);
+}
+
+static const char *
+node_sysevent_bench_workload_name(uint_t i)
+{
+	return (i < NODE_SYSEVENT_BENCH_NWORKLOADS ?
+	    node_sysevent_bench_workloads[i].nsbw_name : NULL);
+}
+
+static const char *
+node_sysevent_bench_strategy_name(uint_t i)
+{
+	return (node_sysevent_bench_strategies[i].nsbs_name);
+}
+
+/*
+ * Build the nvlist and packed form of each workload.
+ */
+static void
+node_sysevent_bench_init(void)
+{
+	node_sysevent_bench_workload_t *w;
+	const nsev_header_t *nsh;
+	uint_t i;
+
+	for (i = 0; i < NODE_SYSEVENT_BENCH_NWORKLOADS; i++) {
+		w = &node_sysevent_bench_workloads[i];
+		nsh = &w->nsbw_header;
+		const char *names[] = { nsh->nsh_class, nsh->nsh_subclass,
+		    nsh->nsh_vendor, nsh->nsh_publisher };
+
+		if (w->nsbw_build != NULL) {
+			VERIFY0(nvlist_alloc(&w->nsbw_nvl, NV_UNIQUE_NAME, 0));
+			w->nsbw_build(w->nsbw_nvl);
+		}
+
+		w->nsbw_size = nsev_packed_size(names, w->nsbw_nvl);
+		VERIFY((w->nsbw_packed = (nsev_packed_t *)malloc(
+		    w->nsbw_size)) != NULL);
+		VERIFY((w->nsbw_scratch = (nsev_packed_t *)malloc(
+		    w->nsbw_size)) != NULL);
+		nsev_packed_fill(w->nsbw_packed, w->nsbw_size, names,
+		    nsh->nsh_pid, nsh->nsh_kernel ? NSEV_PACKED_F_KERNEL : 0,
+		    w->nsbw_nvl);
+		VERIFY0(nsev_packed_check(w->nsbw_packed, w->nsbw_size));
+	}
+}
+
+NAN_MODULE_INIT(bench_init)
+{
+	node_sysevent_convert_init();
+	node_sysevent_bench_init();
+
+	Nan::Set(target, Nan::New("workloads").ToLocalChecked(),
+	    node_sysevent_bench_names(node_sysevent_bench_workload_name));
+	Nan::Set(target, Nan::New("strategies").ToLocalChecked(),
+	    node_sysevent_bench_names(node_sysevent_bench_strategy_name));
+	Nan::SetMethod(target, "run", node_sysevent_bench_run);
+}
+
+NODE_MODULE(bench, bench_init)
@@ -0,0 +1,513 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2022 Joyent, Inc.
+ */
+
+#include <nan.h>
+#include <sys/debug.h>
+#include <string.h>
+#include <libnvpair.h>
+
+#include "convert.h"
+#include "intern.h"
+
+using v8::Local;
+using v8::Object;
+using v8::Value;
+using v8::Array;
+
+/*
+ * Objects are frozen directly where the V8 in use supports it (V8 5.5 and
+ * later), and by calling "Object.freeze()" elsewhere.
+ */
+#if V8_MAJOR_VERSION > 5 || (V8_MAJOR_VERSION == 5 && V8_MINOR_VERSION >= 5)
+#define	NODE_SYSEVENT_HAVE_INTEGRITY_LEVEL	1
+#endif
+
+/*
+ * Each supported nvpair data type has a conversion function, found through a
+ * table indexed by type.  Supporting another type means adding an entry to
+ * "node_sysevent_conv_table" below (and teaching "flat.c" to copy it).  The
+ * functions read values from flattened attribute records, which hold them in
+ * the C type used by libnvpair; see "flat.c".
+ */
+typedef int (node_sysevent_conv_func_t)(const nsev_flat_rec_t *,
+    Local<Value> *);
+
+/*
+ * The number of nvpairs we have seen with a type we do not know how to
+ * convert.  Such nvpairs are skipped.
+ */
+static uint64_t g_node_sysevent_unknown = 0;
+
+static void node_sysevent_flat_members(nsev_flat_iter_t *, Local<Object>);
+
+/*
+ * Functions to make a Javascript value from a C value.  Narrow types are
+ * widened to the argument type of one of these before conversion.
+ */
+static Local<Value>
+node_sysevent_make_int32(int32_t v)
+{
+	return (Nan::New<v8::Integer>(v));
+}
+
+static Local<Value>
+node_sysevent_make_uint32(uint32_t v)
+{
+	return (Nan::New<v8::Uint32>(v));
+}
+
+static Local<Value>
+node_sysevent_make_int64(int64_t v)
+{
+#ifdef NODE_SYSEVENT_HAVE_BIGINT
+	return (v8::BigInt::New(v8::Isolate::GetCurrent(), v));
+#else
+	return (Nan::New<v8::Number>((double)v));
+#endif
+}
+
+static Local<Value>
+node_sysevent_make_uint64(uint64_t v)
+{
+#ifdef NODE_SYSEVENT_HAVE_BIGINT
+	return (v8::BigInt::NewFromUnsigned(v8::Isolate::GetCurrent(), v));
+#else
+	return (Nan::New<v8::Number>((double)v));
+#endif
+}
+
+static Local<Value>
+node_sysevent_make_double(double v)
+{
+	return (Nan::New<v8::Number>(v));
+}
+
+static Local<Value>
+node_sysevent_make_boolean(boolean_t v)
+{
+	return (Nan::New<v8::Boolean>(v == B_TRUE));
+}
+
+static Local<Value>
+node_sysevent_make_string(const char *v)
+{
+	return (Nan::New(v).ToLocalChecked());
+}
+
+/*
+ * Convert a record holding a single value of type T, converted with MAKE
+ * (which takes the widened type W).
+ */
+template <typename T, typename W, Local<Value> (*MAKE)(W)>
+static int
+node_sysevent_conv_scalar(const nsev_flat_rec_t *rec, Local<Value> *valp)
+{
+	if (rec->nfr_vlen != sizeof (T)) {
+		return (-1);
+	}
+
+	*valp = MAKE((W)*(const T *)nsev_flat_value(rec));
+	return (0);
+}
+
+/*
+ * Convert a record holding an array of values of type T into a Javascript
+ * array.
+ */
+template <typename T, typename W, Local<Value> (*MAKE)(W)>
+static int
+node_sysevent_conv_array(const nsev_flat_rec_t *rec, Local<Value> *valp)
+{
+	const T *v = (const T *)nsev_flat_value(rec);
+	uint_t n = nsev_flat_nelem(rec);
+	Local<Array> arr;
+
+	if (rec->nfr_vlen != n * sizeof (T)) {
+		return (-1);
+	}
+
+	arr = Nan::New<Array>(n);
+	for (uint_t i = 0; i < n; i++) {
+		Nan::Set(arr, i, MAKE((W)v[i]));
+	}
+
+	*valp = arr;
+	return (0);
+}
+
+/*
+ * DATA_TYPE_BOOLEAN nvpairs have no value; their presence means "true".
+ */
+static int
+node_sysevent_conv_boolean(const nsev_flat_rec_t *, Local<Value> *valp)
+{
+	*valp = Nan::True();
+	return (0);
+}
+
+static int
+node_sysevent_conv_string(const nsev_flat_rec_t *rec, Local<Value> *valp)
+{
+	*valp = node_sysevent_make_string((const char *)nsev_flat_value(rec));
+	return (0);
+}
+
+/*
+ * The strings of a string array are stored one after another.
+ */
+static int
+node_sysevent_conv_string_array(const nsev_flat_rec_t *rec,
+    Local<Value> *valp)
+{
+	const char *str = (const char *)nsev_flat_value(rec);
+	uint_t n = nsev_flat_nelem(rec);
+	Local<Array> arr = Nan::New<Array>(n);
+
+	for (uint_t i = 0; i < n; i++) {
+		Nan::Set(arr, i, node_sysevent_make_string(str));
+		str += strlen(str) + 1;
+	}
+
+	*valp = arr;
+	return (0);
+}
+
+/*
+ * Nested nvlists are converted recursively.  The depth is bounded: libnvpair
+ * will not unpack an nvlist nested more than 20 deep, and packed events from
+ * outside this process are held to NSEV_FLAT_MAXDEPTH by "nsev_packed_check()".
+ */
+static int
+node_sysevent_conv_nvlist(const nsev_flat_rec_t *rec, Local<Value> *valp)
+{
+	Local<Object> obj = Nan::New<Object>();
+	nsev_flat_iter_t nfi;
+
+	nsev_flat_iter_child(&nfi, rec);
+	node_sysevent_flat_members(&nfi, obj);
+
+	*valp = obj;
+	return (0);
+}
+
+/*
+ * Each element of an nvlist array is itself an (unnamed) nvlist record.
+ */
+static int
+node_sysevent_conv_nvlist_array(const nsev_flat_rec_t *rec,
+    Local<Value> *valp)
+{
+	Local<Array> arr = Nan::New<Array>(nsev_flat_nelem(rec));
+	const nsev_flat_rec_t *elem;
+	nsev_flat_iter_t nfi;
+	uint32_t i = 0;
+
+	nsev_flat_iter_child(&nfi, rec);
+	while ((elem = nsev_flat_iter_next(&nfi)) != NULL) {
+		Local<Value> val;
+
+		VERIFY0(node_sysevent_conv_nvlist(elem, &val));
+		Nan::Set(arr, i++, val);
+	}
+
+	*valp = arr;
+	return (0);
+}
+
+#define	NSC_SCALAR(t, w, make) \
+	node_sysevent_conv_scalar<t, w, make>
+#define	NSC_ARRAY(t, w, make) \
+	node_sysevent_conv_array<t, w, make>
+
+static const struct {
+	data_type_t nsct_type;
+	node_sysevent_conv_func_t *nsct_func;
+} node_sysevent_conv_table[] = {
+	{ DATA_TYPE_BOOLEAN, node_sysevent_conv_boolean },
+	{ DATA_TYPE_BOOLEAN_VALUE, NSC_SCALAR(boolean_t, boolean_t,
+	    node_sysevent_make_boolean) },
+	{ DATA_TYPE_BYTE, NSC_SCALAR(uchar_t, uint32_t,
+	    node_sysevent_make_uint32) },
+	{ DATA_TYPE_INT8, NSC_SCALAR(int8_t, int32_t,
+	    node_sysevent_make_int32) },
+	{ DATA_TYPE_UINT8, NSC_SCALAR(uint8_t, uint32_t,
+	    node_sysevent_make_uint32) },
+	{ DATA_TYPE_INT16, NSC_SCALAR(int16_t, int32_t,
+	    node_sysevent_make_int32) },
+	{ DATA_TYPE_UINT16, NSC_SCALAR(uint16_t, uint32_t,
+	    node_sysevent_make_uint32) },
+	{ DATA_TYPE_INT32, NSC_SCALAR(int32_t, int32_t,
+	    node_sysevent_make_int32) },
+	{ DATA_TYPE_UINT32, NSC_SCALAR(uint32_t, uint32_t,
+	    node_sysevent_make_uint32) },
+	{ DATA_TYPE_INT64, NSC_SCALAR(int64_t, int64_t,
+	    node_sysevent_make_int64) },
+	{ DATA_TYPE_UINT64, NSC_SCALAR(uint64_t, uint64_t,
+	    node_sysevent_make_uint64) },
+	{ DATA_TYPE_HRTIME, NSC_SCALAR(hrtime_t, int64_t,
+	    node_sysevent_make_int64) },
+	{ DATA_TYPE_DOUBLE, NSC_SCALAR(double, double,
+	    node_sysevent_make_double) },
+	{ DATA_TYPE_STRING, node_sysevent_conv_string },
+	{ DATA_TYPE_NVLIST, node_sysevent_conv_nvlist },
+
+	{ DATA_TYPE_BOOLEAN_ARRAY, NSC_ARRAY(boolean_t, boolean_t,
+	    node_sysevent_make_boolean) },
+	{ DATA_TYPE_BYTE_ARRAY, NSC_ARRAY(uchar_t, uint32_t,
+	    node_sysevent_make_uint32) },
+	{ DATA_TYPE_INT8_ARRAY, NSC_ARRAY(int8_t, int32_t,
+	    node_sysevent_make_int32) },
+	{ DATA_TYPE_UINT8_ARRAY, NSC_ARRAY(uint8_t, uint32_t,
+	    node_sysevent_make_uint32) },
+	{ DATA_TYPE_INT16_ARRAY, NSC_ARRAY(int16_t, int32_t,
+	    node_sysevent_make_int32) },
+	{ DATA_TYPE_UINT16_ARRAY, NSC_ARRAY(uint16_t, uint32_t,
+	    node_sysevent_make_uint32) },
+	{ DATA_TYPE_INT32_ARRAY, NSC_ARRAY(int32_t, int32_t,
+	    node_sysevent_make_int32) },
+	{ DATA_TYPE_UINT32_ARRAY, NSC_ARRAY(uint32_t, uint32_t,
+	    node_sysevent_make_uint32) },
+	{ DATA_TYPE_INT64_ARRAY, NSC_ARRAY(int64_t, int64_t,
+	    node_sysevent_make_int64) },
+	{ DATA_TYPE_UINT64_ARRAY, NSC_ARRAY(uint64_t, uint64_t,
+	    node_sysevent_make_uint64) },
+	{ DATA_TYPE_STRING_ARRAY, node_sysevent_conv_string_array },
+	{ DATA_TYPE_NVLIST_ARRAY, node_sysevent_conv_nvlist_array },
+};
+
+#define	NODE_SYSEVENT_CONV_NTYPES	64
+
+/*
+ * Every event header has the same fields, and every delivered record has the
+ * same two properties, so we create these objects from templates that declare
+ * the properties up front, in a fixed order.  All objects made from a
+ * template then share one hidden class, and Javascript code that reads them
+ * stays monomorphic.  The placeholder values have the same type as the real
+ * values, so that filling them in does not change the shape.
+ */
+static const char *node_sysevent_header_strings[] = {
+	"class_name",
+	"subclass_name",
+	"vendor_name",
+	"publisher_name",
+	"source",
+	NULL
+};
+
+static Nan::Persistent<v8::ObjectTemplate> g_node_sysevent_header_tpl;
+static Nan::Persistent<v8::ObjectTemplate> g_node_sysevent_record_tpl;
+static Nan::Persistent<v8::ObjectTemplate> g_node_sysevent_repeat_tpl;
+
+#ifndef NODE_SYSEVENT_HAVE_INTEGRITY_LEVEL
+static Nan::Persistent<v8::Function> g_node_sysevent_freeze;
+#endif
+
+/*
+ * The conversion table, indexed by data type; built from
+ * "node_sysevent_conv_table" by "node_sysevent_convert_init()".
+ */
+static node_sysevent_conv_func_t
+    *g_node_sysevent_conv[NODE_SYSEVENT_CONV_NTYPES];
+
+void
+node_sysevent_convert_init(void)
+{
+	for (size_t i = 0; i < sizeof (node_sysevent_conv_table) /
+	    sizeof (node_sysevent_conv_table[0]); i++) {
+		data_type_t t = node_sysevent_conv_table[i].nsct_type;
+
+		VERIFY(t > DATA_TYPE_UNKNOWN && t < NODE_SYSEVENT_CONV_NTYPES);
+		VERIFY(g_node_sysevent_conv[t] == NULL);
+		g_node_sysevent_conv[t] = node_sysevent_conv_table[i].nsct_func;
+	}
+
+	Local<v8::ObjectTemplate> ht = Nan::New<v8::ObjectTemplate>();
+	for (int i = 0; node_sysevent_header_strings[i] != NULL; i++) {
+		Nan::SetTemplate(ht, node_sysevent_header_strings[i],
+		    Nan::EmptyString());
+	}
+	Nan::SetTemplate(ht, "pid", Nan::New<v8::Integer>(0));
+	g_node_sysevent_header_tpl.Reset(ht);
+
+	Local<v8::ObjectTemplate> rt = Nan::New<v8::ObjectTemplate>();
+	Nan::SetTemplate(rt, "nvl0", Nan::Null());
+	Nan::SetTemplate(rt, "nvl1", Nan::Null());
+	g_node_sysevent_record_tpl.Reset(rt);
+
+	Local<v8::ObjectTemplate> pt = Nan::New<v8::ObjectTemplate>();
+	Nan::SetTemplate(pt, "nvl0", Nan::Null());
+	Nan::SetTemplate(pt, "nvl1", Nan::Null());
+	Nan::SetTemplate(pt, "repeat", Nan::New<v8::Integer>(1));
+	g_node_sysevent_repeat_tpl.Reset(pt);
+
+#ifndef NODE_SYSEVENT_HAVE_INTEGRITY_LEVEL
+	Local<Object> ctor = Nan::Get(Nan::GetCurrentContext()->Global(),
+	    Nan::New("Object").ToLocalChecked()).ToLocalChecked()
+	    .As<Object>();
+	g_node_sysevent_freeze.Reset(Nan::Get(ctor,
+	    Nan::New("freeze").ToLocalChecked()).ToLocalChecked()
+	    .As<v8::Function>());
+#endif
+}
+
+/*
+ * Freeze "obj", as "Object.freeze()" would.  Only the object itself is
+ * frozen; objects referred to by its properties are not.
+ */
+void
+node_sysevent_freeze(Local<Object> obj)
+{
+#ifdef NODE_SYSEVENT_HAVE_INTEGRITY_LEVEL
+	(void) obj->SetIntegrityLevel(Nan::GetCurrentContext(),
+	    v8::IntegrityLevel::kFrozen);
+#else
+	Local<Value> argv[] = { obj };
+
+	(void) Nan::New(g_node_sysevent_freeze)->Call(
+	    Nan::GetCurrentContext()->Global(), 1, argv);
+#endif
+}
+
+/*
+ * Convert the value of the flattened attribute record "rec" to a Javascript
+ * value.  Returns -1 if the type of the record is not supported; such
+ * records are counted, and may be reported through
+ * "node_sysevent_convert_unknown()".
+ */
+int
+node_sysevent_flat_to_value(const nsev_flat_rec_t *rec, Local<Value> *valp)
+{
+	data_type_t t = nsev_flat_type(rec);
+
+	if (t <= DATA_TYPE_UNKNOWN || t >= NODE_SYSEVENT_CONV_NTYPES ||
+	    g_node_sysevent_conv[t] == NULL ||
+	    g_node_sysevent_conv[t](rec, valp) != 0) {
+		g_node_sysevent_unknown++;
+		return (-1);
+	}
+
+	return (0);
+}
+
+static void
+node_sysevent_flat_members(nsev_flat_iter_t *nfi, Local<Object> obj)
+{
+	const nsev_flat_rec_t *rec;
+
+	while ((rec = nsev_flat_iter_next(nfi)) != NULL) {
+		Local<Value> val;
+
+		if (node_sysevent_flat_to_value(rec, &val) != 0) {
+			continue;
+		}
+
+		Nan::Set(obj, node_sysevent_intern(nsev_flat_name(rec)), val);
+	}
+}
+
+/*
+ * Attach the contents of the flattened attribute list "nf" to the JS object
+ * "obj":
+ */
+int
+node_sysevent_flat_to_object(const nsev_flat_t *nf, Local<Object> obj)
+{
+	nsev_flat_iter_t nfi;
+
+	nsev_flat_iter_init(&nfi, nf);
+	node_sysevent_flat_members(&nfi, obj);
+
+	return (0);
+}
+
+/*
+ * Create the Javascript object for the event header "nsh"; this becomes the
+ * "nvl0" property of the record.
+ */
+Local<Object>
+node_sysevent_header_to_object(const nsev_header_t *nsh)
+{
+	Local<Object> obj = Nan::NewInstance(
+	    Nan::New(g_node_sysevent_header_tpl)).ToLocalChecked();
+
+	Nan::Set(obj, node_sysevent_intern("class_name"),
+	    Nan::New(nsh->nsh_class).ToLocalChecked());
+	Nan::Set(obj, node_sysevent_intern("subclass_name"),
+	    Nan::New(nsh->nsh_subclass).ToLocalChecked());
+	Nan::Set(obj, node_sysevent_intern("vendor_name"),
+	    Nan::New(nsh->nsh_vendor).ToLocalChecked());
+	Nan::Set(obj, node_sysevent_intern("publisher_name"),
+	    Nan::New(nsh->nsh_publisher).ToLocalChecked());
+	Nan::Set(obj, node_sysevent_intern("source"),
+	    node_sysevent_intern(nsh->nsh_kernel ? "kernel" : "user"));
+	Nan::Set(obj, node_sysevent_intern("pid"),
+	    Nan::New<v8::Integer>(nsh->nsh_pid));
+
+	return (obj);
+}
+
+/*
+ * Create the "{ nvl0, nvl1 }" record delivered to Javascript for each event.
+ */
+Local<Object>
+node_sysevent_record_new(Local<Value> nvl0, Local<Value> nvl1)
+{
+	Local<Object> obj = Nan::NewInstance(
+	    Nan::New(g_node_sysevent_record_tpl)).ToLocalChecked();
+
+	Nan::Set(obj, node_sysevent_intern("nvl0"), nvl0);
+	Nan::Set(obj, node_sysevent_intern("nvl1"), nvl1);
+
+	return (obj);
+}
+
+/*
+ * Create the "{ nvl0, nvl1, repeat }" record delivered to Javascript for
+ * streams that coalesce events; "repeat" is the number of events the record
+ * stands for.
+ */
+Local<Object>
+node_sysevent_repeat_record_new(Local<Value> nvl0, Local<Value> nvl1,
+    uint32_t repeat)
+{
+	Local<Object> obj = Nan::NewInstance(
+	    Nan::New(g_node_sysevent_repeat_tpl)).ToLocalChecked();
+
+	Nan::Set(obj, node_sysevent_intern("nvl0"), nvl0);
+	Nan::Set(obj, node_sysevent_intern("nvl1"), nvl1);
+	Nan::Set(obj, node_sysevent_intern("repeat"),
+	    Nan::New<v8::Uint32>(repeat));
+
+	return (obj);
+}
+
+/*
+ * The number of nvpairs skipped because of an unsupported data type.
+ */
+uint64_t
+node_sysevent_convert_unknown(void)
+{
+	return (g_node_sysevent_unknown);
+}
@@ -0,0 +1,63 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2022 Joyent, Inc.
+ */
+
+#ifndef	_CONVERT_H
+#define	_CONVERT_H
+
+#include <nan.h>
+#include <libnvpair.h>
+
+#include "more.h"
+
+/*
+ * 64-bit integer values are converted to BigInt where the V8 in use supports
+ * it (V8 6.7 and later), and to Number (with a possible loss of precision)
+ * elsewhere.
+ */
+#if V8_MAJOR_VERSION > 6 || (V8_MAJOR_VERSION == 6 && V8_MINOR_VERSION >= 7)
+#define	NODE_SYSEVENT_HAVE_BIGINT	1
+#endif
+
+/*
+ * Conversion of flattened attribute lists (see "flat.c") and event headers
+ * into Javascript values; see "convert.cc".
+ */
+
+void node_sysevent_convert_init(void);
+
+int node_sysevent_flat_to_value(const nsev_flat_rec_t *,
+    v8::Local<v8::Value> *);
+int node_sysevent_flat_to_object(const nsev_flat_t *, v8::Local<v8::Object>);
+
+v8::Local<v8::Object> node_sysevent_header_to_object(const nsev_header_t *);
+v8::Local<v8::Object> node_sysevent_record_new(v8::Local<v8::Value>,
+    v8::Local<v8::Value>);
+v8::Local<v8::Object> node_sysevent_repeat_record_new(v8::Local<v8::Value>,
+    v8::Local<v8::Value>, uint32_t);
+void node_sysevent_freeze(v8::Local<v8::Object>);
+
+uint64_t node_sysevent_convert_unknown(void);
+
+#endif	/* !_CONVERT_H */
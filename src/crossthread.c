@@ -24,28 +24,49 @@
  */
 
 #include <stddef.h>
+#include <stdlib.h>
 #include <strings.h>
+#include <errno.h>
 #include <sys/debug.h>
 #include <pthread.h>
+#include <atomic.h>
 #include <uv.h>
 
 #include <node_version.h>
 
 #include "crossthread.h"
-#include "illumos_list.h"
+#include "pool.h"
 
 #define	_UNUSED	__attribute__((__unused__))
 
+/*
+ * Calls are passed to the event loop thread through a lock-free
+ * multiple-producer, single-consumer queue.  Producers push each call onto
+ * the head of a singly-linked stack, "g_crossthread_head", with a
+ * compare-and-swap; they never wait for each other, or for the consumer.  The
+ * event loop thread takes every queued call at once by swapping the head for
+ * NULL, then reverses the detached chain to recover submission order.
+ *
+ * Because the consumer only ever detaches the entire stack, and never pops
+ * individual entries, the queue is not subject to the ABA problem.
+ */
 typedef struct crossthread_call {
 	pthread_mutex_t ctc_mtx;
 	pthread_cond_t ctc_cv;
 
-	list_node_t ctc_node;
+	struct crossthread_call *ctc_next;
 
 	crossthread_func_t *ctc_func;
+	crossthread_func_t *ctc_fini;
 	void *ctc_arg0;
 	void *ctc_arg1;
 
+	/*
+	 * Set for calls made through "crossthread_post()".  Nobody waits on
+	 * these; the event loop thread returns the call to the pool once it
+	 * has run.
+	 */
+	int ctc_async;
 	int ctc_done;
 
 } crossthread_call_t;
@@ -53,11 +74,66 @@ typedef struct crossthread_call {
 
 int g_crossthread_init_done;
 pthread_mutexattr_t g_crossthread_mtxattr;
-pthread_mutex_t g_crossthread_mtx;
 uv_async_t g_crossthread_async;
-list_t g_crossthread_queue;
+static crossthread_call_t *volatile g_crossthread_head = NULL;
+
+/*
+ * Micro-batching.  If "g_crossthread_window" is non-zero, queued calls are run
+ * at most once per window (in milliseconds): a wakeup that arrives sooner
+ * arms "g_crossthread_timer" to run them at the end of the window instead.
+ * Once "g_crossthread_batch_max" calls are queued, they are run without
+ * waiting for the window to end.  "g_crossthread_queued" counts the calls
+ * currently queued.
+ */
+static uv_timer_t g_crossthread_timer;
+static int g_crossthread_timer_active = 0;
+static uint_t g_crossthread_window = 0;
+static volatile uint32_t g_crossthread_batch_max = CROSSTHREAD_BATCH_DEFAULT;
+static volatile uint32_t g_crossthread_queued = 0;
+static uint64_t g_crossthread_last_run = 0;
 static pthread_t g_crossthread_self;
 static int g_crossthread_holds = 0;
+static crossthread_drain_func_t *g_crossthread_drain_func = NULL;
+
+/*
+ * Call tracking structures for "crossthread_post()" come from this pool:
+ */
+static nsev_pool_t *g_crossthread_pool = NULL;
+
+/*
+ * Push "ctc" onto the queue, and wake the event loop thread if the queue was
+ * empty.  If it was not, whoever pushed the first entry has already sent (or
+ * is about to send) a wakeup that will cover this entry as well.  We also
+ * wake the event loop thread when the queue reaches the batch size.
+ */
+static void
+crossthread_push(crossthread_call_t *ctc)
+{
+	crossthread_call_t *head;
+	uint32_t n;
+
+	/*
+	 * Ensure the contents of the call are visible before the call itself
+	 * is reachable from the queue.
+	 */
+	membar_producer();
+
+	do {
+		head = g_crossthread_head;
+		ctc->ctc_next = head;
+	} while (atomic_cas_ptr(&g_crossthread_head, head, ctc) != head);
+
+	n = atomic_inc_32_nv(&g_crossthread_queued);
+
+	if (head == NULL || n == g_crossthread_batch_max) {
+		/*
+		 * Schedule "crossthread_async_cb()" to run on the event
+		 * loop thread.  The second wakeup, once the batch is full,
+		 * cuts short any micro-batching window.
+		 */
+		VERIFY0(uv_async_send(&g_crossthread_async));
+	}
+}
 
 int
 crossthread_invoke(crossthread_func_t *func, void *arg0, void *arg1)
@@ -79,14 +155,7 @@ crossthread_invoke(crossthread_func_t *func, void *arg0, void *arg1)
 	/*
 	 * Insert the struct in the call queue.
 	 */
-	VERIFY0(pthread_mutex_lock(&g_crossthread_mtx));
-	list_insert_tail(&g_crossthread_queue, &ctc);
-	VERIFY0(pthread_mutex_unlock(&g_crossthread_mtx));
-
-	/*
-	 * Schedule "crossthread_async_cb()" to run on the event loop thread.
-	 */
-	VERIFY0(uv_async_send(&g_crossthread_async));
+	crossthread_push(&ctc);
 
 	/*
 	 * Wait for call to complete on event loop thread.
@@ -102,57 +171,169 @@ crossthread_invoke(crossthread_func_t *func, void *arg0, void *arg1)
 	return (0);
 }
 
+/*
+ * Schedule "func" to run on the event loop thread, but do not wait for it.
+ * Ownership of "arg0" and "arg1" passes to the event loop thread; once "func"
+ * has run, "fini" (if provided) is called with the same arguments to release
+ * them.  Returns -1 if the call could not be queued, in which case the caller
+ * retains ownership of the arguments.
+ */
+int
+crossthread_post(crossthread_func_t *func, crossthread_func_t *fini,
+    void *arg0, void *arg1)
+{
+	crossthread_call_t *ctc;
+
+	VERIFY(pthread_self() != g_crossthread_self);
+
+	/*
+	 * The call tracking structure must outlive this function, so it
+	 * cannot live on the stack.
+	 */
+	if ((ctc = nsev_pool_alloc(g_crossthread_pool)) == NULL) {
+		return (-1);
+	}
+	bzero(ctc, sizeof (*ctc));
+	ctc->ctc_func = func;
+	ctc->ctc_fini = fini;
+	ctc->ctc_arg0 = arg0;
+	ctc->ctc_arg1 = arg1;
+	ctc->ctc_async = 1;
+
+	crossthread_push(ctc);
+
+	return (0);
+}
+
+/*
+ * Run every queued call on the event loop thread, then call the drain
+ * function.
+ */
 static void
-#if NODE_VERSION_AT_LEAST(0, 11, 0)
-crossthread_async_cb(uv_async_t *asy)
-#else
-crossthread_async_cb(uv_async_t *asy, int status _UNUSED)
-#endif
+crossthread_run(void)
 {
-	crossthread_call_t *ctc = NULL;
+	crossthread_call_t *ctc, *next, *work = NULL;
+	uint32_t n = 0;
 
 	VERIFY(pthread_self() == g_crossthread_self);
 
-top:
+	if (g_crossthread_timer_active) {
+		VERIFY0(uv_timer_stop(&g_crossthread_timer));
+		g_crossthread_timer_active = 0;
+	}
+	g_crossthread_last_run = uv_now(uv_default_loop());
+
 	/*
-	 * Attempt to get work from the queue:
+	 * Take every call that is currently queued in one go.  Anything
+	 * enqueued after this point will have sent another wakeup.  The
+	 * detached chain is newest-first, so reverse it to run the calls in
+	 * the order they were made.
 	 */
-	VERIFY0(pthread_mutex_lock(&g_crossthread_mtx));
-	if (!list_is_empty(&g_crossthread_queue)) {
-		ctc = list_remove_head(&g_crossthread_queue);
+	ctc = atomic_swap_ptr(&g_crossthread_head, NULL);
+	membar_consumer();
+	while (ctc != NULL) {
+		next = ctc->ctc_next;
+		ctc->ctc_next = work;
+		work = ctc;
+		ctc = next;
+		n++;
+	}
+	if (n > 0) {
+		atomic_add_32(&g_crossthread_queued, -(int32_t)n);
 	}
-	VERIFY0(pthread_mutex_unlock(&g_crossthread_mtx));
 
-	if (ctc == NULL) {
+	for (ctc = work; ctc != NULL; ctc = next) {
+		/*
+		 * Once a call has run, its tracking structure may be freed
+		 * (or, for "crossthread_invoke()", go out of scope), so we
+		 * must read the link first.
+		 */
+		next = ctc->ctc_next;
+
+		if (ctc->ctc_async) {
+			/*
+			 * Nobody is waiting for this call.  Run it, release
+			 * the arguments and free the tracking structure.
+			 */
+			ctc->ctc_func(ctc->ctc_arg0, ctc->ctc_arg1);
+			if (ctc->ctc_fini != NULL) {
+				ctc->ctc_fini(ctc->ctc_arg0, ctc->ctc_arg1);
+			}
+			nsev_pool_free(g_crossthread_pool, ctc);
+			continue;
+		}
+
+		/*
+		 * Ensure we haven't seen this one already:
+		 */
+		VERIFY0(pthread_mutex_lock(&ctc->ctc_mtx));
+		VERIFY(ctc->ctc_done == 0);
+		VERIFY0(pthread_mutex_unlock(&ctc->ctc_mtx));
+
 		/*
-		 * No work; back to sleep.
+		 * Run the enqueued function:
 		 */
-		return;
+		ctc->ctc_func(ctc->ctc_arg0, ctc->ctc_arg1);
+
+		/*
+		 * Send reply back to waiting "crossthread_invoke()" call:
+		 */
+		VERIFY0(pthread_mutex_lock(&ctc->ctc_mtx));
+		VERIFY(ctc->ctc_done == 0);
+		ctc->ctc_done = 1;
+		VERIFY0(pthread_cond_broadcast(&ctc->ctc_cv));
+		VERIFY0(pthread_mutex_unlock(&ctc->ctc_mtx));
 	}
 
 	/*
-	 * Ensure we haven't seen this one already:
+	 * Let the consumer know that this batch of calls is complete.
 	 */
-	VERIFY0(pthread_mutex_lock(&ctc->ctc_mtx));
-	VERIFY(ctc->ctc_done == 0);
-	VERIFY0(pthread_mutex_unlock(&ctc->ctc_mtx));
+	if (g_crossthread_drain_func != NULL) {
+		g_crossthread_drain_func();
+	}
+}
 
-	/*
-	 * Run the enqueued function:
-	 */
-	ctc->ctc_func(ctc->ctc_arg0, ctc->ctc_arg1);
+static void
+#if NODE_VERSION_AT_LEAST(0, 11, 0)
+crossthread_timer_cb(uv_timer_t *timer _UNUSED)
+#else
+crossthread_timer_cb(uv_timer_t *timer _UNUSED, int status _UNUSED)
+#endif
+{
+	g_crossthread_timer_active = 0;
+	crossthread_run();
+}
 
-	/*
-	 * Send reply back to waiting "crossthread_invoke()" call:
-	 */
-	VERIFY0(pthread_mutex_lock(&ctc->ctc_mtx));
-	VERIFY(ctc->ctc_done == 0);
-	ctc->ctc_done = 1;
-	VERIFY0(pthread_cond_broadcast(&ctc->ctc_cv));
-	VERIFY0(pthread_mutex_unlock(&ctc->ctc_mtx));
-
-	ctc = NULL;
-	goto top;
+static void
+#if NODE_VERSION_AT_LEAST(0, 11, 0)
+crossthread_async_cb(uv_async_t *asy _UNUSED)
+#else
+crossthread_async_cb(uv_async_t *asy _UNUSED, int status _UNUSED)
+#endif
+{
+	uint64_t elapsed;
+
+	VERIFY(pthread_self() == g_crossthread_self);
+
+	if (g_crossthread_window > 0 &&
+	    g_crossthread_queued < g_crossthread_batch_max) {
+		elapsed = uv_now(uv_default_loop()) - g_crossthread_last_run;
+		if (elapsed < g_crossthread_window) {
+			/*
+			 * We ran a batch recently; let more calls accumulate
+			 * until the end of the window.
+			 */
+			if (!g_crossthread_timer_active) {
+				VERIFY0(uv_timer_start(&g_crossthread_timer,
+				    crossthread_timer_cb,
+				    g_crossthread_window - elapsed, 0));
+				g_crossthread_timer_active = 1;
+			}
+			return;
+		}
+	}
+
+	crossthread_run();
 }
 
 void
@@ -176,6 +357,98 @@ crossthread_release_hold(void)
 	}
 }
 
+/*
+ * Register a function to be called on the event loop thread each time a batch
+ * of queued calls has been run.
+ */
+void
+crossthread_set_drain_func(crossthread_drain_func_t *func)
+{
+	VERIFY(g_crossthread_init_done != 0);
+	VERIFY(pthread_self() == g_crossthread_self);
+
+	g_crossthread_drain_func = func;
+}
+
+/*
+ * Called on the event loop thread to request that the drain function be
+ * called again soon, even if no calls are queued.
+ */
+void
+crossthread_wake(void)
+{
+	VERIFY(g_crossthread_init_done != 0);
+	VERIFY(pthread_self() == g_crossthread_self);
+
+	VERIFY0(uv_async_send(&g_crossthread_async));
+}
+
+/*
+ * Configure micro-batching: queued calls are run at most once every "window"
+ * milliseconds, unless "max" or more calls are queued.  A "window" of zero
+ * runs calls as soon as possible.
+ */
+void
+crossthread_set_batching(uint_t max, uint_t window)
+{
+	VERIFY(g_crossthread_init_done != 0);
+	VERIFY(pthread_self() == g_crossthread_self);
+	VERIFY(max > 0);
+
+	g_crossthread_batch_max = max;
+	g_crossthread_window = window;
+
+	if (window == 0 && g_crossthread_timer_active) {
+		/*
+		 * Run anything that was waiting for the window to end.
+		 */
+		VERIFY0(uv_timer_stop(&g_crossthread_timer));
+		g_crossthread_timer_active = 0;
+		VERIFY0(uv_async_send(&g_crossthread_async));
+	}
+}
+
+/*
+ * Replace the pool of call tracking structures used by "crossthread_post()"
+ * with one of "ncalls" structures, using "policy" once it is exhausted.  This
+ * must not race with "crossthread_post()", so the caller must ensure there
+ * are no other threads that could post calls.  Fails with EBUSY if calls are
+ * still outstanding.
+ */
+int
+crossthread_configure(uint_t ncalls, nsev_pool_policy_t policy)
+{
+	nsev_pool_stats_t nps;
+	nsev_pool_t *np;
+
+	VERIFY(g_crossthread_init_done != 0);
+	VERIFY(pthread_self() == g_crossthread_self);
+
+	nsev_pool_stats(g_crossthread_pool, &nps);
+	if (nps.nps_inuse != 0) {
+		errno = EBUSY;
+		return (-1);
+	}
+
+	if ((np = nsev_pool_create(sizeof (crossthread_call_t), ncalls,
+	    policy)) == NULL) {
+		errno = ENOMEM;
+		return (-1);
+	}
+
+	nsev_pool_destroy(g_crossthread_pool);
+	g_crossthread_pool = np;
+	return (0);
+}
+
+void
+crossthread_pool_stats(nsev_pool_stats_t *nps)
+{
+	VERIFY(g_crossthread_init_done != 0);
+
+	nsev_pool_stats(g_crossthread_pool, nps);
+}
+
 int
 crossthread_init(void)
 {
@@ -184,18 +457,19 @@ crossthread_init(void)
 
 	g_crossthread_self = pthread_self();
 
-	list_create(&g_crossthread_queue, sizeof (crossthread_call_t),
-	    offsetof(crossthread_call_t, ctc_node));
+	VERIFY((g_crossthread_pool = nsev_pool_create(
+	    sizeof (crossthread_call_t), NSEV_POOL_DEFAULT_SIZE,
+	    NSEV_POOL_MALLOC)) != NULL);
 
 	VERIFY0(uv_async_init(uv_default_loop(), &g_crossthread_async,
 	   crossthread_async_cb));
+	VERIFY0(uv_timer_init(uv_default_loop(), &g_crossthread_timer));
+	uv_unref((uv_handle_t *)&g_crossthread_timer);
 
 	VERIFY0(pthread_mutexattr_init(&g_crossthread_mtxattr));
 	VERIFY0(pthread_mutexattr_settype(&g_crossthread_mtxattr,
 	     PTHREAD_MUTEX_ERRORCHECK));
 
-	VERIFY0(pthread_mutex_init(&g_crossthread_mtx, &g_crossthread_mtxattr));
-
 	uv_unref((uv_handle_t *)&g_crossthread_async);
 
 	return (0);
@@ -26,14 +26,29 @@
 #ifndef	_CROSSTHREAD_H
 #define	_CROSSTHREAD_H
 
+#include "pool.h"
+
 #ifdef	__cplusplus
 extern "C" {
 #endif
 
+/*
+ * The default number of queued calls that ends a micro-batching window:
+ */
+#define	CROSSTHREAD_BATCH_DEFAULT	256
+
 typedef void (crossthread_func_t)(void *, void *);
+typedef void (crossthread_drain_func_t)(void);
 
 int crossthread_invoke(crossthread_func_t *, void *, void *);
+int crossthread_post(crossthread_func_t *, crossthread_func_t *, void *,
+    void *);
 int crossthread_init(void);
+void crossthread_set_drain_func(crossthread_drain_func_t *);
+void crossthread_wake(void);
+void crossthread_set_batching(uint_t, uint_t);
+int crossthread_configure(uint_t, nsev_pool_policy_t);
+void crossthread_pool_stats(nsev_pool_stats_t *);
 
 void crossthread_take_hold(void);
 void crossthread_release_hold(void);
@@ -0,0 +1,506 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2022 Joyent, Inc.
+ */
+
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/debug.h>
+#include <libsysevent.h>
+#include <libnvpair.h>
+
+#include "flat.h"
+#include "filter.h"
+
+/*
+ * Each subscriber may provide a filter, which is compiled from the options
+ * nvlist passed to "nsev_attach()" once, at attach time, and evaluated against
+ * every event before any Javascript objects are created for it.  The options
+ * understood here are:
+ *
+ *	classes		nvlist mapping class names to string arrays of
+ *			subclass names; an empty array selects every
+ *			subclass.
+ *
+ *	vendors		string array; the event vendor must be one of these.
+ *
+ *	publishers	string array; the event publisher must begin with one
+ *			of these.
+ *
+ *	attributes	nvlist mapping attribute names to the value that the
+ *			attribute must have.  A string, int64 or boolean_value
+ *			is compared for equality; a nested nvlist containing a
+ *			"prefix" string requires a string attribute beginning
+ *			with that prefix.
+ *
+ * The compiled filter lives in a single allocation: the "nsev_filter_t"
+ * header is followed by the class, vendor, publisher and attribute tables,
+ * and then the strings they refer to.
+ */
+
+typedef enum nsev_filter_op {
+	NSEV_FILTER_STRING_EQ = 1,
+	NSEV_FILTER_STRING_PREFIX,
+	NSEV_FILTER_INT_EQ,
+	NSEV_FILTER_BOOL_EQ
+} nsev_filter_op_t;
+
+typedef struct nsev_filter_class {
+	const char *nfc_class;
+	const char **nfc_subclasses;
+	uint_t nfc_nsubclasses;		/* 0 selects every subclass */
+} nsev_filter_class_t;
+
+typedef struct nsev_filter_attr {
+	const char *nfa_name;
+	nsev_filter_op_t nfa_op;
+	const char *nfa_str;
+	size_t nfa_strlen;
+	int64_t nfa_int;
+} nsev_filter_attr_t;
+
+struct nsev_filter {
+	int nf_all_classes;
+	uint_t nf_nclasses;
+	nsev_filter_class_t *nf_classes;
+
+	uint_t nf_nvendors;
+	const char **nf_vendors;
+
+	uint_t nf_npublishers;
+	const char **nf_publishers;
+
+	uint_t nf_nattrs;
+	nsev_filter_attr_t *nf_attrs;
+};
+
+#define	NSEV_FILTER_ALIGN(x)	\
+	(((x) + sizeof (uint64_t) - 1) & ~(sizeof (uint64_t) - 1))
+
+/*
+ * Carve "sz" bytes out of the filter allocation.  "nsev_filter_measure()"
+ * reserves NSEV_FILTER_ALIGN(sz) for each of these calls, so we cannot run
+ * off the end.
+ */
+static void *
+nsev_filter_alloc(char *base, size_t *offp, size_t sz)
+{
+	void *p;
+
+	*offp = NSEV_FILTER_ALIGN(*offp);
+	p = base + *offp;
+	*offp += sz;
+
+	return (p);
+}
+
+static const char *
+nsev_filter_strdup(char *base, size_t *offp, const char *str)
+{
+	size_t len = strlen(str) + 1;
+	char *p = nsev_filter_alloc(base, offp, len);
+
+	bcopy(str, p, len);
+	return (p);
+}
+
+static int
+nsev_filter_measure_strv(char **strv, uint_t n, size_t maxlen, size_t *szp)
+{
+	uint_t i;
+
+	*szp += NSEV_FILTER_ALIGN(n * sizeof (char *));
+	for (i = 0; i < n; i++) {
+		if (strlen(strv[i]) >= maxlen) {
+			return (-1);
+		}
+		*szp += NSEV_FILTER_ALIGN(strlen(strv[i]) + 1);
+	}
+
+	return (0);
+}
+
+/*
+ * Validate the filter options and work out how large the compiled filter
+ * will be.  Returns 0 if the options are invalid.
+ */
+static size_t
+nsev_filter_measure(nvlist_t *opts)
+{
+	size_t sz = NSEV_FILTER_ALIGN(sizeof (nsev_filter_t));
+	nvlist_t *classes, *attrs;
+	nvpair_t *nvp;
+	char **strv;
+	uint_t n;
+
+	if (nvlist_lookup_nvlist(opts, "classes", &classes) == 0) {
+		nvp = NULL;
+		n = 0;
+		while ((nvp = nvlist_next_nvpair(classes, nvp)) != NULL) {
+			char **subs;
+			uint_t nsubs;
+
+			if (nvpair_type(nvp) != DATA_TYPE_STRING_ARRAY ||
+			    strlen(nvpair_name(nvp)) >= MAX_CLASS_LEN ||
+			    strcmp(nvpair_name(nvp), EC_ALL) == 0) {
+				return (0);
+			}
+			VERIFY0(nvpair_value_string_array(nvp, &subs, &nsubs));
+			if (nsev_filter_measure_strv(subs, nsubs,
+			    MAX_SUBCLASS_LEN, &sz) != 0) {
+				return (0);
+			}
+			sz += NSEV_FILTER_ALIGN(strlen(nvpair_name(nvp)) + 1);
+			n++;
+		}
+		sz += NSEV_FILTER_ALIGN(n * sizeof (nsev_filter_class_t));
+	} else if (nvlist_exists(opts, "classes")) {
+		return (0);
+	}
+
+	if (nvlist_lookup_string_array(opts, "vendors", &strv, &n) == 0) {
+		VERIFY0(nsev_filter_measure_strv(strv, n, SIZE_MAX, &sz));
+	} else if (nvlist_exists(opts, "vendors")) {
+		return (0);
+	}
+
+	if (nvlist_lookup_string_array(opts, "publishers", &strv, &n) == 0) {
+		VERIFY0(nsev_filter_measure_strv(strv, n, SIZE_MAX, &sz));
+	} else if (nvlist_exists(opts, "publishers")) {
+		return (0);
+	}
+
+	if (nvlist_lookup_nvlist(opts, "attributes", &attrs) == 0) {
+		nvp = NULL;
+		n = 0;
+		while ((nvp = nvlist_next_nvpair(attrs, nvp)) != NULL) {
+			nvlist_t *rule;
+			char *str;
+
+			switch (nvpair_type(nvp)) {
+			case DATA_TYPE_STRING:
+				VERIFY0(nvpair_value_string(nvp, &str));
+				break;
+
+			case DATA_TYPE_NVLIST:
+				VERIFY0(nvpair_value_nvlist(nvp, &rule));
+				if (nvlist_lookup_string(rule, "prefix",
+				    &str) != 0) {
+					return (0);
+				}
+				break;
+
+			case DATA_TYPE_INT64:
+			case DATA_TYPE_BOOLEAN_VALUE:
+				str = NULL;
+				break;
+
+			default:
+				return (0);
+			}
+
+			sz += NSEV_FILTER_ALIGN(strlen(nvpair_name(nvp)) + 1);
+			if (str != NULL) {
+				sz += NSEV_FILTER_ALIGN(strlen(str) + 1);
+			}
+			n++;
+		}
+		sz += NSEV_FILTER_ALIGN(n * sizeof (nsev_filter_attr_t));
+	} else if (nvlist_exists(opts, "attributes")) {
+		return (0);
+	}
+
+	return (sz);
+}
+
+static void
+nsev_filter_fill_strv(char *base, size_t *offp, char **strv, uint_t n,
+    const char ***outp)
+{
+	const char **out;
+	uint_t i;
+
+	out = nsev_filter_alloc(base, offp, n * sizeof (char *));
+	for (i = 0; i < n; i++) {
+		out[i] = nsev_filter_strdup(base, offp, strv[i]);
+	}
+
+	*outp = out;
+}
+
+/*
+ * Compile the filter options in "opts" (which may be NULL).  If there is
+ * nothing to filter on, "*nfp" is set to NULL, which matches every event.
+ * Fails with EINVAL if the options are not valid, or ENOMEM.
+ */
+int
+nsev_filter_compile(nvlist_t *opts, nsev_filter_t **nfp)
+{
+	nsev_filter_t *nf;
+	nvlist_t *classes, *attrs;
+	nvpair_t *nvp;
+	char **strv;
+	uint_t n;
+	size_t sz, off;
+	char *base;
+
+	*nfp = NULL;
+
+	if (opts == NULL || (!nvlist_exists(opts, "classes") &&
+	    !nvlist_exists(opts, "vendors") &&
+	    !nvlist_exists(opts, "publishers") &&
+	    !nvlist_exists(opts, "attributes"))) {
+		return (0);
+	}
+
+	if ((sz = nsev_filter_measure(opts)) == 0) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	if ((base = calloc(1, sz)) == NULL) {
+		errno = ENOMEM;
+		return (-1);
+	}
+	off = 0;
+	nf = nsev_filter_alloc(base, &off, sizeof (*nf));
+
+	if (nvlist_lookup_nvlist(opts, "classes", &classes) == 0) {
+		nvp = NULL;
+		while ((nvp = nvlist_next_nvpair(classes, nvp)) != NULL) {
+			nf->nf_nclasses++;
+		}
+		nf->nf_classes = nsev_filter_alloc(base, &off,
+		    nf->nf_nclasses * sizeof (nsev_filter_class_t));
+
+		nvp = NULL;
+		n = 0;
+		while ((nvp = nvlist_next_nvpair(classes, nvp)) != NULL) {
+			nsev_filter_class_t *nfc = &nf->nf_classes[n++];
+
+			nfc->nfc_class = nsev_filter_strdup(base, &off,
+			    nvpair_name(nvp));
+			VERIFY0(nvpair_value_string_array(nvp, &strv,
+			    &nfc->nfc_nsubclasses));
+			nsev_filter_fill_strv(base, &off, strv,
+			    nfc->nfc_nsubclasses, &nfc->nfc_subclasses);
+		}
+	} else {
+		nf->nf_all_classes = 1;
+	}
+
+	if (nvlist_lookup_string_array(opts, "vendors", &strv, &n) == 0) {
+		nf->nf_nvendors = n;
+		nsev_filter_fill_strv(base, &off, strv, n, &nf->nf_vendors);
+	}
+
+	if (nvlist_lookup_string_array(opts, "publishers", &strv, &n) == 0) {
+		nf->nf_npublishers = n;
+		nsev_filter_fill_strv(base, &off, strv, n,
+		    &nf->nf_publishers);
+	}
+
+	if (nvlist_lookup_nvlist(opts, "attributes", &attrs) == 0) {
+		nvp = NULL;
+		while ((nvp = nvlist_next_nvpair(attrs, nvp)) != NULL) {
+			nf->nf_nattrs++;
+		}
+		nf->nf_attrs = nsev_filter_alloc(base, &off,
+		    nf->nf_nattrs * sizeof (nsev_filter_attr_t));
+
+		nvp = NULL;
+		n = 0;
+		while ((nvp = nvlist_next_nvpair(attrs, nvp)) != NULL) {
+			nsev_filter_attr_t *nfa = &nf->nf_attrs[n++];
+			boolean_t bv;
+			nvlist_t *rule;
+			char *str = NULL;
+
+			nfa->nfa_name = nsev_filter_strdup(base, &off,
+			    nvpair_name(nvp));
+
+			switch (nvpair_type(nvp)) {
+			case DATA_TYPE_STRING:
+				nfa->nfa_op = NSEV_FILTER_STRING_EQ;
+				VERIFY0(nvpair_value_string(nvp, &str));
+				break;
+
+			case DATA_TYPE_NVLIST:
+				nfa->nfa_op = NSEV_FILTER_STRING_PREFIX;
+				VERIFY0(nvpair_value_nvlist(nvp, &rule));
+				VERIFY0(nvlist_lookup_string(rule, "prefix",
+				    &str));
+				break;
+
+			case DATA_TYPE_INT64:
+				nfa->nfa_op = NSEV_FILTER_INT_EQ;
+				VERIFY0(nvpair_value_int64(nvp,
+				    &nfa->nfa_int));
+				break;
+
+			case DATA_TYPE_BOOLEAN_VALUE:
+				nfa->nfa_op = NSEV_FILTER_BOOL_EQ;
+				VERIFY0(nvpair_value_boolean_value(nvp, &bv));
+				nfa->nfa_int = (bv == B_TRUE);
+				break;
+
+			default:
+				VERIFY(0);
+			}
+
+			if (str != NULL) {
+				nfa->nfa_str = nsev_filter_strdup(base, &off,
+				    str);
+				nfa->nfa_strlen = strlen(str);
+			}
+		}
+	}
+
+	VERIFY(off <= sz);
+
+	*nfp = nf;
+	return (0);
+}
+
+void
+nsev_filter_free(nsev_filter_t *nf)
+{
+	free(nf);
+}
+
+static int
+nsev_filter_attr_match(const nsev_filter_attr_t *nfa,
+    const nsev_flat_t *attrs)
+{
+	const nsev_flat_rec_t *rec;
+	int64_t iv;
+
+	if (attrs == NULL ||
+	    (rec = nsev_flat_lookup(attrs, nfa->nfa_name)) == NULL) {
+		return (0);
+	}
+
+	switch (nfa->nfa_op) {
+	case NSEV_FILTER_STRING_EQ:
+		return (nsev_flat_type(rec) == DATA_TYPE_STRING &&
+		    strcmp(nsev_flat_value(rec), nfa->nfa_str) == 0);
+
+	case NSEV_FILTER_STRING_PREFIX:
+		return (nsev_flat_type(rec) == DATA_TYPE_STRING &&
+		    strncmp(nsev_flat_value(rec), nfa->nfa_str,
+		    nfa->nfa_strlen) == 0);
+
+	case NSEV_FILTER_INT_EQ:
+		return (nsev_flat_int64(rec, &iv) == 0 &&
+		    iv == nfa->nfa_int);
+
+	case NSEV_FILTER_BOOL_EQ:
+		return (nsev_flat_type(rec) == DATA_TYPE_BOOLEAN_VALUE &&
+		    (*(const boolean_t *)nsev_flat_value(rec) == B_TRUE) ==
+		    nfa->nfa_int);
+	}
+
+	return (0);
+}
+
+static int
+nsev_filter_strv_contains(const char **strv, uint_t n, const char *str)
+{
+	uint_t i;
+
+	for (i = 0; i < n; i++) {
+		if (strcmp(strv[i], str) == 0) {
+			return (1);
+		}
+	}
+
+	return (0);
+}
+
+/*
+ * Returns 1 if the event matches the filter.  A NULL filter matches every
+ * event.
+ */
+int
+nsev_filter_match(const nsev_filter_t *nf, const nsev_filter_event_t *nfe)
+{
+	uint_t i;
+
+	if (nf == NULL) {
+		return (1);
+	}
+
+	if (!nf->nf_all_classes) {
+		const nsev_filter_class_t *nfc = NULL;
+
+		if (nfe->nfe_class == NULL || nfe->nfe_subclass == NULL) {
+			return (0);
+		}
+
+		for (i = 0; i < nf->nf_nclasses; i++) {
+			if (strcmp(nf->nf_classes[i].nfc_class,
+			    nfe->nfe_class) == 0) {
+				nfc = &nf->nf_classes[i];
+				break;
+			}
+		}
+
+		if (nfc == NULL || (nfc->nfc_nsubclasses > 0 &&
+		    !nsev_filter_strv_contains(nfc->nfc_subclasses,
+		    nfc->nfc_nsubclasses, nfe->nfe_subclass))) {
+			return (0);
+		}
+	}
+
+	if (nf->nf_nvendors > 0 && (nfe->nfe_vendor == NULL ||
+	    !nsev_filter_strv_contains(nf->nf_vendors, nf->nf_nvendors,
+	    nfe->nfe_vendor))) {
+		return (0);
+	}
+
+	if (nf->nf_npublishers > 0) {
+		if (nfe->nfe_publisher == NULL) {
+			return (0);
+		}
+		for (i = 0; i < nf->nf_npublishers; i++) {
+			if (strncmp(nfe->nfe_publisher, nf->nf_publishers[i],
+			    strlen(nf->nf_publishers[i])) == 0) {
+				break;
+			}
+		}
+		if (i == nf->nf_npublishers) {
+			return (0);
+		}
+	}
+
+	for (i = 0; i < nf->nf_nattrs; i++) {
+		if (!nsev_filter_attr_match(&nf->nf_attrs[i],
+		    nfe->nfe_attrs)) {
+			return (0);
+		}
+	}
+
+	return (1);
+}
@@ -0,0 +1,58 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2022 Joyent, Inc.
+ */
+
+#ifndef	_FILTER_H
+#define	_FILTER_H
+
+#include <libnvpair.h>
+
+#include "flat.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+typedef struct nsev_filter nsev_filter_t;
+
+/*
+ * The parts of an event that a filter may examine:
+ */
+typedef struct nsev_filter_event {
+	const char *nfe_class;
+	const char *nfe_subclass;
+	const char *nfe_vendor;
+	const char *nfe_publisher;
+	const nsev_flat_t *nfe_attrs;
+} nsev_filter_event_t;
+
+int nsev_filter_compile(nvlist_t *, nsev_filter_t **);
+int nsev_filter_match(const nsev_filter_t *, const nsev_filter_event_t *);
+void nsev_filter_free(nsev_filter_t *);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* !_FILTER_H */
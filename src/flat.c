@@ -0,0 +1,733 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2022 Joyent, Inc.
+ */
+
+/*
+ * Flattened attribute lists.  The attribute nvlist of an event is copied, on
+ * the thread that receives the event from libsysevent, into a single buffer
+ * laid out so that the event loop thread can read it with nothing more than
+ * pointer arithmetic: no nvpair lookups, no unpacking, and no allocation
+ * until the Javascript values themselves are made.
+ *
+ * The buffer starts with an nsev_flat_t header, followed by one record for
+ * each nvpair in the list, in nvlist order.  Each record is:
+ *
+ *	+------------------+
+ *	| nsev_flat_rec_t  |	16 bytes
+ *	+------------------+
+ *	| name, NUL        |	padded to 8 bytes
+ *	+------------------+
+ *	| value            |	"nfr_vlen" bytes, padded to 8 bytes
+ *	+------------------+
+ *
+ * and "nfr_size" covers all three parts, so the next record follows directly.
+ * Every record, and so every value, starts on an 8-byte boundary.  Values are
+ * stored as follows:
+ *
+ *	scalars		the value, in the C type used by libnvpair
+ *	arrays		"nfr_nelem" values of that type, contiguously
+ *	strings		the string, NUL terminated
+ *	string arrays	"nfr_nelem" NUL-terminated strings, one after another
+ *	nvlists		one record per member; "nfr_nelem" is the member count
+ *	nvlist arrays	"nfr_nelem" nvlist records, each with an empty name
+ *	booleans	nothing (DATA_TYPE_BOOLEAN has no value)
+ *
+ * Nvpairs of any other type are kept as a record with an empty value, so that
+ * consumers still see (and may count) them.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/debug.h>
+#include <libnvpair.h>
+
+#include "flat.h"
+
+#define	NSEV_FLAT_ALIGN(x)	\
+	(((x) + sizeof (uint64_t) - 1) & ~(sizeof (uint64_t) - 1))
+
+/*
+ * Each of the "nsev_flat_put_*()" functions below writes a part of the buffer
+ * "buf", starting at offset "off", and returns the offset just past what it
+ * wrote.  If "buf" is NULL, nothing is written, and the functions only
+ * measure; "nsev_flat_size()" uses this to size the buffer, so that the
+ * layout logic exists in one place only.
+ */
+static size_t nsev_flat_put_list(nvlist_t *, char *, size_t, uint32_t *);
+
+/*
+ * Write the record header and name of a record starting at "off", and return
+ * the offset of its value.
+ */
+static size_t
+nsev_flat_put_begin(char *buf, size_t off, const char *name, data_type_t type)
+{
+	size_t namelen = strlen(name) + 1;
+	size_t voff = off + sizeof (nsev_flat_rec_t) + NSEV_FLAT_ALIGN(namelen);
+
+	if (buf != NULL) {
+		nsev_flat_rec_t *rec = (nsev_flat_rec_t *)(buf + off);
+		char *nm = (char *)(rec + 1);
+
+		rec->nfr_type = (uint16_t)type;
+		rec->nfr_namelen = (uint16_t)namelen;
+		bcopy(name, nm, namelen);
+		bzero(nm + namelen, voff - off - sizeof (*rec) - namelen);
+	}
+
+	return (voff);
+}
+
+/*
+ * Finish the record starting at "off", whose value, of "vlen" bytes, has been
+ * written at "voff".
+ */
+static size_t
+nsev_flat_put_end(char *buf, size_t off, size_t voff, size_t vlen,
+    uint32_t nelem)
+{
+	size_t end = voff + NSEV_FLAT_ALIGN(vlen);
+
+	if (buf != NULL) {
+		nsev_flat_rec_t *rec = (nsev_flat_rec_t *)(buf + off);
+
+		rec->nfr_size = (uint32_t)(end - off);
+		rec->nfr_nelem = nelem;
+		rec->nfr_vlen = (uint32_t)vlen;
+		bzero(buf + voff + vlen, end - voff - vlen);
+	}
+
+	return (end);
+}
+
+#define	NSEV_FLAT_SCALAR(type, ctype, get)				\
+	case type: {							\
+		ctype v;						\
+		VERIFY0(get(nvp, &v));					\
+		len = sizeof (v);					\
+		if (dst != NULL)					\
+			bcopy(&v, dst, len);				\
+		*nelemp = 1;						\
+		return (len);						\
+	}
+
+#define	NSEV_FLAT_ARRAY(type, ctype, get)				\
+	case type: {							\
+		ctype *v;						\
+		VERIFY0(get(nvp, &v, &n));				\
+		len = n * sizeof (*v);					\
+		if (dst != NULL && len != 0)				\
+			bcopy(v, dst, len);				\
+		*nelemp = n;						\
+		return (len);						\
+	}
+
+/*
+ * Write the value of "nvp", which is of any type other than an nvlist or an
+ * nvlist array, to "dst" (if it is not NULL), and return its length.
+ */
+static size_t
+nsev_flat_put_value(nvpair_t *nvp, char *dst, uint32_t *nelemp)
+{
+	size_t len, slen;
+	char *str, **strv;
+	uint_t i, n;
+
+	switch (nvpair_type(nvp)) {
+	NSEV_FLAT_SCALAR(DATA_TYPE_BOOLEAN_VALUE, boolean_t,
+	    nvpair_value_boolean_value)
+	NSEV_FLAT_SCALAR(DATA_TYPE_BYTE, uchar_t, nvpair_value_byte)
+	NSEV_FLAT_SCALAR(DATA_TYPE_INT8, int8_t, nvpair_value_int8)
+	NSEV_FLAT_SCALAR(DATA_TYPE_UINT8, uint8_t, nvpair_value_uint8)
+	NSEV_FLAT_SCALAR(DATA_TYPE_INT16, int16_t, nvpair_value_int16)
+	NSEV_FLAT_SCALAR(DATA_TYPE_UINT16, uint16_t, nvpair_value_uint16)
+	NSEV_FLAT_SCALAR(DATA_TYPE_INT32, int32_t, nvpair_value_int32)
+	NSEV_FLAT_SCALAR(DATA_TYPE_UINT32, uint32_t, nvpair_value_uint32)
+	NSEV_FLAT_SCALAR(DATA_TYPE_INT64, int64_t, nvpair_value_int64)
+	NSEV_FLAT_SCALAR(DATA_TYPE_UINT64, uint64_t, nvpair_value_uint64)
+	NSEV_FLAT_SCALAR(DATA_TYPE_HRTIME, hrtime_t, nvpair_value_hrtime)
+	NSEV_FLAT_SCALAR(DATA_TYPE_DOUBLE, double, nvpair_value_double)
+
+	NSEV_FLAT_ARRAY(DATA_TYPE_BOOLEAN_ARRAY, boolean_t,
+	    nvpair_value_boolean_array)
+	NSEV_FLAT_ARRAY(DATA_TYPE_BYTE_ARRAY, uchar_t, nvpair_value_byte_array)
+	NSEV_FLAT_ARRAY(DATA_TYPE_INT8_ARRAY, int8_t, nvpair_value_int8_array)
+	NSEV_FLAT_ARRAY(DATA_TYPE_UINT8_ARRAY, uint8_t,
+	    nvpair_value_uint8_array)
+	NSEV_FLAT_ARRAY(DATA_TYPE_INT16_ARRAY, int16_t,
+	    nvpair_value_int16_array)
+	NSEV_FLAT_ARRAY(DATA_TYPE_UINT16_ARRAY, uint16_t,
+	    nvpair_value_uint16_array)
+	NSEV_FLAT_ARRAY(DATA_TYPE_INT32_ARRAY, int32_t,
+	    nvpair_value_int32_array)
+	NSEV_FLAT_ARRAY(DATA_TYPE_UINT32_ARRAY, uint32_t,
+	    nvpair_value_uint32_array)
+	NSEV_FLAT_ARRAY(DATA_TYPE_INT64_ARRAY, int64_t,
+	    nvpair_value_int64_array)
+	NSEV_FLAT_ARRAY(DATA_TYPE_UINT64_ARRAY, uint64_t,
+	    nvpair_value_uint64_array)
+
+	case DATA_TYPE_STRING:
+		VERIFY0(nvpair_value_string(nvp, &str));
+		len = strlen(str) + 1;
+		if (dst != NULL)
+			bcopy(str, dst, len);
+		*nelemp = 1;
+		return (len);
+
+	case DATA_TYPE_STRING_ARRAY:
+		VERIFY0(nvpair_value_string_array(nvp, &strv, &n));
+		len = 0;
+		for (i = 0; i < n; i++) {
+			slen = strlen(strv[i]) + 1;
+			if (dst != NULL)
+				bcopy(strv[i], dst + len, slen);
+			len += slen;
+		}
+		*nelemp = n;
+		return (len);
+
+	default:
+		/*
+		 * DATA_TYPE_BOOLEAN, which has no value, and any type we do
+		 * not know how to copy.
+		 */
+		*nelemp = 0;
+		return (0);
+	}
+}
+
+#undef	NSEV_FLAT_SCALAR
+#undef	NSEV_FLAT_ARRAY
+
+static size_t
+nsev_flat_put_nvlist(const char *name, nvlist_t *nvl, char *buf, size_t off)
+{
+	size_t voff = nsev_flat_put_begin(buf, off, name, DATA_TYPE_NVLIST);
+	uint32_t count;
+	size_t end;
+
+	end = nsev_flat_put_list(nvl, buf, voff, &count);
+
+	return (nsev_flat_put_end(buf, off, voff, end - voff, count));
+}
+
+static size_t
+nsev_flat_put_pair(nvpair_t *nvp, char *buf, size_t off)
+{
+	data_type_t type = nvpair_type(nvp);
+	const char *name = nvpair_name(nvp);
+	nvlist_t *nvl, **nvla;
+	size_t voff, end;
+	uint32_t nelem;
+	uint_t i, n;
+
+	switch (type) {
+	case DATA_TYPE_NVLIST:
+		VERIFY0(nvpair_value_nvlist(nvp, &nvl));
+		return (nsev_flat_put_nvlist(name, nvl, buf, off));
+
+	case DATA_TYPE_NVLIST_ARRAY:
+		VERIFY0(nvpair_value_nvlist_array(nvp, &nvla, &n));
+		voff = nsev_flat_put_begin(buf, off, name, type);
+		end = voff;
+		for (i = 0; i < n; i++) {
+			end = nsev_flat_put_nvlist("", nvla[i], buf, end);
+		}
+		return (nsev_flat_put_end(buf, off, voff, end - voff, n));
+
+	default:
+		voff = nsev_flat_put_begin(buf, off, name, type);
+		end = voff + nsev_flat_put_value(nvp,
+		    buf == NULL ? NULL : buf + voff, &nelem);
+		return (nsev_flat_put_end(buf, off, voff, end - voff, nelem));
+	}
+}
+
+static size_t
+nsev_flat_put_list(nvlist_t *nvl, char *buf, size_t off, uint32_t *countp)
+{
+	nvpair_t *nvp = NULL;
+	uint32_t count = 0;
+
+	while ((nvp = nvlist_next_nvpair(nvl, nvp)) != NULL) {
+		off = nsev_flat_put_pair(nvp, buf, off);
+		count++;
+	}
+
+	*countp = count;
+	return (off);
+}
+
+/*
+ * Return the size of the buffer needed to flatten the nvlist "nvl".
+ */
+size_t
+nsev_flat_size(nvlist_t *nvl)
+{
+	uint32_t count;
+
+	return (nsev_flat_put_list(nvl, NULL, sizeof (nsev_flat_t), &count));
+}
+
+/*
+ * Flatten the nvlist "nvl" into "nf", a buffer of "sz" bytes, as measured by
+ * "nsev_flat_size()".  The buffer must be 8-byte aligned.
+ */
+void
+nsev_flat_fill(nvlist_t *nvl, nsev_flat_t *nf, size_t sz)
+{
+	uint32_t count;
+
+	VERIFY3U(sz, <=, UINT32_MAX);
+	VERIFY3U(nsev_flat_put_list(nvl, (char *)nf, sizeof (nsev_flat_t),
+	    &count), ==, sz);
+	nf->nf_size = (uint32_t)sz;
+	nf->nf_count = count;
+}
+
+/*
+ * Iterate over the top-level records of "nf".
+ */
+void
+nsev_flat_iter_init(nsev_flat_iter_t *nfi, const nsev_flat_t *nf)
+{
+	nfi->nfi_next = (const char *)(nf + 1);
+	nfi->nfi_left = nf->nf_count;
+}
+
+/*
+ * Iterate over the members of the nvlist record "rec", or over the elements
+ * (each an nvlist record) of the nvlist array record "rec".
+ */
+void
+nsev_flat_iter_child(nsev_flat_iter_t *nfi, const nsev_flat_rec_t *rec)
+{
+	nfi->nfi_next = nsev_flat_value(rec);
+
+	switch (rec->nfr_type) {
+	case DATA_TYPE_NVLIST:
+	case DATA_TYPE_NVLIST_ARRAY:
+		nfi->nfi_left = rec->nfr_nelem;
+		break;
+	default:
+		nfi->nfi_left = 0;
+		break;
+	}
+}
+
+const nsev_flat_rec_t *
+nsev_flat_iter_next(nsev_flat_iter_t *nfi)
+{
+	const nsev_flat_rec_t *rec;
+
+	if (nfi->nfi_left == 0) {
+		return (NULL);
+	}
+
+	rec = (const nsev_flat_rec_t *)nfi->nfi_next;
+	nfi->nfi_next += rec->nfr_size;
+	nfi->nfi_left--;
+
+	return (rec);
+}
+
+/*
+ * Find the top-level record named "name", or return NULL.
+ */
+const nsev_flat_rec_t *
+nsev_flat_lookup(const nsev_flat_t *nf, const char *name)
+{
+	const nsev_flat_rec_t *rec;
+	nsev_flat_iter_t nfi;
+
+	nsev_flat_iter_init(&nfi, nf);
+	while ((rec = nsev_flat_iter_next(&nfi)) != NULL) {
+		if (strcmp(nsev_flat_name(rec), name) == 0) {
+			return (rec);
+		}
+	}
+
+	return (NULL);
+}
+
+data_type_t
+nsev_flat_type(const nsev_flat_rec_t *rec)
+{
+	return ((data_type_t)rec->nfr_type);
+}
+
+const char *
+nsev_flat_name(const nsev_flat_rec_t *rec)
+{
+	return ((const char *)(rec + 1));
+}
+
+const void *
+nsev_flat_value(const nsev_flat_rec_t *rec)
+{
+	return ((const char *)(rec + 1) + NSEV_FLAT_ALIGN(rec->nfr_namelen));
+}
+
+uint_t
+nsev_flat_nelem(const nsev_flat_rec_t *rec)
+{
+	return (rec->nfr_nelem);
+}
+
+/*
+ * Extract the value of any integer-typed record as an int64_t.  Returns -1 if
+ * the record is not an integer, or is an unsigned value that does not fit.
+ */
+int
+nsev_flat_int64(const nsev_flat_rec_t *rec, int64_t *vp)
+{
+	const void *v = nsev_flat_value(rec);
+
+	switch (rec->nfr_type) {
+	case DATA_TYPE_BYTE:
+		*vp = *(const uchar_t *)v;
+		return (0);
+	case DATA_TYPE_INT8:
+		*vp = *(const int8_t *)v;
+		return (0);
+	case DATA_TYPE_UINT8:
+		*vp = *(const uint8_t *)v;
+		return (0);
+	case DATA_TYPE_INT16:
+		*vp = *(const int16_t *)v;
+		return (0);
+	case DATA_TYPE_UINT16:
+		*vp = *(const uint16_t *)v;
+		return (0);
+	case DATA_TYPE_INT32:
+		*vp = *(const int32_t *)v;
+		return (0);
+	case DATA_TYPE_UINT32:
+		*vp = *(const uint32_t *)v;
+		return (0);
+	case DATA_TYPE_INT64:
+		*vp = *(const int64_t *)v;
+		return (0);
+	case DATA_TYPE_UINT64:
+		if (*(const uint64_t *)v > INT64_MAX) {
+			return (-1);
+		}
+		*vp = (int64_t)*(const uint64_t *)v;
+		return (0);
+	case DATA_TYPE_HRTIME:
+		*vp = *(const hrtime_t *)v;
+		return (0);
+	default:
+		return (-1);
+	}
+}
+
+/*
+ * The size of one element of a record of type "type" (or of its array
+ * counterpart), or 0 if values of the type have no fixed size.
+ */
+static size_t
+nsev_flat_elemsize(data_type_t type)
+{
+	switch (type) {
+	case DATA_TYPE_BYTE:
+	case DATA_TYPE_INT8:
+	case DATA_TYPE_UINT8:
+	case DATA_TYPE_BYTE_ARRAY:
+	case DATA_TYPE_INT8_ARRAY:
+	case DATA_TYPE_UINT8_ARRAY:
+		return (1);
+	case DATA_TYPE_INT16:
+	case DATA_TYPE_UINT16:
+	case DATA_TYPE_INT16_ARRAY:
+	case DATA_TYPE_UINT16_ARRAY:
+		return (2);
+	case DATA_TYPE_BOOLEAN_VALUE:
+	case DATA_TYPE_INT32:
+	case DATA_TYPE_UINT32:
+	case DATA_TYPE_BOOLEAN_ARRAY:
+	case DATA_TYPE_INT32_ARRAY:
+	case DATA_TYPE_UINT32_ARRAY:
+		return (4);
+	case DATA_TYPE_INT64:
+	case DATA_TYPE_UINT64:
+	case DATA_TYPE_HRTIME:
+	case DATA_TYPE_DOUBLE:
+	case DATA_TYPE_INT64_ARRAY:
+	case DATA_TYPE_UINT64_ARRAY:
+		return (8);
+	default:
+		return (0);
+	}
+}
+
+static int
+nsev_flat_is_array(data_type_t type)
+{
+	switch (type) {
+	case DATA_TYPE_BOOLEAN_ARRAY:
+	case DATA_TYPE_BYTE_ARRAY:
+	case DATA_TYPE_INT8_ARRAY:
+	case DATA_TYPE_UINT8_ARRAY:
+	case DATA_TYPE_INT16_ARRAY:
+	case DATA_TYPE_UINT16_ARRAY:
+	case DATA_TYPE_INT32_ARRAY:
+	case DATA_TYPE_UINT32_ARRAY:
+	case DATA_TYPE_INT64_ARRAY:
+	case DATA_TYPE_UINT64_ARRAY:
+		return (1);
+	default:
+		return (0);
+	}
+}
+
+static int nsev_flat_check_recs(const char *, size_t, uint32_t, int, uint_t);
+
+/*
+ * Check the value of the record "rec", which is nested in "depth" nvlists.
+ */
+static int
+nsev_flat_check_value(const nsev_flat_rec_t *rec, uint_t depth)
+{
+	const char *v = nsev_flat_value(rec);
+	size_t esz = nsev_flat_elemsize(rec->nfr_type);
+	uint32_t i, off;
+
+	switch (rec->nfr_type) {
+	case DATA_TYPE_STRING:
+		return (rec->nfr_vlen > 0 && v[rec->nfr_vlen - 1] == '\0' ?
+		    0 : -1);
+
+	case DATA_TYPE_STRING_ARRAY:
+		for (i = 0, off = 0; i < rec->nfr_nelem; i++, off++) {
+			while (off < rec->nfr_vlen && v[off] != '\0') {
+				off++;
+			}
+			if (off >= rec->nfr_vlen) {
+				return (-1);
+			}
+		}
+		return (0);
+
+	case DATA_TYPE_NVLIST:
+		return (nsev_flat_check_recs(v, rec->nfr_vlen, rec->nfr_nelem,
+		    0, depth + 1));
+
+	case DATA_TYPE_NVLIST_ARRAY:
+		/*
+		 * The elements are nvlist records, each a level deeper.
+		 */
+		return (nsev_flat_check_recs(v, rec->nfr_vlen, rec->nfr_nelem,
+		    1, depth));
+
+	default:
+		if (esz == 0) {
+			return (0);
+		}
+		if (nsev_flat_is_array(rec->nfr_type)) {
+			return (rec->nfr_vlen ==
+			    (uint64_t)rec->nfr_nelem * esz ? 0 : -1);
+		}
+		return (rec->nfr_vlen == esz ? 0 : -1);
+	}
+}
+
+/*
+ * Check that the "len" bytes at "p" hold "count" well-formed records (each an
+ * nvlist record, if "nvlists" is set), nested in "depth" nvlists.
+ */
+static int
+nsev_flat_check_recs(const char *p, size_t len, uint32_t count, int nvlists,
+    uint_t depth)
+{
+	const nsev_flat_rec_t *rec;
+	const char *name;
+	uint32_t i;
+
+	if (depth > NSEV_FLAT_MAXDEPTH) {
+		return (-1);
+	}
+
+	for (i = 0; i < count; i++) {
+		if (len < sizeof (*rec)) {
+			return (-1);
+		}
+		rec = (const nsev_flat_rec_t *)p;
+		name = (const char *)(rec + 1);
+
+		if (rec->nfr_size > len || rec->nfr_namelen == 0 ||
+		    rec->nfr_size != sizeof (*rec) +
+		    NSEV_FLAT_ALIGN((size_t)rec->nfr_namelen) +
+		    NSEV_FLAT_ALIGN((size_t)rec->nfr_vlen) ||
+		    name[rec->nfr_namelen - 1] != '\0' ||
+		    (nvlists && rec->nfr_type != DATA_TYPE_NVLIST) ||
+		    nsev_flat_check_value(rec, depth) != 0) {
+			return (-1);
+		}
+
+		p += rec->nfr_size;
+		len -= rec->nfr_size;
+	}
+
+	return (0);
+}
+
+/*
+ * The offset of the attribute list in a packed event whose header names are
+ * "names" (class, subclass, vendor and publisher).
+ */
+static size_t
+nsev_packed_names_end(const char *const *names)
+{
+	size_t off = sizeof (nsev_packed_t);
+	uint_t i;
+
+	for (i = 0; i < 4; i++) {
+		off += strlen(names[i]) + 1;
+	}
+
+	return (NSEV_PACKED_ALIGN(off));
+}
+
+/*
+ * Return the size of the buffer needed for a packed event with the header
+ * names "names" (class, subclass, vendor and publisher) and the attribute
+ * list "nvl", which may be NULL.
+ */
+size_t
+nsev_packed_size(const char *const *names, nvlist_t *nvl)
+{
+	size_t off = nsev_packed_names_end(names);
+
+	return (nvl != NULL ? off + nsev_flat_size(nvl) : off);
+}
+
+/*
+ * Build a packed event in "npk", a buffer of "sz" bytes, as measured by
+ * "nsev_packed_size()".  The buffer must be 8-byte aligned.
+ */
+void
+nsev_packed_fill(nsev_packed_t *npk, size_t sz, const char *const *names,
+    int32_t pid, uint16_t flags, nvlist_t *nvl)
+{
+	size_t len, off, pos;
+	uint_t i;
+
+	VERIFY3U(sz, <=, UINT32_MAX);
+	off = nsev_packed_names_end(names);
+
+	npk->npk_magic = NSEV_PACKED_MAGIC;
+	npk->npk_version = NSEV_PACKED_VERSION;
+	npk->npk_flags = flags;
+	npk->npk_size = (uint32_t)sz;
+	npk->npk_pid = pid;
+	npk->npk_attrs = nvl != NULL ? (uint32_t)off : 0;
+	npk->npk_reserved = 0;
+
+	pos = sizeof (nsev_packed_t);
+	for (i = 0; i < 4; i++) {
+		len = strlen(names[i]) + 1;
+		bcopy(names[i], (char *)npk + pos, len);
+		pos += len;
+	}
+	bzero((char *)npk + pos, off - pos);
+
+	if (nvl != NULL) {
+		nsev_flat_fill(nvl, (nsev_flat_t *)((char *)npk + off),
+		    sz - off);
+	} else {
+		VERIFY3U(sz, ==, off);
+	}
+}
+
+/*
+ * Check that the "len" bytes at "npk" hold a well-formed packed event, as
+ * they must before a packed event from outside this process (e.g., one read
+ * from a journal) may be used.  Nvlists may be nested no more than
+ * NSEV_FLAT_MAXDEPTH deep, which bounds the recursion here and in everything
+ * that walks the event afterwards.
+ */
+int
+nsev_packed_check(const nsev_packed_t *npk, size_t len)
+{
+	const char *p = (const char *)npk;
+	const nsev_flat_t *nf;
+	size_t off, end;
+	uint_t i;
+
+	if (len < sizeof (*npk) || npk->npk_magic != NSEV_PACKED_MAGIC ||
+	    npk->npk_version != NSEV_PACKED_VERSION ||
+	    npk->npk_size < sizeof (*npk) || npk->npk_size > len) {
+		return (-1);
+	}
+
+	/*
+	 * The four names must each be terminated before the attribute list
+	 * (or the end of the buffer, if there is none).
+	 */
+	end = npk->npk_attrs != 0 ? npk->npk_attrs : npk->npk_size;
+	if (end > npk->npk_size) {
+		return (-1);
+	}
+	for (i = 0, off = sizeof (*npk); i < 4; i++, off++) {
+		while (off < end && p[off] != '\0') {
+			off++;
+		}
+		if (off >= end) {
+			return (-1);
+		}
+	}
+
+	if (npk->npk_attrs == 0) {
+		return (0);
+	}
+
+	if (npk->npk_attrs != NSEV_PACKED_ALIGN(npk->npk_attrs) ||
+	    npk->npk_size - npk->npk_attrs < sizeof (nsev_flat_t)) {
+		return (-1);
+	}
+	nf = (const nsev_flat_t *)(p + npk->npk_attrs);
+	if (nf->nf_size < sizeof (*nf) ||
+	    nf->nf_size > npk->npk_size - npk->npk_attrs) {
+		return (-1);
+	}
+
+	return (nsev_flat_check_recs((const char *)(nf + 1),
+	    nf->nf_size - sizeof (*nf), nf->nf_count, 0, 0));
+}
+
+/*
+ * The attribute list of the packed event "npk", or NULL if it has none.
+ */
+const nsev_flat_t *
+nsev_packed_attrs(const nsev_packed_t *npk)
+{
+	if (npk->npk_attrs == 0) {
+		return (NULL);
+	}
+
+	return ((const nsev_flat_t *)((const char *)npk + npk->npk_attrs));
+}
@@ -0,0 +1,128 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2022 Joyent, Inc.
+ */
+
+#ifndef	_FLAT_H
+#define	_FLAT_H
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <libnvpair.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * A flattened attribute list: the contents of an nvlist, copied into one
+ * contiguous buffer as a sequence of type-tagged records.  See "flat.c" for
+ * the layout.
+ */
+typedef struct nsev_flat {
+	uint32_t nf_size;	/* total size of the buffer, in bytes */
+	uint32_t nf_count;	/* number of top-level records */
+} nsev_flat_t;
+
+typedef struct nsev_flat_rec {
+	uint32_t nfr_size;	/* size of the whole record, in bytes */
+	uint16_t nfr_type;	/* data_type_t of the original nvpair */
+	uint16_t nfr_namelen;	/* length of the name, including the NUL */
+	uint32_t nfr_nelem;	/* element (or member) count */
+	uint32_t nfr_vlen;	/* length of the value, in bytes */
+} nsev_flat_rec_t;
+
+/*
+ * The deepest nesting of nvlists accepted in a packed event from outside this
+ * process; see "nsev_packed_check()".  libnvpair will not unpack an nvlist
+ * nested more than 20 deep, so every event received from it fits.
+ */
+#define	NSEV_FLAT_MAXDEPTH	32
+
+/*
+ * A packed event: the event header and its flattened attribute list, in one
+ * buffer.  This is how events are kept in memory while they are delivered,
+ * and it is also the binary format handed to Javascript by streams in
+ * "packed" mode (and decoded by "packed.js").  All values are in the byte
+ * order of the host.  The layout is:
+ *
+ *	nsev_packed_t		24 bytes
+ *	class name		each NUL terminated, one after another; the
+ *	subclass name		four strings together are padded to 8 bytes
+ *	vendor name
+ *	publisher name
+ *	nsev_flat_t		the attribute list, at offset "npk_attrs", if
+ *	records			the event has attributes; see "flat.c"
+ *
+ * Record types are the libnvpair "data_type_t" values.  Booleans are stored
+ * as a 4-byte "boolean_t", and hrtime values as a signed 64-bit integer.
+ * Any change to this layout must change NSEV_PACKED_VERSION.
+ */
+#define	NSEV_PACKED_MAGIC	0x4e534556	/* "NSEV" */
+#define	NSEV_PACKED_VERSION	1
+
+#define	NSEV_PACKED_F_KERNEL	0x1	/* published by the kernel */
+
+#define	NSEV_PACKED_ALIGN(x)	\
+	(((x) + sizeof (uint64_t) - 1) & ~(sizeof (uint64_t) - 1))
+
+typedef struct nsev_packed {
+	uint32_t npk_magic;	/* NSEV_PACKED_MAGIC */
+	uint16_t npk_version;	/* NSEV_PACKED_VERSION */
+	uint16_t npk_flags;	/* NSEV_PACKED_F_* */
+	uint32_t npk_size;	/* total size of the buffer, in bytes */
+	int32_t npk_pid;	/* publisher process ID */
+	uint32_t npk_attrs;	/* offset of the attribute list, or 0 */
+	uint32_t npk_reserved;	/* zero */
+} nsev_packed_t;
+
+typedef struct nsev_flat_iter {
+	const char *nfi_next;
+	uint32_t nfi_left;
+} nsev_flat_iter_t;
+
+size_t nsev_flat_size(nvlist_t *);
+void nsev_flat_fill(nvlist_t *, nsev_flat_t *, size_t);
+
+void nsev_flat_iter_init(nsev_flat_iter_t *, const nsev_flat_t *);
+void nsev_flat_iter_child(nsev_flat_iter_t *, const nsev_flat_rec_t *);
+const nsev_flat_rec_t *nsev_flat_iter_next(nsev_flat_iter_t *);
+const nsev_flat_rec_t *nsev_flat_lookup(const nsev_flat_t *, const char *);
+
+data_type_t nsev_flat_type(const nsev_flat_rec_t *);
+const char *nsev_flat_name(const nsev_flat_rec_t *);
+const void *nsev_flat_value(const nsev_flat_rec_t *);
+uint_t nsev_flat_nelem(const nsev_flat_rec_t *);
+int nsev_flat_int64(const nsev_flat_rec_t *, int64_t *);
+
+size_t nsev_packed_size(const char *const *, nvlist_t *);
+void nsev_packed_fill(nsev_packed_t *, size_t, const char *const *, int32_t,
+    uint16_t, nvlist_t *);
+int nsev_packed_check(const nsev_packed_t *, size_t);
+const nsev_flat_t *nsev_packed_attrs(const nsev_packed_t *);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* !_FLAT_H */
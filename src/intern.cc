@@ -0,0 +1,152 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2022 Joyent, Inc.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <nan.h>
+#include <sys/debug.h>
+
+#include "intern.h"
+
+using v8::Local;
+using v8::String;
+
+/*
+ * Events of a given class tend to carry the same small set of attribute
+ * names, so rather than create a new V8 string for every property key of
+ * every event we keep internalized copies of the names we have seen.  V8 can
+ * use an internalized string as a property key directly, without first
+ * looking it up in its own string table.
+ *
+ * The cache is a fixed-size, set-associative table: a name hashes to one set
+ * of NSI_WAYS entries, and when the set is full the least recently used entry
+ * is evicted.  A publisher that uses many distinct names can therefore only
+ * displace other entries, never grow the cache.  Names longer than
+ * NSI_MAXNAMELEN are never cached.
+ *
+ * The table is only used on the event loop thread of the main isolate.
+ */
+#define	NSI_SETS		256
+#define	NSI_WAYS		4
+#define	NSI_MAXNAMELEN		64
+
+typedef struct node_sysevent_intern_ent {
+	uint32_t nsie_hash;
+	uint64_t nsie_lastuse;
+	char nsie_name[NSI_MAXNAMELEN + 1];
+	Nan::Persistent<String> nsie_str;
+} node_sysevent_intern_ent_t;
+
+static node_sysevent_intern_ent_t g_nsi_table[NSI_SETS][NSI_WAYS];
+static uint64_t g_nsi_clock = 0;
+static node_sysevent_intern_stats_t g_nsi_stats;
+
+/*
+ * FNV-1a.
+ */
+static uint32_t
+node_sysevent_intern_hash(const char *name, size_t *lenp)
+{
+	uint32_t h = 2166136261U;
+	const char *c;
+
+	for (c = name; *c != '\0'; c++) {
+		h ^= (uint8_t)*c;
+		h *= 16777619U;
+	}
+
+	*lenp = (size_t)(c - name);
+	return (h);
+}
+
+static Local<String>
+node_sysevent_intern_new(const char *name)
+{
+#if NODE_MODULE_VERSION >= NODE_4_0_MODULE_VERSION
+	return (String::NewFromUtf8(v8::Isolate::GetCurrent(), name,
+	    v8::NewStringType::kInternalized).ToLocalChecked());
+#else
+	return (Nan::New(name).ToLocalChecked());
+#endif
+}
+
+/*
+ * Return a V8 string for the property name "name", from the cache if
+ * possible.
+ */
+Local<String>
+node_sysevent_intern(const char *name)
+{
+	node_sysevent_intern_ent_t *set, *victim;
+	uint32_t h;
+	size_t len;
+
+	h = node_sysevent_intern_hash(name, &len);
+	if (len > NSI_MAXNAMELEN) {
+		g_nsi_stats.nsis_misses++;
+		return (node_sysevent_intern_new(name));
+	}
+
+	set = g_nsi_table[h % NSI_SETS];
+	victim = &set[0];
+	for (int i = 0; i < NSI_WAYS; i++) {
+		node_sysevent_intern_ent_t *nsie = &set[i];
+
+		if (!nsie->nsie_str.IsEmpty() && nsie->nsie_hash == h &&
+		    strcmp(nsie->nsie_name, name) == 0) {
+			g_nsi_stats.nsis_hits++;
+			nsie->nsie_lastuse = ++g_nsi_clock;
+			return (Nan::New(nsie->nsie_str));
+		}
+
+		if (nsie->nsie_str.IsEmpty() ||
+		    (!victim->nsie_str.IsEmpty() &&
+		    nsie->nsie_lastuse < victim->nsie_lastuse)) {
+			victim = nsie;
+		}
+	}
+
+	g_nsi_stats.nsis_misses++;
+	if (!victim->nsie_str.IsEmpty()) {
+		g_nsi_stats.nsis_evictions++;
+	}
+
+	Local<String> str = node_sysevent_intern_new(name);
+
+	victim->nsie_str.Reset(str);
+	victim->nsie_hash = h;
+	victim->nsie_lastuse = ++g_nsi_clock;
+	bcopy(name, victim->nsie_name, len + 1);
+
+	return (str);
+}
+
+void
+node_sysevent_intern_stats(node_sysevent_intern_stats_t *nsis)
+{
+	*nsis = g_nsi_stats;
+}
@@ -0,0 +1,45 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2022 Joyent, Inc.
+ */
+
+#ifndef	_INTERN_H
+#define	_INTERN_H
+
+#include <nan.h>
+
+/*
+ * A bounded cache of internalized V8 strings for property names; see
+ * "intern.cc".
+ */
+
+typedef struct node_sysevent_intern_stats {
+	uint64_t nsis_hits;
+	uint64_t nsis_misses;
+	uint64_t nsis_evictions;
+} node_sysevent_intern_stats_t;
+
+v8::Local<v8::String> node_sysevent_intern(const char *);
+void node_sysevent_intern_stats(node_sysevent_intern_stats_t *);
+
+#endif	/* !_INTERN_H */
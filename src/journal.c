@@ -0,0 +1,470 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2022 Joyent, Inc.
+ */
+
+/*
+ * The event journal: an optional record, on disk, of every event received
+ * from libsysevent, so that a consumer which restarts can catch up on the
+ * events it missed.  The journal is a fixed-size file, mapped into memory,
+ * used as a ring:
+ *
+ *	+---------------------+  0
+ *	| nsev_journal_hdr_t  |
+ *	+---------------------+  NSEV_JOURNAL_HDRSIZE
+ *	| record area         |
+ *	|   (njh_size bytes)  |
+ *	+---------------------+
+ *
+ * Positions ("njh_head" and "njh_tail") count bytes written since the
+ * journal was created, and never wrap; the offset of a position within the
+ * record area is the position modulo "njh_size".  Each record is an
+ * nsev_journal_rec_t followed by the packed event (see "flat.h"), padded to
+ * 8 bytes, and never straddles the end of the record area: if a record does
+ * not fit before the end, a pad record (or, if there is not even room for a
+ * record header, nothing) fills the gap, and the record goes at the start.
+ * When there is no room for a new record, the oldest records are discarded
+ * by advancing "njh_head".
+ *
+ * Records are appended by the libsysevent delivery threads, under a mutex.
+ * The header is updated only after the record itself has been written, and
+ * the head is moved past discarded records before they are overwritten.  A
+ * record below the tail is therefore complete, and a reader that copies a
+ * record and then finds the head still at or before it knows the copy is
+ * intact; "nsev_journal_reader_next()" does exactly this.  Reading a record
+ * in place, or checking only its header or sequence number, is not enough:
+ * the writer may overwrite it meanwhile, leaving a record whose bytes mix two
+ * events.  The file is never synced on this path: the mapping is shared, so
+ * journaled events survive the process, and the caller schedules
+ * "nsev_journal_sync()" to bound what a system crash may lose.
+ *
+ * A journal also serves as a capture file for replay (see "replay.c"), read
+ * with the "nsev_journal_reader_*()" functions.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <atomic.h>
+#include <sys/debug.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+
+#include "journal.h"
+
+#define	NSEV_JOURNAL_ALIGN(x)	\
+	(((x) + sizeof (uint64_t) - 1) & ~(sizeof (uint64_t) - 1))
+
+struct nsev_journal {
+	pthread_mutex_t nj_mtx;
+	int nj_fd;
+	char *nj_map;
+	size_t nj_maplen;
+	nsev_journal_hdr_t *nj_hdr;
+	char *nj_data;
+	uint64_t nj_size;
+};
+
+/*
+ * Whether the existing header describes a usable journal with a record area
+ * of "size" bytes.
+ */
+static int
+nsev_journal_valid(const nsev_journal_hdr_t *njh, uint64_t size)
+{
+	return (njh->njh_magic == NSEV_JOURNAL_MAGIC &&
+	    njh->njh_version == NSEV_JOURNAL_VERSION &&
+	    njh->njh_size == size &&
+	    njh->njh_head <= njh->njh_tail &&
+	    njh->njh_tail - njh->njh_head <= size &&
+	    njh->njh_first <= njh->njh_next);
+}
+
+/*
+ * Open the journal at "path", creating it if it does not exist, with a record
+ * area of "size" bytes.  An existing journal is appended to, continuing its
+ * sequence numbers, unless it is damaged or of a different size, in which
+ * case it is started afresh.
+ */
+int
+nsev_journal_open(const char *path, uint64_t size, nsev_journal_t **njp)
+{
+	nsev_journal_t *nj;
+	struct stat st;
+	int e;
+
+	size = NSEV_JOURNAL_ALIGN(size);
+	if (size < NSEV_JOURNAL_MINSIZE || size > UINT32_MAX) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	if ((nj = calloc(1, sizeof (*nj))) == NULL) {
+		return (-1);
+	}
+	nj->nj_fd = -1;
+	nj->nj_size = size;
+	nj->nj_maplen = NSEV_JOURNAL_HDRSIZE + size;
+
+	if ((nj->nj_fd = open(path, O_RDWR | O_CREAT, 0644)) < 0) {
+		goto fail;
+	}
+	if (fstat(nj->nj_fd, &st) != 0) {
+		goto fail;
+	}
+	if ((uint64_t)st.st_size != nj->nj_maplen &&
+	    ftruncate(nj->nj_fd, (off_t)nj->nj_maplen) != 0) {
+		goto fail;
+	}
+
+	if ((nj->nj_map = mmap(NULL, nj->nj_maplen, PROT_READ | PROT_WRITE,
+	    MAP_SHARED, nj->nj_fd, 0)) == MAP_FAILED) {
+		nj->nj_map = NULL;
+		goto fail;
+	}
+	nj->nj_hdr = (nsev_journal_hdr_t *)nj->nj_map;
+	nj->nj_data = nj->nj_map + NSEV_JOURNAL_HDRSIZE;
+
+	if ((uint64_t)st.st_size != nj->nj_maplen ||
+	    !nsev_journal_valid(nj->nj_hdr, size)) {
+		bzero(nj->nj_hdr, sizeof (*nj->nj_hdr));
+		nj->nj_hdr->njh_size = size;
+		nj->nj_hdr->njh_first = 1;
+		nj->nj_hdr->njh_next = 1;
+		nj->nj_hdr->njh_version = NSEV_JOURNAL_VERSION;
+		membar_producer();
+		nj->nj_hdr->njh_magic = NSEV_JOURNAL_MAGIC;
+	}
+
+	VERIFY0(pthread_mutex_init(&nj->nj_mtx, NULL));
+
+	*njp = nj;
+	return (0);
+
+fail:
+	e = errno;
+	if (nj->nj_map != NULL) {
+		VERIFY0(munmap(nj->nj_map, nj->nj_maplen));
+	}
+	if (nj->nj_fd >= 0) {
+		(void) close(nj->nj_fd);
+	}
+	free(nj);
+	errno = e;
+	return (-1);
+}
+
+/*
+ * Sync the journal to disk, and close it.
+ */
+void
+nsev_journal_close(nsev_journal_t *nj)
+{
+	if (nj == NULL) {
+		return;
+	}
+
+	nsev_journal_sync(nj, 1);
+	VERIFY0(munmap(nj->nj_map, nj->nj_maplen));
+	(void) close(nj->nj_fd);
+	VERIFY0(pthread_mutex_destroy(&nj->nj_mtx));
+	free(nj);
+}
+
+/*
+ * Write back modified pages of the journal: if "wait" is set, wait for the
+ * writes to complete; otherwise just schedule them.
+ */
+void
+nsev_journal_sync(nsev_journal_t *nj, int wait)
+{
+	(void) msync(nj->nj_map, nj->nj_maplen, wait ? MS_SYNC : MS_ASYNC);
+}
+
+/*
+ * Discard the oldest record.  Called with the journal lock held.
+ */
+static void
+nsev_journal_evict(nsev_journal_t *nj)
+{
+	nsev_journal_hdr_t *njh = nj->nj_hdr;
+	uint64_t off = njh->njh_head % nj->nj_size;
+	nsev_journal_rec_t *njr;
+
+	if (nj->nj_size - off < sizeof (nsev_journal_rec_t)) {
+		njh->njh_head += nj->nj_size - off;
+		return;
+	}
+
+	njr = (nsev_journal_rec_t *)(nj->nj_data + off);
+	if (njr->njr_magic == NSEV_JOURNAL_REC_MAGIC) {
+		njh->njh_first = njr->njr_seq + 1;
+	}
+	njh->njh_head += njr->njr_size;
+}
+
+/*
+ * Append the packed event "npk" to the journal.  Returns -1, with errno set
+ * to E2BIG, if the event is too large for the journal.  This is called on
+ * the libsysevent delivery threads.
+ */
+int
+nsev_journal_append(nsev_journal_t *nj, const nsev_packed_t *npk)
+{
+	nsev_journal_hdr_t *njh = nj->nj_hdr;
+	size_t need = NSEV_JOURNAL_ALIGN(sizeof (nsev_journal_rec_t) +
+	    npk->npk_size);
+	nsev_journal_rec_t *njr;
+	uint64_t off, pad;
+
+	if (need > nj->nj_size / 2) {
+		errno = E2BIG;
+		return (-1);
+	}
+
+	VERIFY0(pthread_mutex_lock(&nj->nj_mtx));
+
+	off = njh->njh_tail % nj->nj_size;
+	pad = (off + need > nj->nj_size) ? nj->nj_size - off : 0;
+
+	/*
+	 * Make room, and publish the new head, before overwriting anything.
+	 */
+	while (njh->njh_tail + pad + need - njh->njh_head > nj->nj_size) {
+		nsev_journal_evict(nj);
+	}
+	membar_producer();
+
+	if (pad >= sizeof (nsev_journal_rec_t)) {
+		njr = (nsev_journal_rec_t *)(nj->nj_data + off);
+		njr->njr_magic = NSEV_JOURNAL_PAD_MAGIC;
+		njr->njr_size = (uint32_t)pad;
+		njr->njr_seq = 0;
+		njr->njr_time = 0;
+	}
+	off = (off + pad) % nj->nj_size;
+
+	njr = (nsev_journal_rec_t *)(nj->nj_data + off);
+	njr->njr_magic = NSEV_JOURNAL_REC_MAGIC;
+	njr->njr_size = (uint32_t)need;
+	njr->njr_seq = njh->njh_next;
+	njr->njr_time = gethrtime();
+	bcopy(npk, njr + 1, npk->npk_size);
+	bzero((char *)(njr + 1) + npk->npk_size,
+	    need - sizeof (*njr) - npk->npk_size);
+
+	/*
+	 * Publish the record.
+	 */
+	membar_producer();
+	njh->njh_tail += pad + need;
+	njh->njh_next++;
+
+	VERIFY0(pthread_mutex_unlock(&nj->nj_mtx));
+
+	return (0);
+}
+
+struct nsev_journal_reader {
+	int njrd_fd;
+	char *njrd_map;
+	size_t njrd_maplen;
+	volatile const nsev_journal_hdr_t *njrd_hdr;
+	const char *njrd_data;
+	uint64_t njrd_size;
+	uint64_t njrd_pos;
+	uint64_t njrd_tail;
+	uint64_t njrd_seq;
+	nsev_journal_rec_t *njrd_buf;	/* copy of the current record */
+	size_t njrd_buflen;
+};
+
+/*
+ * Open the journal at "path" for reading.  The reader visits the records
+ * that were in the journal when it was opened, oldest first; the journal may
+ * continue to be written (by this or another process) meanwhile.
+ */
+int
+nsev_journal_reader_open(const char *path, nsev_journal_reader_t **njrdp)
+{
+	nsev_journal_reader_t *njrd;
+	const nsev_journal_hdr_t *njh;
+	struct stat st;
+	int e;
+
+	if ((njrd = calloc(1, sizeof (*njrd))) == NULL) {
+		return (-1);
+	}
+
+	if ((njrd->njrd_fd = open(path, O_RDONLY)) < 0) {
+		free(njrd);
+		return (-1);
+	}
+	if (fstat(njrd->njrd_fd, &st) != 0) {
+		goto fail;
+	}
+	if ((uint64_t)st.st_size < NSEV_JOURNAL_HDRSIZE) {
+		errno = EINVAL;
+		goto fail;
+	}
+
+	njrd->njrd_maplen = (size_t)st.st_size;
+	if ((njrd->njrd_map = mmap(NULL, njrd->njrd_maplen, PROT_READ,
+	    MAP_SHARED, njrd->njrd_fd, 0)) == MAP_FAILED) {
+		njrd->njrd_map = NULL;
+		goto fail;
+	}
+
+	njh = (const nsev_journal_hdr_t *)njrd->njrd_map;
+	if (!nsev_journal_valid(njh,
+	    njrd->njrd_maplen - NSEV_JOURNAL_HDRSIZE)) {
+		errno = EINVAL;
+		goto fail;
+	}
+
+	njrd->njrd_hdr = njh;
+	njrd->njrd_data = njrd->njrd_map + NSEV_JOURNAL_HDRSIZE;
+	njrd->njrd_size = njh->njh_size;
+	njrd->njrd_tail = njh->njh_tail;
+	membar_consumer();
+	njrd->njrd_pos = njh->njh_head;
+	njrd->njrd_seq = njh->njh_first;
+
+	*njrdp = njrd;
+	return (0);
+
+fail:
+	e = errno;
+	if (njrd->njrd_map != NULL) {
+		VERIFY0(munmap(njrd->njrd_map, njrd->njrd_maplen));
+	}
+	(void) close(njrd->njrd_fd);
+	free(njrd);
+	errno = e;
+	return (-1);
+}
+
+/*
+ * Whether the record area at position "pos" may have been overwritten since
+ * the reader copied from it: the writer moves the head past records before
+ * it overwrites them.
+ */
+static int
+nsev_journal_reader_stale(nsev_journal_reader_t *njrd, uint64_t pos)
+{
+	membar_consumer();
+	return (pos < njrd->njrd_hdr->njh_head);
+}
+
+/*
+ * Return a copy of the next event record, or NULL: with errno 0 once every
+ * record has been visited; ESTALE if a writer has overtaken the reader, and
+ * overwritten records it had yet to read; EINVAL if the journal is
+ * inconsistent; or ENOMEM.  The record is copied out of the journal, and the
+ * head checked again afterwards, so a record that is returned was not
+ * overwritten while it was copied, and cannot change once it has been.  It
+ * is valid until the next call; the packed event it holds must still be
+ * checked before it is used.
+ */
+const nsev_journal_rec_t *
+nsev_journal_reader_next(nsev_journal_reader_t *njrd)
+{
+	const nsev_journal_rec_t *njr;
+	uint64_t off, pos;
+	uint32_t size;
+	void *buf;
+
+	while (njrd->njrd_pos < njrd->njrd_tail) {
+		pos = njrd->njrd_pos;
+		off = pos % njrd->njrd_size;
+
+		if (njrd->njrd_size - off < sizeof (*njr)) {
+			njrd->njrd_pos += njrd->njrd_size - off;
+			continue;
+		}
+
+		njr = (const nsev_journal_rec_t *)(njrd->njrd_data + off);
+		size = njr->njr_size;
+		if (size < sizeof (*njr) || size > njrd->njrd_size - off ||
+		    (njr->njr_magic != NSEV_JOURNAL_REC_MAGIC &&
+		    njr->njr_magic != NSEV_JOURNAL_PAD_MAGIC)) {
+			errno = nsev_journal_reader_stale(njrd, pos) ?
+			    ESTALE : EINVAL;
+			return (NULL);
+		}
+
+		if (size > njrd->njrd_buflen) {
+			if ((buf = realloc(njrd->njrd_buf, size)) == NULL) {
+				errno = ENOMEM;
+				return (NULL);
+			}
+			njrd->njrd_buf = buf;
+			njrd->njrd_buflen = size;
+		}
+		bcopy(njr, njrd->njrd_buf, size);
+		if (nsev_journal_reader_stale(njrd, pos)) {
+			errno = ESTALE;
+			return (NULL);
+		}
+		njr = njrd->njrd_buf;
+		if (njr->njr_size != size) {
+			errno = EINVAL;
+			return (NULL);
+		}
+		njrd->njrd_pos += size;
+
+		if (njr->njr_magic == NSEV_JOURNAL_PAD_MAGIC) {
+			continue;
+		}
+
+		if (njr->njr_seq != njrd->njrd_seq) {
+			errno = EINVAL;
+			return (NULL);
+		}
+		njrd->njrd_seq++;
+
+		return (njr);
+	}
+
+	errno = 0;
+	return (NULL);
+}
+
+void
+nsev_journal_reader_close(nsev_journal_reader_t *njrd)
+{
+	if (njrd == NULL) {
+		return;
+	}
+
+	VERIFY0(munmap(njrd->njrd_map, njrd->njrd_maplen));
+	(void) close(njrd->njrd_fd);
+	free(njrd->njrd_buf);
+	free(njrd);
+}
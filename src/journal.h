@@ -0,0 +1,86 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2022 Joyent, Inc.
+ */
+
+#ifndef	_JOURNAL_H
+#define	_JOURNAL_H
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#include "flat.h"
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * An on-disk journal of packed events, kept in a fixed-size ring file; see
+ * "journal.c" for the layout, which "journal.js" also reads.  All values are
+ * in the byte order of the host.
+ */
+#define	NSEV_JOURNAL_MAGIC	0x4e534a4c	/* "NSJL" */
+#define	NSEV_JOURNAL_VERSION	1
+
+#define	NSEV_JOURNAL_REC_MAGIC	0x4e53524b	/* "NSRK": an event */
+#define	NSEV_JOURNAL_PAD_MAGIC	0x4e535044	/* "NSPD": skip to the start */
+
+#define	NSEV_JOURNAL_HDRSIZE	4096
+#define	NSEV_JOURNAL_MINSIZE	(64 * 1024)
+#define	NSEV_JOURNAL_DEFAULT_SIZE	(16 * 1024 * 1024)
+
+typedef struct nsev_journal_hdr {
+	uint32_t njh_magic;	/* NSEV_JOURNAL_MAGIC */
+	uint32_t njh_version;	/* NSEV_JOURNAL_VERSION */
+	uint64_t njh_size;	/* size of the record area, in bytes */
+	uint64_t njh_head;	/* position of the oldest record */
+	uint64_t njh_tail;	/* position at which the next record goes */
+	uint64_t njh_first;	/* sequence number of the oldest record */
+	uint64_t njh_next;	/* sequence number of the next record */
+} nsev_journal_hdr_t;
+
+typedef struct nsev_journal_rec {
+	uint32_t njr_magic;	/* NSEV_JOURNAL_REC_MAGIC or _PAD_MAGIC */
+	uint32_t njr_size;	/* size of the record, including this header */
+	uint64_t njr_seq;	/* sequence number */
+	int64_t njr_time;	/* gethrtime() when the event was journaled */
+} nsev_journal_rec_t;
+
+typedef struct nsev_journal nsev_journal_t;
+typedef struct nsev_journal_reader nsev_journal_reader_t;
+
+int nsev_journal_open(const char *, uint64_t, nsev_journal_t **);
+void nsev_journal_close(nsev_journal_t *);
+int nsev_journal_append(nsev_journal_t *, const nsev_packed_t *);
+void nsev_journal_sync(nsev_journal_t *, int);
+
+int nsev_journal_reader_open(const char *, nsev_journal_reader_t **);
+const nsev_journal_rec_t *nsev_journal_reader_next(nsev_journal_reader_t *);
+void nsev_journal_reader_close(nsev_journal_reader_t *);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* !_JOURNAL_H */
@@ -24,21 +24,27 @@
  */
 
 #include <stdio.h>
+#include <string.h>
+#include <errno.h>
 #include <unistd.h>
 
 #include <nan.h>
 #include <sys/debug.h>
-#include <thread.h>
-#include <synch.h>
 #include <libnvpair.h>
 
 #include "more.h"
 #include "crossthread.h"
+#include "convert.h"
+#include "intern.h"
+#include "journal.h"
+#include "replay.h"
+#include "source.h"
 
 using v8::Local;
 using v8::Object;
 using v8::Handle;
 using v8::Value;
+using v8::Array;
 using v8::External;
 using v8::FunctionTemplate;
 using v8::Function;
@@ -59,6 +65,26 @@ typedef struct node_sysevent_cpp {
 	 */
 	Nan::Global<Object> *nsec_obj;
 
+	/*
+	 * Events converted since the last flush, waiting to be passed to the
+	 * callback function as a single array:
+	 */
+	Nan::Global<Array> *nsec_batch;
+	uint32_t nsec_batch_len;
+
+	/*
+	 * 1 if attribute lists are delivered as "SyseventAttributes" objects
+	 * rather than converted up front:
+	 */
+	int nsec_lazy;
+	int nsec_coalesce;
+
+	/*
+	 * 1 if events are delivered as packed Buffers; see "flat.h":
+	 */
+	int nsec_packed;
+	nsev_stats_t nsec_stats;
+
 	/*
 	 * A handle to the C routines in "more.c":
 	 */
@@ -97,71 +123,723 @@ get_internal_pointer(Local<Object> self, int idx)
 }
 
 /*
- * Attach contents of an nvlist_t "nvl" to the JS object "obj":
+ * In "lazy" mode, the attribute list of each event is delivered as a
+ * "SyseventAttributes" object rather than being converted up front.  The
+ * object holds the packed form of the underlying event (but not the event
+ * itself, whose pool slot is freed as soon as delivery is done), and converts
+ * individual attributes only when asked for them through its methods.  This
+ * struct tracks the C++ state of each such object:
+ */
+typedef struct node_sysevent_attrs {
+	/*
+	 * The packed event whose attribute list we expose.  We hold it until
+	 * the Javascript object is collected, and report its size to V8 as
+	 * external memory so that garbage collection keeps pace with it.
+	 */
+	const nsev_packed_t *nsea_packed;
+
+	/*
+	 * A weak reference to the Javascript object, through which we learn
+	 * that it has been collected:
+	 */
+	Nan::Global<Object> *nsea_obj;
+
+} node_sysevent_attrs_t;
+
+static Nan::Persistent<Function> g_node_sysevent_attrs_ctor;
+
+/*
+ * The finaliser for "SyseventAttributes" objects; releases our hold on the
+ * packed event.
+ */
+static void
+node_sysevent_attrs_dtor(
+    const Nan::WeakCallbackInfo<node_sysevent_attrs_t> &data)
+{
+	node_sysevent_attrs_t *nsea = data.GetParameter();
+
+	Nan::AdjustExternalMemory(-(int)nsea->nsea_packed->npk_size);
+	nsev_packed_rele(nsea->nsea_packed);
+
+	delete nsea->nsea_obj;
+	free(nsea);
+}
+
+/*
+ * Create a "SyseventAttributes" object for the event "nev".
  */
-int
-node_sysevent_nvlist_to_object(nvlist_t *nvl, Local<Object> obj)
+static Local<Object>
+node_sysevent_attrs_create(nsev_event_t *nev)
 {
-	nvpair_t *nvp = NULL;
+	Nan::EscapableHandleScope scope;
+	node_sysevent_attrs_t *nsea;
+	Local<Object> obj = Nan::NewInstance(
+	    Nan::New(g_node_sysevent_attrs_ctor)).ToLocalChecked();
 
-	while ((nvp = nvlist_next_nvpair(nvl, nvp)) != NULL) {
-		switch (nvpair_type(nvp)) {
-		case DATA_TYPE_STRING: {
-			char *val;
+	VERIFY((nsea = (node_sysevent_attrs_t *)calloc(1,
+	    sizeof (*nsea))) != NULL);
+	set_internal_pointer(obj, 0, (void *)nsea);
 
-			VERIFY0(nvpair_value_string(nvp, &val));
+	nsea->nsea_packed = nsev_event_packed_hold(nev);
+	Nan::AdjustExternalMemory((int)nsea->nsea_packed->npk_size);
 
-			Nan::Set(obj,
-			    Nan::New(nvpair_name(nvp)).ToLocalChecked(),
-			    Nan::New(val).ToLocalChecked());
-			break;
-	       }
+	nsea->nsea_obj = new Nan::Global<Object>(obj);
+	nsea->nsea_obj->SetWeak(nsea, node_sysevent_attrs_dtor,
+	    Nan::WeakCallbackType::kParameter);
+
+	return (scope.Escape(obj));
+}
+
+/*
+ * Find the attribute list behind a "SyseventAttributes" object.  Throws and
+ * returns -1 if the object was not created by "node_sysevent_attrs_create()".
+ * On success, "*nfp" is NULL if the event had no attributes.
+ */
+static int
+node_sysevent_attrs_flat(Local<Object> self, const nsev_flat_t **nfp)
+{
+	node_sysevent_attrs_t *nsea;
+
+	if (!self->GetInternalField(0)->IsExternal()) {
+		Nan::ThrowError("not a sysevent attribute list");
+		return (-1);
+	}
+	nsea = (node_sysevent_attrs_t *)get_internal_pointer(self, 0);
+
+	*nfp = nsev_packed_attrs(nsea->nsea_packed);
+	return (0);
+}
+
+/*
+ * The ".get(name)" method: returns the value of the named attribute, or
+ * undefined if there is no such attribute.
+ */
+static
+NAN_METHOD(node_sysevent_attrs_get)
+{
+	const nsev_flat_rec_t *rec;
+	const nsev_flat_t *nf;
+	Local<Value> val;
+
+	if (info.Length() != 1 || !info[0]->IsString()) {
+		Nan::ThrowTypeError("attribute name must be a string");
+		return;
+	}
+
+	if (node_sysevent_attrs_flat(info.This(), &nf) != 0) {
+		return;
+	}
+
+	Nan::Utf8String name(info[0]);
+	if (nf != NULL && (rec = nsev_flat_lookup(nf, *name)) != NULL &&
+	    node_sysevent_flat_to_value(rec, &val) == 0) {
+		info.GetReturnValue().Set(val);
+	}
+}
+
+/*
+ * The ".has(name)" method.
+ */
+static
+NAN_METHOD(node_sysevent_attrs_has)
+{
+	const nsev_flat_t *nf;
+
+	if (info.Length() != 1 || !info[0]->IsString()) {
+		Nan::ThrowTypeError("attribute name must be a string");
+		return;
+	}
+
+	if (node_sysevent_attrs_flat(info.This(), &nf) != 0) {
+		return;
+	}
+
+	Nan::Utf8String name(info[0]);
+	info.GetReturnValue().Set(nf != NULL &&
+	    nsev_flat_lookup(nf, *name) != NULL);
+}
+
+/*
+ * The ".keys()" method: returns an array of attribute names.
+ */
+static
+NAN_METHOD(node_sysevent_attrs_keys)
+{
+	Local<Array> keys = Nan::New<Array>();
+	const nsev_flat_rec_t *rec;
+	const nsev_flat_t *nf;
+	nsev_flat_iter_t nfi;
+	uint32_t i = 0;
+
+	if (node_sysevent_attrs_flat(info.This(), &nf) != 0) {
+		return;
+	}
+
+	if (nf != NULL) {
+		nsev_flat_iter_init(&nfi, nf);
+		while ((rec = nsev_flat_iter_next(&nfi)) != NULL) {
+			Nan::Set(keys, i++,
+			    node_sysevent_intern(nsev_flat_name(rec)));
+		}
+	}
+
+	info.GetReturnValue().Set(keys);
+}
+
+/*
+ * The ".toObject()" method: converts every attribute, producing the object
+ * that would have been delivered had "lazy" mode not been used.
+ */
+static
+NAN_METHOD(node_sysevent_attrs_to_object)
+{
+	Local<Object> obj = Nan::New<Object>();
+	const nsev_flat_t *nf;
+
+	if (node_sysevent_attrs_flat(info.This(), &nf) != 0) {
+		return;
+	}
+
+	if (nf != NULL) {
+		VERIFY0(node_sysevent_flat_to_object(nf, obj));
+	}
 
-		case DATA_TYPE_INT32: {
-			int32_t val;
+	info.GetReturnValue().Set(obj);
+}
 
-			VERIFY0(nvpair_value_int32(nvp, &val));
+/*
+ * Add the array of strings "val" to "nvl" as a string array named "name".
+ * Returns -1 if "val" is not an array of strings.
+ */
+static int
+node_sysevent_add_string_array(nvlist_t *nvl, const char *name,
+    Local<Value> val)
+{
+	Local<Array> arr;
+	char **strv;
+	uint32_t n;
+	int ret = 0;
 
-			Nan::Set(obj,
-			    Nan::New(nvpair_name(nvp)).ToLocalChecked(),
-			    Nan::New(val));
+	if (!val->IsArray()) {
+		return (-1);
+	}
+	arr = val.As<Array>();
+	n = arr->Length();
+
+	if ((strv = (char **)calloc(n + 1, sizeof (char *))) == NULL) {
+		return (-1);
+	}
+
+	for (uint32_t i = 0; i < n; i++) {
+		Local<Value> v = Nan::Get(arr, i).ToLocalChecked();
+
+		if (!v->IsString()) {
+			ret = -1;
 			break;
 		}
 
-		default:
-			fprintf(stderr, "unknown type: %d\n", nvpair_type(nvp));
+		Nan::Utf8String str(v);
+		if ((strv[i] = strdup(*str)) == NULL) {
+			ret = -1;
 			break;
 		}
 	}
 
+	if (ret == 0 && nvlist_add_string_array(nvl, name, strv, n) != 0) {
+		ret = -1;
+	}
+
+	for (uint32_t i = 0; i < n; i++) {
+		free(strv[i]);
+	}
+	free(strv);
+
+	return (ret);
+}
+
+static int
+node_sysevent_empty_array(Local<Value> val)
+{
+	return (val->IsArray() && val.As<Array>()->Length() == 0);
+}
+
+/*
+ * Convert the "classes" option, a map from class name to either "true" (to
+ * select every subclass) or an array of subclass names, into an nvlist of
+ * string arrays.  Returns -1 if the option is malformed.
+ */
+static int
+node_sysevent_classes_to_nvlist(Local<Value> val, nvlist_t *nvl)
+{
+	Local<Object> obj;
+	Local<Array> names;
+
+	if (!val->IsObject() || val->IsArray()) {
+		return (-1);
+	}
+	obj = val.As<Object>();
+	names = Nan::GetOwnPropertyNames(obj).ToLocalChecked();
+
+	for (uint32_t i = 0; i < names->Length(); i++) {
+		Local<Value> name = Nan::Get(names, i).ToLocalChecked();
+		Local<Value> subs = Nan::Get(obj, name).ToLocalChecked();
+		Nan::Utf8String class_name(name);
+
+		if (subs->IsTrue()) {
+			subs = Nan::New<Array>();
+		}
+
+		if (node_sysevent_add_string_array(nvl, *class_name,
+		    subs) != 0) {
+			return (-1);
+		}
+	}
+
+	return (0);
+}
+
+/*
+ * Convert the "attributes" option, a map from attribute name to the value the
+ * attribute must have, into an nvlist.  Strings, booleans and integers are
+ * matched for equality; an object of the form "{ prefix: '...' }" matches
+ * strings that begin with the prefix.  Returns -1 if the option is malformed.
+ */
+static int
+node_sysevent_attributes_to_nvlist(Local<Value> val, nvlist_t *nvl)
+{
+	Local<Object> obj;
+	Local<Array> names;
+
+	if (!val->IsObject() || val->IsArray()) {
+		return (-1);
+	}
+	obj = val.As<Object>();
+	names = Nan::GetOwnPropertyNames(obj).ToLocalChecked();
+
+	for (uint32_t i = 0; i < names->Length(); i++) {
+		Local<Value> name = Nan::Get(names, i).ToLocalChecked();
+		Local<Value> v = Nan::Get(obj, name).ToLocalChecked();
+		Nan::Utf8String attr_name(name);
+		int ret;
+
+		if (v->IsString()) {
+			Nan::Utf8String str(v);
+
+			ret = nvlist_add_string(nvl, *attr_name, *str);
+
+		} else if (v->IsBoolean()) {
+			ret = nvlist_add_boolean_value(nvl, *attr_name,
+			    Nan::To<bool>(v).FromJust() ? B_TRUE : B_FALSE);
+
+		} else if (v->IsNumber()) {
+			double d = Nan::To<double>(v).FromJust();
+
+			/*
+			 * Only safe integers can be represented exactly.
+			 */
+			if (d < -9007199254740991.0 || d > 9007199254740991.0 ||
+			    d != (double)(int64_t)d) {
+				return (-1);
+			}
+			ret = nvlist_add_int64(nvl, *attr_name, (int64_t)d);
+
+		} else if (v->IsObject() && !v->IsArray()) {
+			Local<Value> key = Nan::New("prefix").ToLocalChecked();
+			Local<Value> pfx = Nan::Get(v.As<Object>(),
+			    key).ToLocalChecked();
+			nvlist_t *rule;
+
+			if (!pfx->IsString()) {
+				return (-1);
+			}
+
+			Nan::Utf8String str(pfx);
+			VERIFY0(nvlist_alloc(&rule, NV_UNIQUE_NAME, 0));
+			if ((ret = nvlist_add_string(rule, "prefix",
+			    *str)) == 0) {
+				ret = nvlist_add_nvlist(nvl, *attr_name, rule);
+			}
+			nvlist_free(rule);
+
+		} else {
+			return (-1);
+		}
+
+		if (ret != 0) {
+			return (-1);
+		}
+	}
+
+	return (0);
+}
+
+#define	NODE_SYSEVENT_HOLD_MAX	(1024 * 1024)
+
+/*
+ * Look up the property "name" on the options object "opts".
+ */
+static Local<Value>
+node_sysevent_option(Local<Object> opts, const char *name)
+{
+	return (Nan::Get(opts, Nan::New(name).ToLocalChecked())
+	    .ToLocalChecked());
+}
+
+/*
+ * Read the integer option "name", between 0 and "max", into "valp".  Throws
+ * and returns -1 if the option is present but not valid.
+ */
+static int
+node_sysevent_uint_option(Local<Object> opts, const char *name, uint_t max,
+    uint_t *valp)
+{
+	Local<Value> v = node_sysevent_option(opts, name);
+	double d;
+
+	if (v->IsUndefined()) {
+		return (0);
+	}
+
+	if (!v->IsNumber() || (d = Nan::To<double>(v).FromJust()) < 0 ||
+	    d > max || d != (double)(uint_t)d) {
+		char msg[128];
+
+		(void) snprintf(msg, sizeof (msg), "\"%s\" must be an integer "
+		    "between 0 and %u", name, max);
+		Nan::ThrowTypeError(msg);
+		return (-1);
+	}
+
+	*valp = (uint_t)d;
+	return (0);
+}
+
+#define	NODE_SYSEVENT_WINDOW_MAX	(60 * 1000)
+
+/*
+ * Convert the "coalesce" option, "{ attributes: [ ... ], window: ms }", to
+ * the "coalesce" nvlist in "nvl".  Throws and returns -1 if it is not valid.
+ */
+static int
+node_sysevent_coalesce_to_nvlist(nvlist_t *nvl, Local<Value> val)
+{
+	Local<Object> opts;
+	Local<Value> v;
+	nvlist_t *sub;
+	uint_t window = NSEV_COALESCE_WINDOW_DEFAULT;
+
+	if (!val->IsObject() || val->IsArray()) {
+		Nan::ThrowTypeError("\"coalesce\" must be an object");
+		return (-1);
+	}
+	opts = val.As<Object>();
+
+	if (node_sysevent_uint_option(opts, "window",
+	    NODE_SYSEVENT_WINDOW_MAX, &window) != 0) {
+		return (-1);
+	}
+	if (window == 0) {
+		Nan::ThrowTypeError("\"window\" must be at least 1");
+		return (-1);
+	}
+
+	VERIFY0(nvlist_alloc(&sub, NV_UNIQUE_NAME, 0));
+	VERIFY0(nvlist_add_uint32(sub, "window", window));
+
+	v = node_sysevent_option(opts, "attributes");
+	if (!v->IsUndefined() &&
+	    node_sysevent_add_string_array(sub, "attributes", v) != 0) {
+		nvlist_free(sub);
+		Nan::ThrowTypeError("\"coalesce.attributes\" must be an "
+		    "array of strings");
+		return (-1);
+	}
+
+	VERIFY0(nvlist_add_nvlist(nvl, "coalesce", sub));
+	nvlist_free(sub);
+	return (0);
+}
+
+/*
+ * Convert the options object passed to the "SyseventImpl" constructor into the
+ * nvlist passed to "nsev_attach()".  Throws and returns -1 if the options are
+ * not valid.
+ */
+static int
+node_sysevent_options_to_nvlist(Local<Value> val, nvlist_t **nvlp)
+{
+	Local<Object> opts;
+	Local<Value> v;
+	nvlist_t *nvl, *sub;
+
+	*nvlp = NULL;
+
+	if (val->IsUndefined() || val->IsNull()) {
+		return (0);
+	}
+
+	if (!val->IsObject()) {
+		Nan::ThrowTypeError("options must be an object");
+		return (-1);
+	}
+	opts = val.As<Object>();
+
+	VERIFY0(nvlist_alloc(&nvl, NV_UNIQUE_NAME, 0));
+
+	v = node_sysevent_option(opts, "classes");
+	if (!v->IsUndefined()) {
+		VERIFY0(nvlist_alloc(&sub, NV_UNIQUE_NAME, 0));
+		if (node_sysevent_classes_to_nvlist(v, sub) != 0) {
+			nvlist_free(sub);
+			nvlist_free(nvl);
+			Nan::ThrowTypeError("\"classes\" must be an object "
+			    "mapping class names to true or an array of "
+			    "subclass names");
+			return (-1);
+		}
+		VERIFY0(nvlist_add_nvlist(nvl, "classes", sub));
+		nvlist_free(sub);
+	}
+
+	/*
+	 * An empty vendor or publisher list would compile to no constraint
+	 * at all, and so select every event; one that happens to be empty is
+	 * more likely a mistake than a request for everything, so reject it.
+	 */
+	v = node_sysevent_option(opts, "vendors");
+	if (!v->IsUndefined() && (node_sysevent_empty_array(v) ||
+	    node_sysevent_add_string_array(nvl, "vendors", v) != 0)) {
+		nvlist_free(nvl);
+		Nan::ThrowTypeError("\"vendors\" must be a non-empty array of "
+		    "strings");
+		return (-1);
+	}
+
+	v = node_sysevent_option(opts, "publishers");
+	if (!v->IsUndefined() && (node_sysevent_empty_array(v) ||
+	    node_sysevent_add_string_array(nvl, "publishers", v) != 0)) {
+		nvlist_free(nvl);
+		Nan::ThrowTypeError("\"publishers\" must be a non-empty array "
+		    "of strings");
+		return (-1);
+	}
+
+	v = node_sysevent_option(opts, "attributes");
+	if (!v->IsUndefined()) {
+		VERIFY0(nvlist_alloc(&sub, NV_UNIQUE_NAME, 0));
+		if (node_sysevent_attributes_to_nvlist(v, sub) != 0) {
+			nvlist_free(sub);
+			nvlist_free(nvl);
+			Nan::ThrowTypeError("\"attributes\" must be an object "
+			    "mapping attribute names to a string, boolean, "
+			    "integer or { prefix: string }");
+			return (-1);
+		}
+		VERIFY0(nvlist_add_nvlist(nvl, "attributes", sub));
+		nvlist_free(sub);
+	}
+
+	v = node_sysevent_option(opts, "coalesce");
+	if (!v->IsUndefined() &&
+	    node_sysevent_coalesce_to_nvlist(nvl, v) != 0) {
+		nvlist_free(nvl);
+		return (-1);
+	}
+
+	v = node_sysevent_option(opts, "holdLimit");
+	if (!v->IsUndefined()) {
+		uint_t limit;
+
+		if (node_sysevent_uint_option(opts, "holdLimit",
+		    NODE_SYSEVENT_HOLD_MAX, &limit) != 0) {
+			nvlist_free(nvl);
+			return (-1);
+		}
+		VERIFY0(nvlist_add_uint32(nvl, "holdLimit", limit));
+	}
+
+	*nvlp = nvl;
 	return (0);
 }
 
+/*
+ * The Javascript objects built for an event, cached on the event so that
+ * every stream it is delivered to in one pass shares the same (frozen)
+ * objects.  Streams in lazy mode receive different attributes, and so a
+ * different record, to the others, but all streams share the header object.
+ * Streams that coalesce events each receive their own record, as the repeat
+ * count differs between them, but share the header and attributes.  Streams
+ * in packed mode share a single Buffer.
+ */
+typedef struct node_sysevent_records {
+	Nan::Global<Object> nsr_header;
+	Nan::Global<Object> nsr_attrs[2];
+	Nan::Global<Object> nsr_record[2];
+	Nan::Global<Object> nsr_packed;
+} node_sysevent_records_t;
+
+extern "C" void
+node_sysevent_records_fini(void *arg)
+{
+	delete (node_sysevent_records_t *)arg;
+}
+
+/*
+ * Return the record for "nev" in the requested mode, creating it (and the
+ * objects it refers to) if this is the first stream to receive the event in
+ * that mode.
+ */
+static node_sysevent_records_t *
+node_sysevent_records(nsev_event_t *nev)
+{
+	node_sysevent_records_t *nsr;
+
+	if ((nsr = (node_sysevent_records_t *)nsev_event_cache(nev)) == NULL) {
+		nsr = new node_sysevent_records_t;
+		nsev_event_set_cache(nev, nsr, node_sysevent_records_fini);
+	}
+
+	return (nsr);
+}
+
+static Local<Object>
+node_sysevent_record(nsev_event_t *nev, int lazy, int coalesce,
+    uint_t count)
+{
+	node_sysevent_records_t *nsr = node_sysevent_records(nev);
+	Local<Object> obj0, obj1, evt;
+	int m = lazy ? 1 : 0;
+
+	if (!coalesce && !nsr->nsr_record[m].IsEmpty()) {
+		return (Nan::New(nsr->nsr_record[m]));
+	}
+
+	if (nsr->nsr_header.IsEmpty()) {
+		obj0 = node_sysevent_header_to_object(nsev_event_header(nev));
+		node_sysevent_freeze(obj0);
+		nsr->nsr_header.Reset(obj0);
+	} else {
+		obj0 = Nan::New(nsr->nsr_header);
+	}
+
+	if (!nsr->nsr_attrs[m].IsEmpty()) {
+		obj1 = Nan::New(nsr->nsr_attrs[m]);
+	} else {
+		if (lazy) {
+			obj1 = node_sysevent_attrs_create(nev);
+		} else {
+			const nsev_flat_t *nf = nsev_event_attrs(nev);
+
+			obj1 = Nan::New<Object>();
+			if (nf != NULL) {
+				VERIFY0(node_sysevent_flat_to_object(nf,
+				    obj1));
+			}
+		}
+		node_sysevent_freeze(obj1);
+		nsr->nsr_attrs[m].Reset(obj1);
+	}
+
+	if (coalesce) {
+		evt = node_sysevent_repeat_record_new(obj0, obj1, count);
+		node_sysevent_freeze(evt);
+		return (evt);
+	}
+
+	evt = node_sysevent_record_new(obj0, obj1);
+	node_sysevent_freeze(evt);
+	nsr->nsr_record[m].Reset(evt);
+
+	return (evt);
+}
+
+/*
+ * Called when a Buffer made by "node_sysevent_packed_record()" is collected.
+ */
+static void
+node_sysevent_packed_free(char *data, void *)
+{
+	const nsev_packed_t *npk = (const nsev_packed_t *)data;
+
+	Nan::AdjustExternalMemory(-(int)npk->npk_size);
+	nsev_packed_rele(npk);
+}
+
+/*
+ * Return the Buffer holding the packed form of "nev", creating it if this is
+ * the first packed-mode stream to receive the event.  The Buffer refers
+ * directly to the packed event built on the libsysevent thread, rather than
+ * to a copy, and holds a reference to it until the Buffer is collected; the
+ * Buffer may therefore outlive both the event and the stream.
+ */
+static Local<Object>
+node_sysevent_packed_record(nsev_event_t *nev)
+{
+	node_sysevent_records_t *nsr = node_sysevent_records(nev);
+	const nsev_packed_t *npk;
+	Local<Object> buf;
+
+	if (!nsr->nsr_packed.IsEmpty()) {
+		return (Nan::New(nsr->nsr_packed));
+	}
+
+	npk = nsev_event_packed_hold(nev);
+	buf = Nan::NewBuffer((char *)npk, npk->npk_size,
+	    node_sysevent_packed_free, NULL).ToLocalChecked();
+	Nan::AdjustExternalMemory((int)npk->npk_size);
+	nsr->nsr_packed.Reset(buf);
+
+	return (buf);
+}
+
 /*
  * This callback (with C calling convention) is passed to the C side of the
  * implementation.  It will be called when we receive notification of a
- * sysevent.  See "more.c" for further information.
+ * sysevent.  See "more.c" for further information.  The record for the event
+ * (which stands for "count" events if this stream coalesces them) is appended
+ * to the current batch; the batch is passed to Javascript by
+ * "node_sysevent_flush()".
  */
 extern "C" void
-node_sysevent_deliver(nvlist_t *nvl0, nvlist_t *nvl1, void *arg)
+node_sysevent_deliver(nsev_event_t *nev, uint_t count, void *arg)
 {
 	node_sysevent_cpp_t *nsec = (node_sysevent_cpp_t *)arg;
+	Nan::HandleScope scope;
 
-	/*
-	 * Arguments to the callback:
-	 */
-	Local<Object> obj0 = Nan::New<Object>();
-	Local<Object> obj1 = Nan::New<Object>();
-	Local<Value> argv[] = { obj0, obj1 };
+	Local<Object> evt = nsec->nsec_packed ?
+	    node_sysevent_packed_record(nev) :
+	    node_sysevent_record(nev, nsec->nsec_lazy, nsec->nsec_coalesce,
+	    count);
 
-	if (nvl0 != NULL) {
-		VERIFY0(node_sysevent_nvlist_to_object(nvl0, obj0));
+	if (nsec->nsec_batch == NULL) {
+		nsec->nsec_batch = new Nan::Global<Array>(Nan::New<Array>());
+		nsec->nsec_batch_len = 0;
 	}
-	if (nvl1 != NULL) {
-		VERIFY0(node_sysevent_nvlist_to_object(nvl1, obj1));
+	Nan::Set(Nan::New(*nsec->nsec_batch), nsec->nsec_batch_len++, evt);
+}
+
+/*
+ * Called by "more.c" at the end of each batch of events in which
+ * "node_sysevent_deliver()" was called for this subscriber.  The whole batch
+ * is passed to the callback function in a single call.
+ */
+extern "C" void
+node_sysevent_flush(void *arg)
+{
+	node_sysevent_cpp_t *nsec = (node_sysevent_cpp_t *)arg;
+	Nan::HandleScope scope;
+
+	if (nsec->nsec_batch == NULL) {
+		return;
 	}
 
-	nsec->nsec_func->Call(2, argv);
+	Local<Value> argv[] = { Nan::New(*nsec->nsec_batch) };
+
+	delete nsec->nsec_batch;
+	nsec->nsec_batch = NULL;
+	nsec->nsec_batch_len = 0;
+
+	nsec->nsec_func->Call(1, argv);
 }
 
 /*
@@ -200,6 +878,11 @@ node_sysevent_destroy_common(node_sysevent_cpp_t *nsec)
 	nsec->nsec_destroyed = 1;
 
 	if (nsec->nsec_hdl != NULL) {
+		/*
+		 * Keep the final counters for "stats()".
+		 */
+		nsev_stats(nsec->nsec_hdl, &nsec->nsec_stats);
+
 		/*
 		 * Detach from the subscription first to ensure no further
 		 * calls to node_sysevent_deliver().
@@ -213,6 +896,18 @@ node_sysevent_destroy_common(node_sysevent_cpp_t *nsec)
 		crossthread_release_hold();
 	}
 
+	/*
+	 * Discard any events that were waiting to be flushed.  Buffers
+	 * already made for packed events hold their own reference to the
+	 * native memory behind them (see "node_sysevent_packed_record()"),
+	 * so they remain valid after this stream is gone, and that memory is
+	 * only returned to its pool when the last of them is collected.
+	 */
+	if (nsec->nsec_batch != NULL) {
+		delete nsec->nsec_batch;
+		nsec->nsec_batch = NULL;
+	}
+
 	/*
 	 * Remove reference to our event delivery callback:
 	 */
@@ -237,27 +932,73 @@ static
 NAN_METHOD(node_sysevent_ctor)
 {
 	Local<Object> self = info.This();
+	Local<Function> func;
 	node_sysevent_cpp_t *nsec;
+	nvlist_t *opts = NULL;
+	int lazy = 0, packed = 0;
 
 	/*
 	 * We don't expose this class to consumers directly, so just make sure
 	 * we're doing the right thing with respect to "new" and provided
-	 * arguments, etc.
+	 * arguments, etc.  We accept either "(callback)" or
+	 * "(options, callback)".
 	 */
-	if (!info.IsConstructCall() || info.Length() != 1) {
+	if (!info.IsConstructCall() || info.Length() < 1 ||
+	    info.Length() > 2 || !info[info.Length() - 1]->IsFunction()) {
 		Nan::ThrowError("invalid constructor call");
 		return;
 	}
+	func = info[info.Length() - 1].As<Function>();
+
+	if (info.Length() == 2 && info[0]->IsObject()) {
+		Local<Value> v = node_sysevent_option(info[0].As<Object>(),
+		    "lazy");
+
+		if (!v->IsUndefined() && !v->IsBoolean()) {
+			Nan::ThrowTypeError("\"lazy\" must be a boolean");
+			return;
+		}
+		lazy = v->IsTrue();
+
+		v = node_sysevent_option(info[0].As<Object>(), "packed");
+		if (!v->IsUndefined() && !v->IsBoolean()) {
+			Nan::ThrowTypeError("\"packed\" must be a boolean");
+			return;
+		}
+		packed = v->IsTrue();
+
+		/*
+		 * A packed event is a single Buffer shared by every stream,
+		 * so there is nowhere to put a repeat count, and attributes
+		 * are never converted.
+		 */
+		if (packed && (lazy || !node_sysevent_option(
+		    info[0].As<Object>(), "coalesce")->IsUndefined())) {
+			Nan::ThrowTypeError("\"packed\" cannot be combined "
+			    "with \"lazy\" or \"coalesce\"");
+			return;
+		}
+	}
+
+	if (info.Length() == 2 &&
+	    node_sysevent_options_to_nvlist(info[0], &opts) != 0) {
+		return;
+	}
 
 	/*
 	 * Allocate our tracking structure and set our first internal field
 	 * slot to point to it.
 	 */
 	if ((nsec = (node_sysevent_cpp_t *)calloc(1, sizeof (*nsec))) == NULL) {
+		nvlist_free(opts);
 		Nan::ThrowError("could not allocate tracking struct");
 		return;
 	}
 	set_internal_pointer(self, 0, (void *)nsec);
+	nsec->nsec_lazy = lazy;
+	nsec->nsec_packed = packed;
+	nsec->nsec_coalesce = (opts != NULL &&
+	    nvlist_exists(opts, "coalesce"));
 
 	/*
 	 * Create a persistent reference to ourselves, so that we are not
@@ -269,16 +1010,22 @@ NAN_METHOD(node_sysevent_ctor)
 	 * Create a persistent reference to the callback function we were
 	 * passed, so that we may call it asynchronously.
 	 */
-	nsec->nsec_func = new Nan::Callback(info[0].As<Function>());
+	nsec->nsec_func = new Nan::Callback(func);
 
 	/*
 	 * Attach to the sysevent subscription.
 	 */
-	if (nsev_attach(node_sysevent_deliver, (void *)nsec,
-	    &nsec->nsec_hdl) != 0) {
-		Nan::ThrowError("could not connect to sysevent");
+	if (nsev_attach(node_sysevent_deliver, node_sysevent_flush, opts,
+	    (void *)nsec, &nsec->nsec_hdl) != 0) {
+		int e = errno;
+
+		nvlist_free(opts);
+		node_sysevent_destroy_common(nsec);
+		Nan::ThrowError(Nan::ErrnoException(e, "nsev_attach",
+		    "could not connect to sysevent"));
 		return;
 	}
+	nvlist_free(opts);
 
 	/*
 	 * Hold the event loop open while we wait for sysevents.  The consumer
@@ -301,6 +1048,647 @@ NAN_METHOD(node_sysevent_destroy)
 	node_sysevent_destroy_common(nsec);
 }
 
+/*
+ * The "stats()" method: returns counters for the events that matched this
+ * subscriber's filters.  "dropped" and "coalesced" count events discarded
+ * by the module-wide overload policy; see "configure()".
+ */
+static
+NAN_METHOD(node_sysevent_impl_stats)
+{
+	Local<Object> self = info.This();
+	node_sysevent_cpp_t *nsec = (node_sysevent_cpp_t *)
+	    get_internal_pointer(self, 0);
+	Local<Object> stats = Nan::New<Object>();
+
+	if (nsec->nsec_hdl != NULL) {
+		nsev_stats(nsec->nsec_hdl, &nsec->nsec_stats);
+	}
+
+	Nan::Set(stats, Nan::New("delivered").ToLocalChecked(),
+	    Nan::New<v8::Number>((double)nsec->nsec_stats.nss_delivered));
+	Nan::Set(stats, Nan::New("dropped").ToLocalChecked(),
+	    Nan::New<v8::Number>((double)nsec->nsec_stats.nss_dropped));
+	Nan::Set(stats, Nan::New("coalesced").ToLocalChecked(),
+	    Nan::New<v8::Number>((double)nsec->nsec_stats.nss_coalesced));
+	Nan::Set(stats, Nan::New("held").ToLocalChecked(),
+	    Nan::New<v8::Number>((double)nsec->nsec_stats.nss_held));
+
+	info.GetReturnValue().Set(stats);
+}
+
+/*
+ * The "pause()" and "resume()" methods: while paused, events for this object
+ * are held in native memory (up to the "holdLimit" passed to the
+ * constructor) rather than passed to the callback.
+ */
+static
+NAN_METHOD(node_sysevent_pause)
+{
+	Local<Object> self = info.This();
+	node_sysevent_cpp_t *nsec = (node_sysevent_cpp_t *)
+	    get_internal_pointer(self, 0);
+
+	if (nsec->nsec_hdl != NULL) {
+		nsev_pause(nsec->nsec_hdl);
+	}
+}
+
+static
+NAN_METHOD(node_sysevent_resume)
+{
+	Local<Object> self = info.This();
+	node_sysevent_cpp_t *nsec = (node_sysevent_cpp_t *)
+	    get_internal_pointer(self, 0);
+
+	if (nsec->nsec_hdl != NULL) {
+		nsev_resume(nsec->nsec_hdl);
+	}
+}
+
+/*
+ * The current configuration of the in-flight event pools; see
+ * "node_sysevent_configure()".
+ */
+static uint_t g_node_sysevent_pool_size = NSEV_POOL_DEFAULT_SIZE;
+static nsev_pool_policy_t g_node_sysevent_pool_policy = NSEV_POOL_MALLOC;
+
+/*
+ * The current queue limit and overload policy:
+ */
+static uint_t g_node_sysevent_queue_limit = 0;
+static nsev_overload_t g_node_sysevent_overload = NSEV_OVERLOAD_BLOCK;
+
+/*
+ * The current micro-batching configuration:
+ */
+static uint_t g_node_sysevent_batch_size = CROSSTHREAD_BATCH_DEFAULT;
+static uint_t g_node_sysevent_batch_window = 0;
+
+#define	NODE_SYSEVENT_POOL_MAX	(1024 * 1024)
+#define	NODE_SYSEVENT_JOURNAL_MAX	(1024 * 1024 * 1024)
+#define	NODE_SYSEVENT_SYNC_MAX	(60 * 60 * 1000)
+#define	NODE_SYSEVENT_QUEUE_MAX	(1024 * 1024)
+#define	NODE_SYSEVENT_BATCH_MAX	(1024 * 1024)
+#define	NODE_SYSEVENT_SPEED_MAX	1000000
+
+static const struct {
+	const char *nso_name;
+	nsev_overload_t nso_policy;
+} node_sysevent_overloads[] = {
+	{ "block",		NSEV_OVERLOAD_BLOCK },
+	{ "drop-newest",	NSEV_OVERLOAD_DROP_NEWEST },
+	{ "drop-oldest",	NSEV_OVERLOAD_DROP_OLDEST },
+	{ "coalesce",		NSEV_OVERLOAD_COALESCE },
+	{ NULL,			NSEV_OVERLOAD_BLOCK }
+};
+
+/*
+ * Validate the "journal" option, without applying it.  On success, "pathp"
+ * is set to the journal path, or to null if journaling is to stop.  Throws
+ * and returns -1 if the option is not valid.
+ */
+static int
+node_sysevent_parse_journal(Local<Value> v, Local<Value> *pathp,
+    uint_t *sizep, uint_t *syncp)
+{
+	Local<Object> jopts;
+	Local<Value> p;
+
+	*sizep = NSEV_JOURNAL_DEFAULT_SIZE;
+	*syncp = NSEV_JOURNAL_SYNC_DEFAULT;
+
+	if (v->IsNull() || v->IsFalse()) {
+		*pathp = Nan::Null();
+		return (0);
+	}
+
+	if (!v->IsObject() || !(p = node_sysevent_option(v.As<Object>(),
+	    "path"))->IsString()) {
+		Nan::ThrowTypeError("\"journal\" must be null or an object "
+		    "with a string \"path\"");
+		return (-1);
+	}
+	jopts = v.As<Object>();
+
+	if (node_sysevent_uint_option(jopts, "size",
+	    NODE_SYSEVENT_JOURNAL_MAX, sizep) != 0 ||
+	    node_sysevent_uint_option(jopts, "syncInterval",
+	    NODE_SYSEVENT_SYNC_MAX, syncp) != 0) {
+		return (-1);
+	}
+	if (*sizep < NSEV_JOURNAL_MINSIZE) {
+		Nan::ThrowTypeError("journal \"size\" is too small");
+		return (-1);
+	}
+
+	*pathp = p;
+	return (0);
+}
+
+static const nsev_source_ops_t *node_sysevent_sources[] = {
+	&nsev_source_sysevent,
+	&nsev_source_synth,
+	&nsev_source_replay,
+	NULL
+};
+
+#define	NODE_SYSEVENT_SYNTH_RATE_MAX	(10 * 1000 * 1000)
+#define	NODE_SYSEVENT_SYNTH_THREADS_MAX	64
+#define	NODE_SYSEVENT_SYNTH_ATTRS_MAX	1024
+#define	NODE_SYSEVENT_SYNTH_STRLEN_MAX	(64 * 1024)
+#define	NODE_SYSEVENT_SYNTH_CLASSES_MAX	256
+
+/*
+ * Convert the "synthetic" option into "nsy", without applying it; the class
+ * names are copied into "names", and "classes" must have room for
+ * NODE_SYSEVENT_SYNTH_CLASSES_MAX entries.  Throws and returns -1 if the
+ * option is not valid.  The "classes" property is an array of "{ class,
+ * subclass, weight }" objects; "post" is a boolean.
+ */
+static int
+node_sysevent_parse_synth(Local<Value> v, nsev_synth_config_t *nsyp,
+    nsev_synth_class_t *classes, char names[][2][NSEV_CLASS_LEN])
+{
+	nsev_synth_config_t nsy;
+	Local<Object> sopts;
+	Local<Value> cv;
+	uint_t i, weight = 0;
+
+	if (!v->IsObject()) {
+		Nan::ThrowTypeError("\"synthetic\" must be an object");
+		return (-1);
+	}
+	sopts = v.As<Object>();
+
+	nsy.nsy_rate = NSEV_SYNTH_RATE_DEFAULT;
+	nsy.nsy_threads = NSEV_SYNTH_THREADS_DEFAULT;
+	nsy.nsy_attrs = NSEV_SYNTH_ATTRS_DEFAULT;
+	nsy.nsy_strlen = NSEV_SYNTH_STRLEN_DEFAULT;
+	nsy.nsy_nclasses = 1;
+	nsy.nsy_classes = classes;
+	classes[0].nsc_class = (char *)"EC_synthetic";
+	classes[0].nsc_subclass = (char *)"ESC_synthetic";
+	classes[0].nsc_weight = 1;
+	nsy.nsy_post = 0;
+
+	if (node_sysevent_uint_option(sopts, "rate",
+	    NODE_SYSEVENT_SYNTH_RATE_MAX, &nsy.nsy_rate) != 0 ||
+	    node_sysevent_uint_option(sopts, "threads",
+	    NODE_SYSEVENT_SYNTH_THREADS_MAX, &nsy.nsy_threads) != 0 ||
+	    node_sysevent_uint_option(sopts, "attributes",
+	    NODE_SYSEVENT_SYNTH_ATTRS_MAX, &nsy.nsy_attrs) != 0 ||
+	    node_sysevent_uint_option(sopts, "stringLength",
+	    NODE_SYSEVENT_SYNTH_STRLEN_MAX, &nsy.nsy_strlen) != 0) {
+		return (-1);
+	}
+	if (nsy.nsy_threads == 0) {
+		Nan::ThrowTypeError("\"threads\" must be at least 1");
+		return (-1);
+	}
+
+	cv = node_sysevent_option(sopts, "post");
+	if (!cv->IsUndefined()) {
+		if (!cv->IsBoolean()) {
+			Nan::ThrowTypeError("\"post\" must be a boolean");
+			return (-1);
+		}
+		nsy.nsy_post = cv->IsTrue();
+	}
+
+	cv = node_sysevent_option(sopts, "classes");
+	if (!cv->IsUndefined()) {
+		Local<Array> a;
+
+		if (!cv->IsArray() || (a = cv.As<Array>())->Length() == 0 ||
+		    a->Length() > NODE_SYSEVENT_SYNTH_CLASSES_MAX) {
+			Nan::ThrowTypeError("\"classes\" must be a non-empty "
+			    "array of at most 256 objects");
+			return (-1);
+		}
+		nsy.nsy_nclasses = a->Length();
+
+		for (i = 0; i < nsy.nsy_nclasses; i++) {
+			Local<Value> e = Nan::Get(a, i).ToLocalChecked();
+			Local<Value> c, sc;
+
+			if (!e->IsObject() || !(c = node_sysevent_option(
+			    e.As<Object>(), "class"))->IsString() ||
+			    !(sc = node_sysevent_option(e.As<Object>(),
+			    "subclass"))->IsString()) {
+				Nan::ThrowTypeError("each of \"classes\" must "
+				    "have a string \"class\" and "
+				    "\"subclass\"");
+				return (-1);
+			}
+
+			classes[i].nsc_weight = 1;
+			if (node_sysevent_uint_option(e.As<Object>(), "weight",
+			    UINT16_MAX, &classes[i].nsc_weight) != 0) {
+				return (-1);
+			}
+
+			Nan::Utf8String cs(c);
+			Nan::Utf8String scs(sc);
+			(void) snprintf(names[i][0], NSEV_CLASS_LEN, "%s",
+			    *cs);
+			(void) snprintf(names[i][1], NSEV_CLASS_LEN, "%s",
+			    *scs);
+			classes[i].nsc_class = names[i][0];
+			classes[i].nsc_subclass = names[i][1];
+		}
+	}
+
+	for (i = 0; i < nsy.nsy_nclasses; i++) {
+		weight += classes[i].nsc_weight;
+	}
+	if (weight == 0) {
+		Nan::ThrowTypeError("at least one of \"classes\" must have a "
+		    "non-zero \"weight\"");
+		return (-1);
+	}
+
+	*nsyp = nsy;
+	return (0);
+}
+
+/*
+ * The "configure(options)" function: adjusts module-wide tuning.  The
+ * supported options are:
+ *
+ *	poolSize	the number of in-flight events (those received from
+ *			libsysevent but not yet delivered to every stream)
+ *			for which memory is preallocated
+ *
+ *	poolExhausted	what to do with events that arrive while the pool is
+ *			exhausted: "malloc" to allocate memory for them
+ *			anyway, or "drop" to discard them
+ *
+ *	queueLimit	the number of events that may be waiting for delivery
+ *			to Javascript, or 0 for no limit
+ *
+ *	overload	what to do with events beyond the queue limit: one of
+ *			"block", "drop-newest", "drop-oldest" or "coalesce"
+ *
+ *	batchWindow	if non-zero, events are delivered to Javascript at
+ *			most once per this many milliseconds
+ *
+ *	batchSize	the number of waiting events that ends a batch window
+ *			early
+ *
+ *	journal		"{ path, size, syncInterval }" to journal every event
+ *			received to a ring file (see "journal.c"), or null
+ *			to stop journaling
+ *
+ *	source		"sysevent" to receive live events from libsysevent,
+ *			"synthetic" to receive made-up events (see below), or
+ *			"replay" to receive only replayed events (see
+ *			"replay()")
+ *
+ *	synthetic	"{ rate, threads, attributes, stringLength, classes,
+ *			post }" to configure the synthetic source; see
+ *			"source.h"
+ *
+ * Options that are not provided keep their current values.  The pools, the
+ * source and the synthetic source configuration can only be changed when
+ * there are no active streams; the other settings may be changed at any
+ * time.
+ *
+ * Every option is validated before any is applied, so an invalid option, or
+ * an attempt to change one of the above while streams are active, changes
+ * nothing.  The journal is opened after the pools, the source and the
+ * synthetic source are changed, though, so if it cannot be opened (or memory
+ * runs out), those changes remain and the queue and batching settings are
+ * left as they were.
+ */
+static
+NAN_METHOD(node_sysevent_configure)
+{
+	uint_t size = g_node_sysevent_pool_size;
+	nsev_pool_policy_t policy = g_node_sysevent_pool_policy;
+	uint_t limit = g_node_sysevent_queue_limit;
+	nsev_overload_t overload = g_node_sysevent_overload;
+	uint_t batch = g_node_sysevent_batch_size;
+	uint_t window = g_node_sysevent_batch_window;
+	const nsev_source_ops_t *source = NULL;
+	nsev_synth_config_t nsy;
+	nsev_synth_class_t classes[NODE_SYSEVENT_SYNTH_CLASSES_MAX];
+	char names[NODE_SYSEVENT_SYNTH_CLASSES_MAX][2][NSEV_CLASS_LEN];
+	uint_t jsize, jsync;
+	Local<Object> opts;
+	Local<Value> v, synth, journal, path;
+
+	if (info.Length() != 1 || !info[0]->IsObject()) {
+		Nan::ThrowTypeError("options must be an object");
+		return;
+	}
+	opts = info[0].As<Object>();
+
+	if (node_sysevent_uint_option(opts, "poolSize",
+	    NODE_SYSEVENT_POOL_MAX, &size) != 0 ||
+	    node_sysevent_uint_option(opts, "queueLimit",
+	    NODE_SYSEVENT_QUEUE_MAX, &limit) != 0 ||
+	    node_sysevent_uint_option(opts, "batchSize",
+	    NODE_SYSEVENT_BATCH_MAX, &batch) != 0 ||
+	    node_sysevent_uint_option(opts, "batchWindow",
+	    NODE_SYSEVENT_WINDOW_MAX, &window) != 0) {
+		return;
+	}
+	if (batch == 0) {
+		Nan::ThrowTypeError("\"batchSize\" must be at least 1");
+		return;
+	}
+
+	v = node_sysevent_option(opts, "poolExhausted");
+	if (!v->IsUndefined()) {
+		if (!v->IsString()) {
+			Nan::ThrowTypeError("\"poolExhausted\" must be "
+			    "\"malloc\" or \"drop\"");
+			return;
+		}
+
+		Nan::Utf8String str(v);
+		if (strcmp(*str, "malloc") == 0) {
+			policy = NSEV_POOL_MALLOC;
+		} else if (strcmp(*str, "drop") == 0) {
+			policy = NSEV_POOL_DROP;
+		} else {
+			Nan::ThrowTypeError("\"poolExhausted\" must be "
+			    "\"malloc\" or \"drop\"");
+			return;
+		}
+	}
+
+	v = node_sysevent_option(opts, "overload");
+	if (!v->IsUndefined()) {
+		int i = 0;
+
+		if (v->IsString()) {
+			Nan::Utf8String str(v);
+
+			for (; node_sysevent_overloads[i].nso_name != NULL;
+			    i++) {
+				if (strcmp(*str,
+				    node_sysevent_overloads[i].nso_name) == 0) {
+					break;
+				}
+			}
+		}
+		if (!v->IsString() ||
+		    node_sysevent_overloads[i].nso_name == NULL) {
+			Nan::ThrowTypeError("\"overload\" must be \"block\", "
+			    "\"drop-newest\", \"drop-oldest\" or "
+			    "\"coalesce\"");
+			return;
+		}
+		overload = node_sysevent_overloads[i].nso_policy;
+	}
+
+	v = node_sysevent_option(opts, "source");
+	if (!v->IsUndefined()) {
+		int i = 0;
+
+		if (v->IsString()) {
+			Nan::Utf8String str(v);
+
+			for (; node_sysevent_sources[i] != NULL; i++) {
+				if (strcmp(*str,
+				    node_sysevent_sources[i]->nso_name) == 0) {
+					break;
+				}
+			}
+		}
+		if (!v->IsString() || node_sysevent_sources[i] == NULL) {
+			Nan::ThrowTypeError("\"source\" must be \"sysevent\", "
+			    "\"synthetic\" or \"replay\"");
+			return;
+		}
+		source = node_sysevent_sources[i];
+	}
+
+	synth = node_sysevent_option(opts, "synthetic");
+	if (!synth->IsUndefined() && node_sysevent_parse_synth(synth, &nsy,
+	    classes, names) != 0) {
+		return;
+	}
+
+	journal = node_sysevent_option(opts, "journal");
+	if (!journal->IsUndefined() && node_sysevent_parse_journal(journal,
+	    &path, &jsize, &jsync) != 0) {
+		return;
+	}
+
+	/*
+	 * Every option is valid; apply them.  The pools, the source and the
+	 * synthetic source all fail with EBUSY while there are active streams,
+	 * and the first of them to be changed fails before anything else is.
+	 */
+	if (size != g_node_sysevent_pool_size ||
+	    policy != g_node_sysevent_pool_policy) {
+		if (nsev_configure_pool(size, policy) != 0) {
+			Nan::ThrowError(Nan::ErrnoException(errno,
+			    "nsev_configure_pool",
+			    "could not configure event pools"));
+			return;
+		}
+		g_node_sysevent_pool_size = size;
+		g_node_sysevent_pool_policy = policy;
+	}
+
+	if (source != NULL && nsev_configure_source(source) != 0) {
+		Nan::ThrowError(Nan::ErrnoException(errno,
+		    "nsev_configure_source", "could not change event source"));
+		return;
+	}
+
+	if (!synth->IsUndefined() && nsev_synth_configure(&nsy) != 0) {
+		Nan::ThrowError(Nan::ErrnoException(errno,
+		    "nsev_synth_configure",
+		    "could not configure synthetic source"));
+		return;
+	}
+
+	if (!journal->IsUndefined()) {
+		if (path->IsNull()) {
+			VERIFY0(nsev_configure_journal(NULL, 0, 0));
+		} else {
+			Nan::Utf8String str(path);
+
+			if (nsev_configure_journal(*str, jsize, jsync) != 0) {
+				Nan::ThrowError(Nan::ErrnoException(errno,
+				    "nsev_configure_journal",
+				    "could not open journal", *str));
+				return;
+			}
+		}
+	}
+
+	nsev_configure_queue(limit, overload);
+	g_node_sysevent_queue_limit = limit;
+	g_node_sysevent_overload = overload;
+
+	crossthread_set_batching(batch, window);
+	g_node_sysevent_batch_size = batch;
+	g_node_sysevent_batch_window = window;
+}
+
+/*
+ * Called by "replay.c" when a replay ends.
+ */
+static void
+node_sysevent_replay_done(int err, uint64_t count, void *arg)
+{
+	Nan::Callback *cb = (Nan::Callback *)arg;
+	Nan::HandleScope scope;
+	Local<Value> argv[2];
+
+	if (err == 0) {
+		argv[0] = Nan::Null();
+	} else {
+		argv[0] = Nan::ErrnoException(err, "nsev_replay",
+		    err == ECANCELED ? "replay stopped" :
+		    err == ESTALE ? "journal overwritten during replay" :
+		    "replay failed");
+	}
+	argv[1] = Nan::New<v8::Number>((double)count);
+
+	cb->Call(2, argv);
+	delete cb;
+}
+
+/*
+ * The "replay(path, options, callback)" function: replays the events in the
+ * journal at "path" to every stream, as if they had just been received.  The
+ * supported options are:
+ *
+ *	from		the sequence number of the first record to replay
+ *
+ *	speed		the rate at which to replay events, relative to the
+ *			rate at which they were journaled (default 1), or 0
+ *			to replay them as fast as they can be delivered
+ *
+ * The callback is called with an error (or null) and the number of events
+ * replayed, once the replay ends.  Only one replay may run at a time.
+ */
+static
+NAN_METHOD(node_sysevent_replay)
+{
+	uint64_t from = 0;
+	double speed = 1;
+	Local<Object> opts;
+	Local<Value> v;
+
+	if (info.Length() != 3 || !info[0]->IsString() ||
+	    !info[1]->IsObject() || !info[2]->IsFunction()) {
+		Nan::ThrowTypeError("expected a path, an options object and "
+		    "a callback");
+		return;
+	}
+	opts = info[1].As<Object>();
+
+	v = node_sysevent_option(opts, "from");
+	if (!v->IsUndefined()) {
+		double d;
+
+		if (!v->IsNumber() || (d = Nan::To<double>(v).FromJust()) < 0 ||
+		    d > 9007199254740991.0 || d != (double)(uint64_t)d) {
+			Nan::ThrowTypeError("\"from\" must be a non-negative "
+			    "integer");
+			return;
+		}
+		from = (uint64_t)d;
+	}
+
+	v = node_sysevent_option(opts, "speed");
+	if (!v->IsUndefined()) {
+		if (!v->IsNumber() || !((speed = Nan::To<double>(v).FromJust())
+		    >= 0 && speed <= NODE_SYSEVENT_SPEED_MAX)) {
+			Nan::ThrowTypeError("\"speed\" must be a number "
+			    "between 0 and 1000000");
+			return;
+		}
+	}
+
+	Nan::Utf8String path(info[0]);
+	Nan::Callback *cb = new Nan::Callback(info[2].As<Function>());
+
+	if (nsev_replay_start(*path, from, speed, node_sysevent_replay_done,
+	    cb) != 0) {
+		delete cb;
+		Nan::ThrowError(Nan::ErrnoException(errno, "nsev_replay_start",
+		    "could not start replay", *path));
+		return;
+	}
+}
+
+/*
+ * The "stopReplay()" function: stops the running replay, whose callback is
+ * then called with an ECANCELED error.  Returns false if no replay was
+ * running.
+ */
+static
+NAN_METHOD(node_sysevent_stop_replay)
+{
+	info.GetReturnValue().Set(Nan::New<v8::Boolean>(
+	    nsev_replay_stop() == 0));
+}
+
+/*
+ * The "stats()" function: returns an object containing counters that
+ * describe the operation of the module.
+ */
+static
+NAN_METHOD(node_sysevent_stats)
+{
+	Local<Object> stats = Nan::New<Object>();
+	node_sysevent_intern_stats_t nsis;
+	nsev_pool_stats_t events, packed, calls;
+	nsev_journal_stats_t njs;
+	nsev_queue_stats_t nqs;
+
+	node_sysevent_intern_stats(&nsis);
+	nsev_journal_report(&njs);
+	nsev_pool_report(&events, &packed, &calls);
+	nsev_queue_report(&nqs);
+
+	Nan::Set(stats, Nan::New("unknownTypes").ToLocalChecked(),
+	    Nan::New<v8::Number>((double)node_sysevent_convert_unknown()));
+	Nan::Set(stats, Nan::New("internHits").ToLocalChecked(),
+	    Nan::New<v8::Number>((double)nsis.nsis_hits));
+	Nan::Set(stats, Nan::New("internMisses").ToLocalChecked(),
+	    Nan::New<v8::Number>((double)nsis.nsis_misses));
+	Nan::Set(stats, Nan::New("internEvictions").ToLocalChecked(),
+	    Nan::New<v8::Number>((double)nsis.nsis_evictions));
+	Nan::Set(stats, Nan::New("poolSize").ToLocalChecked(),
+	    Nan::New<v8::Number>((double)events.nps_size));
+	Nan::Set(stats, Nan::New("poolInUse").ToLocalChecked(),
+	    Nan::New<v8::Number>((double)events.nps_inuse));
+	Nan::Set(stats, Nan::New("poolFallbacks").ToLocalChecked(),
+	    Nan::New<v8::Number>((double)(events.nps_fallbacks +
+	    packed.nps_fallbacks + calls.nps_fallbacks)));
+	Nan::Set(stats, Nan::New("poolDrops").ToLocalChecked(),
+	    Nan::New<v8::Number>((double)(events.nps_failures +
+	    packed.nps_failures + calls.nps_failures)));
+	Nan::Set(stats, Nan::New("packedInUse").ToLocalChecked(),
+	    Nan::New<v8::Number>((double)packed.nps_inuse));
+	Nan::Set(stats, Nan::New("queued").ToLocalChecked(),
+	    Nan::New<v8::Number>((double)nqs.nqs_queued));
+	Nan::Set(stats, Nan::New("queueLimit").ToLocalChecked(),
+	    Nan::New<v8::Number>((double)nqs.nqs_limit));
+	Nan::Set(stats, Nan::New("queueDrops").ToLocalChecked(),
+	    Nan::New<v8::Number>((double)nqs.nqs_dropped));
+	Nan::Set(stats, Nan::New("queueCoalesced").ToLocalChecked(),
+	    Nan::New<v8::Number>((double)nqs.nqs_coalesced));
+	Nan::Set(stats, Nan::New("journalAppended").ToLocalChecked(),
+	    Nan::New<v8::Number>((double)njs.njs_appended));
+	Nan::Set(stats, Nan::New("journalErrors").ToLocalChecked(),
+	    Nan::New<v8::Number>((double)njs.njs_errors));
+	Nan::Set(stats, Nan::New("subscribeErrors").ToLocalChecked(),
+	    Nan::New<v8::Number>((double)nsev_sysevent_subscribe_errors()));
+
+	info.GetReturnValue().Set(stats);
+}
+
 /*
  * Create the function template for the "SyseventImpl" Javascript class and
  * export it.
@@ -314,9 +1702,33 @@ node_sysevent_init(Handle<Object> exports)
 	t->InstanceTemplate()->SetInternalFieldCount(1);
 
 	Nan::SetPrototypeMethod(t, "destroy", node_sysevent_destroy);
+	Nan::SetPrototypeMethod(t, "stats", node_sysevent_impl_stats);
+	Nan::SetPrototypeMethod(t, "pause", node_sysevent_pause);
+	Nan::SetPrototypeMethod(t, "resume", node_sysevent_resume);
 
 	exports->Set(Nan::New("SyseventImpl").ToLocalChecked(),
 	    t->GetFunction());
+
+	/*
+	 * The "SyseventAttributes" class is not exported; instances are only
+	 * created by "node_sysevent_attrs_create()".
+	 */
+	Local<FunctionTemplate> at = Nan::New<FunctionTemplate>();
+
+	at->SetClassName(Nan::New("SyseventAttributes").ToLocalChecked());
+	at->InstanceTemplate()->SetInternalFieldCount(1);
+
+	Nan::SetPrototypeMethod(at, "get", node_sysevent_attrs_get);
+	Nan::SetPrototypeMethod(at, "has", node_sysevent_attrs_has);
+	Nan::SetPrototypeMethod(at, "keys", node_sysevent_attrs_keys);
+	Nan::SetPrototypeMethod(at, "toObject", node_sysevent_attrs_to_object);
+
+	g_node_sysevent_attrs_ctor.Reset(at->GetFunction());
+
+	Nan::SetMethod(exports, "configure", node_sysevent_configure);
+	Nan::SetMethod(exports, "stats", node_sysevent_stats);
+	Nan::SetMethod(exports, "replay", node_sysevent_replay);
+	Nan::SetMethod(exports, "stopReplay", node_sysevent_stop_replay);
 }
 
 NAN_MODULE_INIT(module_init)
@@ -326,12 +1738,14 @@ NAN_MODULE_INIT(module_init)
 	 * subscription to underpin all Javascript-level subscription
 	 * objects.
 	 */
+	VERIFY0(crossthread_init());
+
+	node_sysevent_convert_init();
+
 	if (nsev_init() != 0) {
 		Nan::ThrowError("could not init sysevent handler");
 	}
 
-	VERIFY0(crossthread_init());
-
 	node_sysevent_init(target);
 }
 
@@ -26,96 +26,1577 @@
 #include <libsysevent.h>
 #include <sys/debug.h>
 #include <sys/types.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
 #include <pthread.h>
+#include <atomic.h>
 #include <libnvpair.h>
+#include <uv.h>
+
+#include <node_version.h>
 
 #include "crossthread.h"
 #include "illumos_list.h"
+#include "filter.h"
+#include "flat.h"
+#include "journal.h"
+#include "pool.h"
+#include "source.h"
 
 #include "more.h"
 
+#define	_UNUSED	__attribute__((__unused__))
+
+/*
+ * An event held for a subscriber, with the number of events it stands for
+ * (more than one if it was coalesced):
+ */
+typedef struct nsev_held {
+	nsev_event_t *nh_event;
+	uint_t nh_count;
+} nsev_held_t;
+
+/*
+ * A subscriber with a coalescing window collects matching events in a table
+ * keyed on their class, subclass and the values of the chosen attributes.
+ * An event with the same key as one already in the table replaces it, and
+ * the repeat count of the entry is incremented.  When the window expires,
+ * the latest event for each key is delivered once, with its repeat count.
+ */
+typedef struct nsev_coalesce_entry {
+	list_node_t nce_node;			/* in order of first arrival */
+	struct nsev_coalesce_entry *nce_next;	/* hash chain */
+	uint32_t nce_hash;
+	size_t nce_keylen;
+	char *nce_key;
+	nsev_event_t *nce_event;
+	uint_t nce_count;
+} nsev_coalesce_entry_t;
+
+#define	NSEV_COALESCE_BUCKETS	256
+
+/*
+ * Once the table holds this many distinct keys, it is delivered without
+ * waiting for the window to expire.
+ */
+#define	NSEV_COALESCE_MAX	4096
+
+typedef struct nsev_coalesce {
+	nvlist_t *nc_opts;
+	char **nc_attrs;
+	uint_t nc_nattrs;
+	uint_t nc_window;		/* milliseconds */
+
+	uv_timer_t nc_timer;
+	int nc_timer_active;
+
+	list_t nc_entries;
+	uint_t nc_nentries;
+	nsev_coalesce_entry_t *nc_buckets[NSEV_COALESCE_BUCKETS];
+
+	/*
+	 * Scratch space in which keys are built:
+	 */
+	char *nc_buf;
+	size_t nc_bufsz;
+} nsev_coalesce_t;
+
+/*
+ * C++ registers subscribing functions to be invoked in the event-loop thread,
+ * and we track them in a list of "node_sysevent_t" objects.  The callback
+ * function is invoked once per event, and the flush function is invoked once
+ * at the end of each batch of events in which the callback was invoked at
+ * least once.
+ */
+struct node_sysevent {
+	nsev_callback_t *nse_func;
+	nsev_flush_t *nse_flush;
+	void *nse_func_arg;
+	list_node_t nse_node;
+
+	/*
+	 * The classes this subscriber wants to receive, as a map from class
+	 * name to an array of subclass names.  An empty array selects every
+	 * subclass.  If NULL, every class is wanted.  This is used to compute
+	 * the subscription on our sysevent handle.
+	 */
+	nvlist_t *nse_classes;
+
+	/*
+	 * The compiled filter, evaluated against every event before it is
+	 * passed to "nse_func".  If NULL, every event matches.
+	 */
+	nsev_filter_t *nse_filter;
+
+	/*
+	 * Number of events passed to "nse_func" since the last flush:
+	 */
+	unsigned int nse_pending;
+
+	/*
+	 * Counts of events this subscriber would have received, but which
+	 * were discarded by the overload policy; see "nsev_admit()".  These
+	 * are updated atomically, as they may be incremented by the
+	 * producer threads of the event source.
+	 */
+	uint64_t nse_delivered;
+	uint64_t nse_dropped;
+	uint64_t nse_coalesced;
+
+	/*
+	 * While the subscriber is paused (see "nsev_pause()"), events for it
+	 * are held in this ring rather than passed to "nse_func".  At most
+	 * "nse_hold_limit" events are held; beyond that, the oldest held
+	 * event is discarded (unless the overload policy is "block", in which
+	 * case delivery of further events waits until the subscriber
+	 * resumes).
+	 */
+	int nse_paused;
+	nsev_held_t *nse_hold;
+	uint_t nse_hold_limit;
+	uint_t nse_hold_start;
+	uint_t nse_hold_count;
+
+	/*
+	 * Set by "nsev_detach()" if it is called while we are walking the
+	 * list; the object is freed by "nsev_reap()" once the walk ends.
+	 */
+	int nse_detached;
+
+	/*
+	 * Coalescing state, if the subscriber asked for it:
+	 */
+	nsev_coalesce_t *nse_coalesce;
+};
+
+/*
+ * Each sysevent is captured in an "nsev_event_t", allocated from
+ * "g_nsev_event_pool" by a producer thread of the event source, and handed
+ * to the event loop thread.  From then on it is only touched on the event
+ * loop thread, where subscribers may take additional holds to keep it (and
+ * its attributes) alive beyond the delivery callback.  The header and
+ * attribute nvlist are packed into one buffer on the delivery thread (see
+ * "flat.h"), so that the event loop thread never has to walk or unpack the
+ * nvlist.  "nev_attrs" points into that buffer.
+ */
+struct nsev_event {
+	nsev_header_t nev_header;
+	nsev_packed_t *nev_packed;
+	const nsev_flat_t *nev_attrs;
+	unsigned int nev_refcnt;
+	list_node_t nev_node;
+
+	/*
+	 * The subscriber callback may cache a representation of the event
+	 * here, for use by the other subscribers it is delivered to; see
+	 * "nsev_event_set_cache()".
+	 */
+	void *nev_cache;
+	nsev_cache_fini_t *nev_cache_fini;
+};
+
+/*
+ * Global state:
+ */
+list_t g_nsev_list;
+static unsigned int g_nsev_nactive = 0;
+static unsigned int g_nsev_walkers = 0;
+static pthread_t g_nsev_loop_thread;
+static int g_nsev_init_done = 0;
+static nsev_pool_t *g_nsev_event_pool = NULL;
+static const nsev_source_ops_t *g_nsev_source = &nsev_source_sysevent;
+static int g_nsev_source_started = 0;
+
+/*
+ * The packed form of each event (see "flat.h") is allocated from this pool,
+ * if it fits in NSEV_PACKED_POOL_OBJSIZE bytes, or from the heap otherwise.
+ * A packed event may be handed to Javascript as an external Buffer, which
+ * can outlive the event, so the packed event has a reference count of its
+ * own: the event holds one reference, and each Buffer another.  The count
+ * is kept in a small header in front of the packed event.
+ */
+typedef struct nsev_packed_buf {
+	uint32_t npb_refcnt;
+	uint32_t npb_pooled;
+} nsev_packed_buf_t;
+
+#define	NSEV_PACKED_POOL_OBJSIZE	1024
+
+static nsev_pool_t *g_nsev_packed_pool = NULL;
+
+/*
+ * The event journal, if one is configured; see "journal.c".  The delivery
+ * threads append to it while holding "g_nsev_journal_lock" as readers; the
+ * event loop thread replaces it while holding the lock as a writer.  The
+ * journal is synced periodically by a timer on the event loop, and never on
+ * the delivery threads.
+ */
+static nsev_journal_t *g_nsev_journal = NULL;
+static pthread_rwlock_t g_nsev_journal_lock;
+static uv_timer_t g_nsev_journal_timer;
+static volatile uint64_t g_nsev_journal_appended = 0;
+static volatile uint64_t g_nsev_journal_errors = 0;
+
+/*
+ * The subscriber list is only modified on the event loop thread, which may
+ * walk it without a lock.  Other threads walk it (to account for events they
+ * drop) while holding this lock as readers, so the event loop thread holds it
+ * as a writer while inserting, detaching or freeing subscribers.
+ */
+static pthread_rwlock_t g_nsev_list_lock;
+
+/*
+ * The overload policy.  "g_nsev_queued" counts events that have been accepted
+ * from the event source but not yet delivered or discarded by the event loop
+ * thread.  If "g_nsev_queue_limit" is non-zero, it bounds that count, and
+ * "g_nsev_overload" determines what happens to events beyond the bound.
+ * Events taken from the crossthread queue wait on "g_nsev_backlog" until the
+ * end of the batch, when the policy is applied and they are delivered.
+ */
+static volatile uint32_t g_nsev_queued = 0;
+static volatile uint_t g_nsev_queue_limit = 0;
+static volatile nsev_overload_t g_nsev_overload = NSEV_OVERLOAD_BLOCK;
+static list_t g_nsev_backlog;
+static uint_t g_nsev_backlog_len = 0;
+static uint64_t g_nsev_dropped = 0;
+static uint64_t g_nsev_coalesced = 0;
+
+/*
+ * Producers blocked by the "block" policy wait on this condition variable.
+ * While "g_nsev_unblock" is set, they give up waiting and discard their event
+ * instead; see "nsev_detach()".
+ */
+static pthread_mutex_t g_nsev_queue_mtx;
+static pthread_cond_t g_nsev_queue_cv;
+static uint_t g_nsev_queue_waiters = 0;
+static int g_nsev_unblock = 0;
+
+
+static void nsev_coalesce_destroy(nsev_coalesce_t *);
+static void nsev_event_cache_clear(nsev_event_t *);
+
+static int
+nsev_in_loop_thread(void)
+{
+	return (g_nsev_loop_thread == pthread_self());
+}
+
+/*
+ * Subscriber callbacks call back into Javascript, which may in turn detach
+ * any subscriber (including the one being called).  Objects detached during
+ * a walk of "g_nsev_list" are left on the list, marked as detached, until the
+ * outermost walk has finished.
+ */
+static void
+nsev_reap(void)
+{
+	node_sysevent_t *nse, *next;
+
+	VERIFY(nsev_in_loop_thread());
+
+	if (g_nsev_walkers > 0) {
+		return;
+	}
+
+	VERIFY0(pthread_rwlock_wrlock(&g_nsev_list_lock));
+	for (nse = list_head(&g_nsev_list); nse != NULL; nse = next) {
+		next = list_next(&g_nsev_list, nse);
+
+		if (nse->nse_detached) {
+			list_remove(&g_nsev_list, nse);
+			VERIFY(nse->nse_hold_count == 0);
+			free(nse->nse_hold);
+			nsev_coalesce_destroy(nse->nse_coalesce);
+			nvlist_free(nse->nse_classes);
+			nsev_filter_free(nse->nse_filter);
+			free(nse);
+		}
+	}
+	VERIFY0(pthread_rwlock_unlock(&g_nsev_list_lock));
+}
+
+static int
+nsev_strv_contains(char **strv, uint_t n, const char *str)
+{
+	uint_t i;
+
+	for (i = 0; i < n; i++) {
+		if (strcmp(strv[i], str) == 0) {
+			return (1);
+		}
+	}
+
+	return (0);
+}
+
+/*
+ * Returns 1 if every subclass in "a" is also selected by "b".
+ */
+int
+nsev_subclasses_within(char **a, uint_t an, char **b, uint_t bn)
+{
+	uint_t i;
+
+	if (nsev_strv_contains(b, bn, EC_SUB_ALL)) {
+		return (1);
+	}
+
+	for (i = 0; i < an; i++) {
+		if (!nsev_strv_contains(b, bn, a[i])) {
+			return (0);
+		}
+	}
+
+	return (1);
+}
+
+/*
+ * Compute the union of the class maps of all active subscribers, in the form
+ * we pass to "sysevent_subscribe_event()": each class maps to a list of
+ * subclasses, where EC_SUB_ALL selects every subclass.  If any subscriber
+ * wants every event, the union is just EC_ALL.
+ */
+static nvlist_t *
+nsev_classes_union(void)
+{
+	const char *all[] = { EC_SUB_ALL };
+	node_sysevent_t *nse;
+	nvlist_t *u;
+
+	VERIFY0(nvlist_alloc(&u, NV_UNIQUE_NAME, 0));
+
+	for (nse = list_head(&g_nsev_list); nse != NULL;
+	    nse = list_next(&g_nsev_list, nse)) {
+		nvpair_t *nvp = NULL;
+
+		if (nse->nse_detached) {
+			continue;
+		}
+
+		if (nse->nse_classes == NULL) {
+			nvlist_free(u);
+			VERIFY0(nvlist_alloc(&u, NV_UNIQUE_NAME, 0));
+			VERIFY0(nvlist_add_string_array(u, EC_ALL,
+			    (char **)all, 1));
+			return (u);
+		}
+
+		while ((nvp = nvlist_next_nvpair(nse->nse_classes,
+		    nvp)) != NULL) {
+			char *class = nvpair_name(nvp);
+			char **subs, **have, **merged;
+			uint_t nsubs, nhave, nmerged, i;
+
+			VERIFY0(nvpair_value_string_array(nvp, &subs, &nsubs));
+
+			if (nsubs == 0) {
+				VERIFY0(nvlist_add_string_array(u, class,
+				    (char **)all, 1));
+				continue;
+			}
+
+			if (nvlist_lookup_string_array(u, class, &have,
+			    &nhave) != 0) {
+				VERIFY0(nvlist_add_string_array(u, class,
+				    subs, nsubs));
+				continue;
+			}
+
+			if (nsev_subclasses_within(subs, nsubs, have, nhave)) {
+				continue;
+			}
+
+			/*
+			 * The existing subclass strings belong to the pair we
+			 * are about to replace, so take copies of them.
+			 */
+			VERIFY((merged = calloc(nhave + nsubs,
+			    sizeof (char *))) != NULL);
+			for (nmerged = 0; nmerged < nhave; nmerged++) {
+				VERIFY((merged[nmerged] =
+				    strdup(have[nmerged])) != NULL);
+			}
+			for (i = 0; i < nsubs; i++) {
+				if (!nsev_strv_contains(have, nhave, subs[i])) {
+					VERIFY((merged[nmerged++] =
+					    strdup(subs[i])) != NULL);
+				}
+			}
+			VERIFY0(nvlist_add_string_array(u, class, merged,
+			    nmerged));
+			for (i = 0; i < nmerged; i++) {
+				free(merged[i]);
+			}
+			free(merged);
+		}
+	}
+
+	return (u);
+}
+
+/*
+ * Tell the event source that the union of the class maps of all active
+ * subscribers has changed.  Sources that cannot select events by class
+ * leave it to the subscriber filters.
+ */
+static void
+nsev_resubscribe(void)
+{
+	VERIFY(g_nsev_source_started);
+
+	if (g_nsev_source->nso_subscribe != NULL) {
+		g_nsev_source->nso_subscribe(nsev_classes_union());
+	}
+}
+
+/*
+ * The event header: the class, subclass, vendor and publisher names, and the
+ * publishing pid.
+ */
+const nsev_header_t *
+nsev_event_header(nsev_event_t *nev)
+{
+	return (&nev->nev_header);
+}
+
+/*
+ * The event attribute list, or NULL if the event had none.
+ */
+const nsev_flat_t *
+nsev_event_attrs(nsev_event_t *nev)
+{
+	return (nev->nev_attrs);
+}
+
+/*
+ * The packed form of the event, as described in "flat.h".
+ */
+const nsev_packed_t *
+nsev_event_packed(nsev_event_t *nev)
+{
+	return (nev->nev_packed);
+}
+
+static nsev_packed_t *
+nsev_packed_alloc(size_t sz)
+{
+	nsev_packed_buf_t *npb;
+
+	if (sizeof (*npb) + sz <= NSEV_PACKED_POOL_OBJSIZE) {
+		if ((npb = nsev_pool_alloc(g_nsev_packed_pool)) == NULL) {
+			return (NULL);
+		}
+		npb->npb_pooled = 1;
+	} else {
+		if ((npb = malloc(sizeof (*npb) + sz)) == NULL) {
+			return (NULL);
+		}
+		npb->npb_pooled = 0;
+	}
+	npb->npb_refcnt = 1;
+
+	return ((nsev_packed_t *)(npb + 1));
+}
+
+/*
+ * Take an additional reference on the packed form of the event, which keeps
+ * it valid after the event itself is freed; release it with
+ * "nsev_packed_rele()".  This allows the packed event to be exposed to
+ * Javascript without a copy.
+ */
+const nsev_packed_t *
+nsev_event_packed_hold(nsev_event_t *nev)
+{
+	nsev_packed_buf_t *npb = (nsev_packed_buf_t *)nev->nev_packed - 1;
+
+	atomic_inc_32(&npb->npb_refcnt);
+	return (nev->nev_packed);
+}
+
+/*
+ * Release a reference on a packed event.  This may be called on any thread.
+ */
+void
+nsev_packed_rele(const nsev_packed_t *npk)
+{
+	nsev_packed_buf_t *npb;
+
+	if (npk == NULL) {
+		return;
+	}
+
+	npb = (nsev_packed_buf_t *)npk - 1;
+	if (atomic_dec_32_nv(&npb->npb_refcnt) > 0) {
+		return;
+	}
+
+	if (npb->npb_pooled) {
+		nsev_pool_free(g_nsev_packed_pool, npb);
+	} else {
+		free(npb);
+	}
+}
+
+/*
+ * A subscriber callback may attach a cached representation of the event
+ * (e.g., the Javascript object built for it), so that other subscribers that
+ * receive the same event can reuse it.  The cache is discarded, by calling
+ * "fini", once the event has been passed to every subscriber in the current
+ * delivery pass; it does not live as long as the event, so that it may refer
+ * to objects which themselves hold the event.
+ */
+void *
+nsev_event_cache(nsev_event_t *nev)
+{
+	VERIFY(nsev_in_loop_thread());
+
+	return (nev->nev_cache);
+}
+
+void
+nsev_event_set_cache(nsev_event_t *nev, void *cache, nsev_cache_fini_t *fini)
+{
+	VERIFY(nsev_in_loop_thread());
+	VERIFY(nev->nev_cache == NULL);
+
+	nev->nev_cache = cache;
+	nev->nev_cache_fini = fini;
+}
+
+static void
+nsev_event_cache_clear(nsev_event_t *nev)
+{
+	if (nev->nev_cache != NULL) {
+		nev->nev_cache_fini(nev->nev_cache);
+		nev->nev_cache = NULL;
+		nev->nev_cache_fini = NULL;
+	}
+}
+
+void
+nsev_event_hold(nsev_event_t *nev)
+{
+	VERIFY(nsev_in_loop_thread());
+	VERIFY(nev->nev_refcnt > 0);
+
+	nev->nev_refcnt++;
+}
+
+void
+nsev_event_rele(nsev_event_t *nev)
+{
+	VERIFY(nsev_in_loop_thread());
+	VERIFY(nev->nev_refcnt > 0);
+
+	if (--nev->nev_refcnt > 0) {
+		return;
+	}
+
+	nsev_event_cache_clear(nev);
+	nsev_packed_rele(nev->nev_packed);
+	nsev_pool_free(g_nsev_event_pool, nev);
+}
+
+static void
+nsev_filter_event_init(nsev_filter_event_t *nfe, nsev_event_t *nev)
+{
+	nfe->nfe_class = nev->nev_header.nsh_class;
+	nfe->nfe_subclass = nev->nev_header.nsh_subclass;
+	nfe->nfe_vendor = nev->nev_header.nsh_vendor;
+	nfe->nfe_publisher = nev->nev_header.nsh_publisher;
+	nfe->nfe_attrs = nev->nev_attrs;
+}
+
+/*
+ * Account for a discarded event, described by "nfe", against each
+ * subscriber whose filter it matches.  This may be called on any thread.
+ */
+static void
+nsev_count_discard_common(const nsev_filter_event_t *nfe, int coalesced)
+{
+	node_sysevent_t *nse;
+
+	VERIFY0(pthread_rwlock_rdlock(&g_nsev_list_lock));
+	for (nse = list_head(&g_nsev_list); nse != NULL;
+	    nse = list_next(&g_nsev_list, nse)) {
+		if (nse->nse_detached ||
+		    !nsev_filter_match(nse->nse_filter, nfe)) {
+			continue;
+		}
+
+		atomic_inc_64(coalesced ? &nse->nse_coalesced :
+		    &nse->nse_dropped);
+	}
+	VERIFY0(pthread_rwlock_unlock(&g_nsev_list_lock));
+}
+
+/*
+ * Account for an event discarded by the overload policy, against each
+ * subscriber that would otherwise have received it.
+ */
+static void
+nsev_count_discard(nsev_event_t *nev, int coalesced)
+{
+	nsev_filter_event_t nfe;
+
+	atomic_inc_64(coalesced ? &g_nsev_coalesced : &g_nsev_dropped);
+
+	nsev_filter_event_init(&nfe, nev);
+	nsev_count_discard_common(&nfe, coalesced);
+}
+
+/*
+ * Account for an event discarded before it could be captured (because the
+ * event pool or the packed pool was exhausted), of which we have only the
+ * header.  Attribute filters cannot be evaluated without the flattened
+ * attributes, so subscribers that filter on attributes are not charged for
+ * it.  The module-wide count is kept by the pool that failed, so this does
+ * not add to the overload policy's count.
+ */
+static void
+nsev_count_discard_header(const nsev_header_t *nsh)
+{
+	nsev_filter_event_t nfe;
+
+	nfe.nfe_class = nsh->nsh_class;
+	nfe.nfe_subclass = nsh->nsh_subclass;
+	nfe.nfe_vendor = nsh->nsh_vendor;
+	nfe.nfe_publisher = nsh->nsh_publisher;
+	nfe.nfe_attrs = NULL;
+	nsev_count_discard_common(&nfe, 0);
+}
+
+/*
+ * Called by a producer thread to admit "nev" to the queue.
+ * Returns 0 if the event may be queued, or -1 if it must be discarded.  With
+ * the "block" policy, this waits until the event loop thread has made room.
+ * The "drop-oldest" and "coalesce" policies prefer to discard older events,
+ * which the event loop thread does in "nsev_apply_overload()"; producers
+ * only discard events themselves if the queue reaches twice its limit, so
+ * that memory stays bounded while the event loop thread is busy.
+ */
+static int
+nsev_admit(nsev_event_t *nev)
+{
+	for (;;) {
+		uint_t limit = g_nsev_queue_limit;
+		nsev_overload_t policy = g_nsev_overload;
+		uint32_t n = atomic_inc_32_nv(&g_nsev_queued);
+
+		if (limit == 0 || n <= limit) {
+			return (0);
+		}
+
+		if ((policy == NSEV_OVERLOAD_DROP_OLDEST ||
+		    policy == NSEV_OVERLOAD_COALESCE) && n <= 2 * limit) {
+			return (0);
+		}
+
+		atomic_dec_32(&g_nsev_queued);
+
+		if (policy != NSEV_OVERLOAD_BLOCK) {
+			nsev_count_discard(nev, 0);
+			return (-1);
+		}
+
+		VERIFY0(pthread_mutex_lock(&g_nsev_queue_mtx));
+		g_nsev_queue_waiters++;
+		while (!g_nsev_unblock &&
+		    g_nsev_overload == NSEV_OVERLOAD_BLOCK &&
+		    g_nsev_queue_limit != 0 &&
+		    g_nsev_queued >= g_nsev_queue_limit) {
+			(void) pthread_cond_wait(&g_nsev_queue_cv,
+			    &g_nsev_queue_mtx);
+		}
+		g_nsev_queue_waiters--;
+		if (g_nsev_unblock) {
+			VERIFY0(pthread_mutex_unlock(&g_nsev_queue_mtx));
+			nsev_count_discard(nev, 0);
+			return (-1);
+		}
+		VERIFY0(pthread_mutex_unlock(&g_nsev_queue_mtx));
+	}
+}
+
+/*
+ * Wake any producers waiting for room in the queue.
+ */
+static void
+nsev_queue_wake(void)
+{
+	VERIFY0(pthread_mutex_lock(&g_nsev_queue_mtx));
+	if (g_nsev_queue_waiters > 0) {
+		VERIFY0(pthread_cond_broadcast(&g_nsev_queue_cv));
+	}
+	VERIFY0(pthread_mutex_unlock(&g_nsev_queue_mtx));
+}
+
+/*
+ * Remove "nev" from the backlog and release it, either because it has been
+ * delivered or because it was discarded.
+ */
+static void
+nsev_backlog_remove(nsev_event_t *nev)
+{
+	list_remove(&g_nsev_backlog, nev);
+	g_nsev_backlog_len--;
+	atomic_dec_32(&g_nsev_queued);
+	nsev_event_rele(nev);
+}
+
+static uint32_t
+nsev_header_hash(const nsev_header_t *nsh)
+{
+	const char *strs[] = { nsh->nsh_class, nsh->nsh_subclass,
+	    nsh->nsh_vendor, nsh->nsh_publisher };
+	uint32_t h = 2166136261U;
+	const char *c;
+	unsigned int i;
+
+	for (i = 0; i < sizeof (strs) / sizeof (strs[0]); i++) {
+		for (c = strs[i]; *c != '\0'; c++) {
+			h = (h ^ (uint8_t)*c) * 16777619U;
+		}
+		h = (h ^ 0xff) * 16777619U;
+	}
+
+	return (h);
+}
+
+static int
+nsev_header_equal(const nsev_header_t *a, const nsev_header_t *b)
+{
+	return (strcmp(a->nsh_class, b->nsh_class) == 0 &&
+	    strcmp(a->nsh_subclass, b->nsh_subclass) == 0 &&
+	    strcmp(a->nsh_vendor, b->nsh_vendor) == 0 &&
+	    strcmp(a->nsh_publisher, b->nsh_publisher) == 0);
+}
+
+/*
+ * Discard every event in the backlog for which a newer event with the same
+ * class, subclass, vendor and publisher is also in the backlog.
+ */
+static void
+nsev_coalesce_backlog(void)
+{
+	nsev_event_t **seen;
+	nsev_event_t *nev, *prev;
+	size_t size = 1;
+	size_t i;
+
+	while (size < 2 * (size_t)g_nsev_backlog_len) {
+		size <<= 1;
+	}
+	if ((seen = calloc(size, sizeof (*seen))) == NULL) {
+		/*
+		 * The caller will fall back to discarding the oldest events.
+		 */
+		return;
+	}
+
+	for (nev = list_tail(&g_nsev_backlog); nev != NULL; nev = prev) {
+		prev = list_prev(&g_nsev_backlog, nev);
+
+		for (i = nsev_header_hash(&nev->nev_header) & (size - 1);
+		    seen[i] != NULL; i = (i + 1) & (size - 1)) {
+			if (nsev_header_equal(&seen[i]->nev_header,
+			    &nev->nev_header)) {
+				break;
+			}
+		}
+
+		if (seen[i] == NULL) {
+			seen[i] = nev;
+			continue;
+		}
+
+		nsev_count_discard(nev, 1);
+		nsev_backlog_remove(nev);
+	}
+
+	free(seen);
+}
+
+/*
+ * If the backlog is over the queue limit, apply the "drop-oldest" or
+ * "coalesce" policy to it.
+ */
+static void
+nsev_apply_overload(void)
+{
+	uint_t limit = g_nsev_queue_limit;
+	nsev_overload_t policy = g_nsev_overload;
+	nsev_event_t *nev;
+
+	if (limit == 0 || g_nsev_backlog_len <= limit) {
+		return;
+	}
+
+	if (policy == NSEV_OVERLOAD_COALESCE) {
+		nsev_coalesce_backlog();
+	}
+
+	if (policy == NSEV_OVERLOAD_COALESCE ||
+	    policy == NSEV_OVERLOAD_DROP_OLDEST) {
+		while (g_nsev_backlog_len > limit) {
+			nev = list_head(&g_nsev_backlog);
+			nsev_count_discard(nev, 0);
+			nsev_backlog_remove(nev);
+		}
+	}
+}
+
+/*
+ * Deliver "nev", standing for "count" events, to the subscriber "nse".
+ */
+static void
+nsev_deliver_one(node_sysevent_t *nse, nsev_event_t *nev, uint_t count)
+{
+	nse->nse_pending++;
+	nse->nse_delivered++;
+	nse->nse_func(nev, count, nse->nse_func_arg);
+}
+
+/*
+ * Hold "nev", standing for "count" events, for the paused subscriber "nse".
+ * If the hold ring is full, the oldest held event is discarded to make room.
+ */
+static void
+nsev_hold_event(node_sysevent_t *nse, nsev_event_t *nev, uint_t count)
+{
+	nsev_held_t *old;
+
+	if (nse->nse_hold_limit == 0) {
+		atomic_add_64(&nse->nse_dropped, count);
+		return;
+	}
+
+	if (nse->nse_hold_count == nse->nse_hold_limit) {
+		old = &nse->nse_hold[nse->nse_hold_start];
+		nse->nse_hold_start = (nse->nse_hold_start + 1) %
+		    nse->nse_hold_limit;
+		nse->nse_hold_count--;
+		atomic_add_64(&nse->nse_dropped, old->nh_count);
+		nsev_event_rele(old->nh_event);
+	}
+
+	nsev_event_hold(nev);
+	old = &nse->nse_hold[(nse->nse_hold_start + nse->nse_hold_count) %
+	    nse->nse_hold_limit];
+	old->nh_event = nev;
+	old->nh_count = count;
+	nse->nse_hold_count++;
+}
+
+/*
+ * Remove and return the oldest event held for "nse".  The caller inherits
+ * the hold on the event.
+ */
+static nsev_event_t *
+nsev_hold_take(node_sysevent_t *nse, uint_t *countp)
+{
+	nsev_held_t *nh;
+
+	if (nse->nse_hold_count == 0) {
+		return (NULL);
+	}
+
+	nh = &nse->nse_hold[nse->nse_hold_start];
+	nse->nse_hold_start = (nse->nse_hold_start + 1) % nse->nse_hold_limit;
+	nse->nse_hold_count--;
+
+	*countp = nh->nh_count;
+	return (nh->nh_event);
+}
+
+/*
+ * Deliver "nev" to "nse" now, or hold it if "nse" is paused (or still has
+ * held events to deliver, which must go first).
+ */
+static void
+nsev_deliver_or_hold(node_sysevent_t *nse, nsev_event_t *nev, uint_t count)
+{
+	if (nse->nse_paused || nse->nse_hold_count > 0) {
+		nsev_hold_event(nse, nev, count);
+	} else {
+		nsev_deliver_one(nse, nev, count);
+	}
+}
+
+static int
+nsev_key_append(nsev_coalesce_t *nc, size_t *offp, const void *data,
+    size_t len)
+{
+	if (*offp + len > nc->nc_bufsz) {
+		size_t sz = nc->nc_bufsz == 0 ? 256 : nc->nc_bufsz;
+		char *buf;
+
+		while (sz < *offp + len) {
+			sz *= 2;
+		}
+		if ((buf = realloc(nc->nc_buf, sz)) == NULL) {
+			return (-1);
+		}
+		nc->nc_buf = buf;
+		nc->nc_bufsz = sz;
+	}
+
+	bcopy(data, nc->nc_buf + *offp, len);
+	*offp += len;
+	return (0);
+}
+
+/*
+ * Build the coalescing key for "nev" in the scratch buffer: the class and
+ * subclass, then the type and value of each key attribute.  Returns -1 if a
+ * key attribute has a type that cannot be part of a key (e.g., an array), in
+ * which case the event is not coalesced.
+ */
+static int
+nsev_coalesce_key(nsev_coalesce_t *nc, nsev_event_t *nev, size_t *lenp)
+{
+	const nsev_header_t *nsh = &nev->nev_header;
+	size_t off = 0;
+	uint_t i;
+
+	if (nsev_key_append(nc, &off, nsh->nsh_class,
+	    strlen(nsh->nsh_class) + 1) != 0 ||
+	    nsev_key_append(nc, &off, nsh->nsh_subclass,
+	    strlen(nsh->nsh_subclass) + 1) != 0) {
+		return (-1);
+	}
+
+	for (i = 0; i < nc->nc_nattrs; i++) {
+		const nsev_flat_rec_t *rec = NULL;
+		int32_t type = DATA_TYPE_UNKNOWN;
+
+		if (nev->nev_attrs != NULL && (rec = nsev_flat_lookup(
+		    nev->nev_attrs, nc->nc_attrs[i])) != NULL) {
+			type = nsev_flat_type(rec);
+		}
+
+		switch (type) {
+		case DATA_TYPE_UNKNOWN:
+		case DATA_TYPE_BOOLEAN:
+			rec = NULL;
+			break;
+		case DATA_TYPE_BOOLEAN_VALUE:
+		case DATA_TYPE_BYTE:
+		case DATA_TYPE_INT8:
+		case DATA_TYPE_UINT8:
+		case DATA_TYPE_INT16:
+		case DATA_TYPE_UINT16:
+		case DATA_TYPE_INT32:
+		case DATA_TYPE_UINT32:
+		case DATA_TYPE_INT64:
+		case DATA_TYPE_UINT64:
+		case DATA_TYPE_HRTIME:
+		case DATA_TYPE_STRING:
+			break;
+		default:
+			return (-1);
+		}
+
+		/*
+		 * The flattened value of each of these types is the value
+		 * itself (or the NUL-terminated string), so it can be used
+		 * in the key as it is.
+		 */
+		if (nsev_key_append(nc, &off, &type, sizeof (type)) != 0 ||
+		    (rec != NULL && nsev_key_append(nc, &off,
+		    nsev_flat_value(rec), rec->nfr_vlen) != 0)) {
+			return (-1);
+		}
+	}
+
+	*lenp = off;
+	return (0);
+}
+
+/*
+ * Deliver (or hold) every event in the coalescing table of "nse", and empty
+ * the table.  This does not call into Javascript; the caller must arrange
+ * for the subscriber to be flushed.
+ */
+static void
+nsev_coalesce_deliver(node_sysevent_t *nse)
+{
+	nsev_coalesce_t *nc = nse->nse_coalesce;
+	nsev_coalesce_entry_t *nce;
+
+	if (nc->nc_timer_active) {
+		VERIFY0(uv_timer_stop(&nc->nc_timer));
+		nc->nc_timer_active = 0;
+	}
+
+	while ((nce = list_remove_head(&nc->nc_entries)) != NULL) {
+		if (!nse->nse_detached) {
+			nsev_deliver_or_hold(nse, nce->nce_event,
+			    nce->nce_count);
+			nsev_event_cache_clear(nce->nce_event);
+		}
+		nsev_event_rele(nce->nce_event);
+		free(nce->nce_key);
+		free(nce);
+	}
+	nc->nc_nentries = 0;
+	bzero(nc->nc_buckets, sizeof (nc->nc_buckets));
+}
+
+static void
+#if NODE_VERSION_AT_LEAST(0, 11, 0)
+nsev_coalesce_timer_cb(uv_timer_t *timer)
+#else
+nsev_coalesce_timer_cb(uv_timer_t *timer, int status _UNUSED)
+#endif
+{
+	node_sysevent_t *nse = timer->data;
+
+	VERIFY(nsev_in_loop_thread());
+
+	nse->nse_coalesce->nc_timer_active = 0;
+
+	g_nsev_walkers++;
+	nsev_coalesce_deliver(nse);
+	if (!nse->nse_detached && nse->nse_pending > 0) {
+		nse->nse_pending = 0;
+		nse->nse_flush(nse->nse_func_arg);
+	}
+	g_nsev_walkers--;
+
+	nsev_reap();
+}
+
+/*
+ * Add "nev" to the coalescing table of "nse".  Returns -1 if the event cannot
+ * be coalesced, in which case the caller should deliver it directly.
+ */
+static int
+nsev_coalesce_add(node_sysevent_t *nse, nsev_event_t *nev)
+{
+	nsev_coalesce_t *nc = nse->nse_coalesce;
+	nsev_coalesce_entry_t *nce;
+	uint32_t h = 2166136261U;
+	size_t len, i;
+
+	if (nsev_coalesce_key(nc, nev, &len) != 0) {
+		return (-1);
+	}
+	for (i = 0; i < len; i++) {
+		h = (h ^ (uint8_t)nc->nc_buf[i]) * 16777619U;
+	}
+
+	for (nce = nc->nc_buckets[h % NSEV_COALESCE_BUCKETS]; nce != NULL;
+	    nce = nce->nce_next) {
+		if (nce->nce_hash == h && nce->nce_keylen == len &&
+		    bcmp(nce->nce_key, nc->nc_buf, len) == 0) {
+			/*
+			 * Keep the latest event for this key.
+			 */
+			nsev_event_hold(nev);
+			nsev_event_rele(nce->nce_event);
+			nce->nce_event = nev;
+			nce->nce_count++;
+			atomic_inc_64(&nse->nse_coalesced);
+			return (0);
+		}
+	}
+
+	if (nc->nc_nentries >= NSEV_COALESCE_MAX) {
+		nsev_coalesce_deliver(nse);
+	}
+
+	if ((nce = malloc(sizeof (*nce))) == NULL) {
+		return (-1);
+	}
+	if ((nce->nce_key = malloc(len)) == NULL) {
+		free(nce);
+		return (-1);
+	}
+	bcopy(nc->nc_buf, nce->nce_key, len);
+	nce->nce_keylen = len;
+	nce->nce_hash = h;
+	nce->nce_count = 1;
+	nsev_event_hold(nev);
+	nce->nce_event = nev;
+
+	nce->nce_next = nc->nc_buckets[h % NSEV_COALESCE_BUCKETS];
+	nc->nc_buckets[h % NSEV_COALESCE_BUCKETS] = nce;
+	list_insert_tail(&nc->nc_entries, nce);
+	nc->nc_nentries++;
+
+	if (!nc->nc_timer_active) {
+		VERIFY0(uv_timer_start(&nc->nc_timer, nsev_coalesce_timer_cb,
+		    nc->nc_window, 0));
+		nc->nc_timer_active = 1;
+	}
+
+	return (0);
+}
+
+/*
+ * Create the coalescing state described by the "coalesce" option.  Returns
+ * -1 with errno set on failure.
+ *
+ *	window		uint32: the window, in milliseconds
+ *	attributes	string array: the names of the key attributes
+ */
+static int
+nsev_coalesce_create(node_sysevent_t *nse, nvlist_t *opts)
+{
+	nsev_coalesce_t *nc;
+	int e;
+
+	if ((nc = calloc(1, sizeof (*nc))) == NULL) {
+		errno = ENOMEM;
+		return (-1);
+	}
+	if ((e = nvlist_dup(opts, &nc->nc_opts, 0)) != 0) {
+		free(nc);
+		errno = e;
+		return (-1);
+	}
+
+	nc->nc_window = NSEV_COALESCE_WINDOW_DEFAULT;
+	(void) nvlist_lookup_uint32(nc->nc_opts, "window", &nc->nc_window);
+	if (nvlist_lookup_string_array(nc->nc_opts, "attributes",
+	    &nc->nc_attrs, &nc->nc_nattrs) != 0) {
+		nc->nc_attrs = NULL;
+		nc->nc_nattrs = 0;
+	}
+
+	list_create(&nc->nc_entries, sizeof (nsev_coalesce_entry_t),
+	    offsetof(nsev_coalesce_entry_t, nce_node));
+
+	VERIFY0(uv_timer_init(uv_default_loop(), &nc->nc_timer));
+	nc->nc_timer.data = nse;
+	uv_unref((uv_handle_t *)&nc->nc_timer);
+
+	nse->nse_coalesce = nc;
+	return (0);
+}
+
+/*
+ * Discard any events in the coalescing table without delivering them.
+ */
+static void
+nsev_coalesce_discard(nsev_coalesce_t *nc)
+{
+	nsev_coalesce_entry_t *nce;
+
+	if (nc == NULL) {
+		return;
+	}
+
+	if (nc->nc_timer_active) {
+		VERIFY0(uv_timer_stop(&nc->nc_timer));
+		nc->nc_timer_active = 0;
+	}
+
+	while ((nce = list_remove_head(&nc->nc_entries)) != NULL) {
+		nsev_event_rele(nce->nce_event);
+		free(nce->nce_key);
+		free(nce);
+	}
+	nc->nc_nentries = 0;
+	bzero(nc->nc_buckets, sizeof (nc->nc_buckets));
+}
+
+static void
+nsev_coalesce_close_cb(uv_handle_t *handle)
+{
+	nsev_coalesce_t *nc = (nsev_coalesce_t *)((char *)handle -
+	    offsetof(nsev_coalesce_t, nc_timer));
+
+	list_destroy(&nc->nc_entries);
+	nvlist_free(nc->nc_opts);
+	free(nc->nc_buf);
+	free(nc);
+}
+
+/*
+ * Free the coalescing state.  The timer handle must be closed before its
+ * memory is freed, which libuv completes asynchronously.
+ */
+static void
+nsev_coalesce_destroy(nsev_coalesce_t *nc)
+{
+	if (nc == NULL) {
+		return;
+	}
+
+	nsev_coalesce_discard(nc);
+	nc->nc_timer.data = NULL;
+	uv_close((uv_handle_t *)&nc->nc_timer, nsev_coalesce_close_cb);
+}
+
+/*
+ * Under the "block" policy with a queue limit, an event that would have to
+ * be discarded by a paused subscriber's full hold ring is instead left in the
+ * backlog until that subscriber resumes; the backlog then fills, and the
+ * producers wait for room.  Without a queue limit, nothing would push back on
+ * the producers, so the backlog (and delivery to every other subscriber)
+ * would stall without bound; the hold ring discards its oldest event instead,
+ * as under the other policies.
+ */
+static int
+nsev_blocked(nsev_event_t *nev)
+{
+	nsev_filter_event_t nfe;
+	node_sysevent_t *nse;
+
+	if (g_nsev_overload != NSEV_OVERLOAD_BLOCK ||
+	    g_nsev_queue_limit == 0) {
+		return (0);
+	}
+
+	nsev_filter_event_init(&nfe, nev);
+
+	for (nse = list_head(&g_nsev_list); nse != NULL;
+	    nse = list_next(&g_nsev_list, nse)) {
+		if (!nse->nse_detached && nse->nse_paused &&
+		    nse->nse_hold_count == nse->nse_hold_limit &&
+		    nsev_filter_match(nse->nse_filter, &nfe)) {
+			return (1);
+		}
+	}
+
+	return (0);
+}
+
 /*
- * C++ registers subscribing functions to be invoked in the event-loop thread,
- * and we track them in a list of "node_sysevent_t" objects:
+ * Pass "nev" to every subscriber whose filter it matches; paused subscribers
+ * (and those with events still held from a pause) hold it instead, and
+ * subscribers with a coalescing window add it to their table.
  */
-struct node_sysevent {
-	nsev_callback_t *nse_func;
-	void *nse_func_arg;
-	list_node_t nse_node;
-};
+static void
+nsev_fanout(nsev_event_t *nev)
+{
+	nsev_filter_event_t nfe;
+	node_sysevent_t *nse;
+
+	nsev_filter_event_init(&nfe, nev);
+
+	g_nsev_walkers++;
+	for (nse = list_head(&g_nsev_list); nse != NULL;
+	    nse = list_next(&g_nsev_list, nse)) {
+		if (nse->nse_detached ||
+		    !nsev_filter_match(nse->nse_filter, &nfe)) {
+			continue;
+		}
+
+		if (nse->nse_coalesce != NULL &&
+		    nsev_coalesce_add(nse, nev) == 0) {
+			continue;
+		}
+
+		nsev_deliver_or_hold(nse, nev, 1);
+	}
+	g_nsev_walkers--;
+
+	nsev_event_cache_clear(nev);
+	nsev_reap();
+}
 
 /*
- * Global state:
+ * This function executes on the eventloop thread via "crossthread_post()".
+ * The event joins the backlog, and is delivered by "nsev_drain()" at the end
+ * of the batch.
  */
-sysevent_handle_t *g_nsev_handle;
-list_t g_nsev_list;
-static pthread_t g_nsev_loop_thread;
-static int g_nsev_init_done = 0;
+static void
+nsev_enqueue(void *arg0, void *arg1 _UNUSED)
+{
+	nsev_event_t *nev = arg0;
 
+	VERIFY(nsev_in_loop_thread());
 
-static int
-nsev_in_loop_thread(void)
-{
-	return (g_nsev_loop_thread == pthread_self());
+	list_insert_tail(&g_nsev_backlog, nev);
+	g_nsev_backlog_len++;
 }
 
 /*
- * This function executes on the eventloop thread via "crossthread_invoke()".
+ * This function executes on the eventloop thread once each batch of events
+ * queued by "nsev_produce()" has been passed to "nsev_enqueue()", and when
+ * "nsev_resume()" or "nsev_detach()" ask for a drain.  Events held for
+ * subscribers that have resumed are delivered first.  Then the overload
+ * policy is applied to the backlog, and the remaining events are delivered.
+ * Finally, each subscriber that received events is flushed.  Only the flush
+ * calls into Javascript, so subscribers cannot pause or resume during the
+ * earlier steps.
  */
 static void
-nsev_deliver(void *arg0, void *arg1)
+nsev_drain(void)
 {
-	nvlist_t *nvl0 = arg0;
-	nvlist_t *nvl1 = arg1;
 	node_sysevent_t *nse;
+	nsev_event_t *nev;
+	uint_t count;
 
 	VERIFY(nsev_in_loop_thread());
 
+	g_nsev_walkers++;
+	for (nse = list_head(&g_nsev_list); nse != NULL;
+	    nse = list_next(&g_nsev_list, nse)) {
+		if (nse->nse_detached || nse->nse_paused) {
+			continue;
+		}
+
+		while ((nev = nsev_hold_take(nse, &count)) != NULL) {
+			nsev_deliver_one(nse, nev, count);
+			nsev_event_cache_clear(nev);
+			nsev_event_rele(nev);
+		}
+	}
+	g_nsev_walkers--;
+
+	nsev_apply_overload();
+
+	while ((nev = list_head(&g_nsev_backlog)) != NULL &&
+	    !nsev_blocked(nev)) {
+		nsev_fanout(nev);
+		nsev_backlog_remove(nev);
+	}
+	nsev_queue_wake();
+
+	g_nsev_walkers++;
 	for (nse = list_head(&g_nsev_list); nse != NULL;
 	    nse = list_next(&g_nsev_list, nse)) {
-		nse->nse_func(nvl0, nvl1, nse->nse_func_arg);
+		if (nse->nse_detached || nse->nse_pending == 0) {
+			continue;
+		}
+
+		nse->nse_pending = 0;
+		nse->nse_flush(nse->nse_func_arg);
+	}
+	g_nsev_walkers--;
+
+	nsev_reap();
+}
+
+/*
+ * Copy the string "src" into the buffer "dst" of "len" bytes, truncating if
+ * necessary.  A NULL "src" is treated as an empty string.
+ */
+static void
+nsev_copy_name(char *dst, const char *src, size_t len)
+{
+	size_t i;
+
+	for (i = 0; src != NULL && src[i] != '\0' && i < len - 1; i++) {
+		dst[i] = src[i];
+	}
+	dst[i] = '\0';
+}
+
+/*
+ * Build the packed form of "nev", from its header and the attribute list
+ * "nvl" (which may be NULL).  Returns -1 if memory cannot be allocated.
+ */
+static int
+nsev_event_pack(nsev_event_t *nev, nvlist_t *nvl)
+{
+	const nsev_header_t *nsh = &nev->nev_header;
+	const char *names[] = { nsh->nsh_class, nsh->nsh_subclass,
+	    nsh->nsh_vendor, nsh->nsh_publisher };
+	nsev_packed_t *npk;
+	size_t sz;
+
+	if ((sz = nsev_packed_size(names, nvl)) > UINT32_MAX ||
+	    (npk = nsev_packed_alloc(sz)) == NULL) {
+		return (-1);
 	}
+	nsev_packed_fill(npk, sz, names, nsh->nsh_pid,
+	    nsh->nsh_kernel ? NSEV_PACKED_F_KERNEL : 0, nvl);
+
+	nev->nev_packed = npk;
+	nev->nev_attrs = nsev_packed_attrs(npk);
+
+	return (0);
 }
 
 /*
- * This function executes in a delivery thread within the thread pool managed
- * by libsysevent.
+ * Append the packed event "npk" to the journal, if there is one.  This is
+ * called on the delivery threads.
  */
 static void
-nsev_handler(sysevent_t *ev)
+nsev_journal_event(const nsev_packed_t *npk)
+{
+	VERIFY0(pthread_rwlock_rdlock(&g_nsev_journal_lock));
+	if (g_nsev_journal != NULL) {
+		if (nsev_journal_append(g_nsev_journal, npk) == 0) {
+			atomic_inc_64(&g_nsev_journal_appended);
+		} else {
+			atomic_inc_64(&g_nsev_journal_errors);
+		}
+	}
+	VERIFY0(pthread_rwlock_unlock(&g_nsev_journal_lock));
+}
+
+/*
+ * Pass a newly built event to the event loop thread, subject to the overload
+ * policy.  Returns -1 if the event was discarded instead, in which case it
+ * has been freed.
+ */
+static int
+nsev_submit(nsev_event_t *nev)
+{
+	if (nsev_admit(nev) != 0) {
+		nsev_packed_rele(nev->nev_packed);
+		nsev_pool_free(g_nsev_event_pool, nev);
+		return (-1);
+	}
+
+	if (crossthread_post(nsev_enqueue, NULL, nev, NULL) != 0) {
+		/*
+		 * We could not queue the event for delivery, so it must be
+		 * dropped.
+		 */
+		atomic_dec_32(&g_nsev_queued);
+		nsev_packed_rele(nev->nev_packed);
+		nsev_pool_free(g_nsev_event_pool, nev);
+		return (-1);
+	}
+
+	return (0);
+}
+
+/*
+ * Called by an event source (see "source.h") on one of its own threads, for
+ * each event it produces.  The event header is copied into the fixed-size
+ * header of an "nsev_event_t", the event is packed along with the attribute
+ * list "nvl" (which may be NULL, and remains owned by the caller), and
+ * ownership of the event is passed to the event loop thread, so the source
+ * does not wait for Javascript to run.
+ */
+void
+nsev_produce(const char *class, const char *subclass, const char *vendor,
+    const char *publisher, int32_t pid, int kernel, nvlist_t *nvl)
 {
-	nvlist_t *nvl0;
-	nvlist_t *nvl1 = NULL;
-	pid_t evpid;
+	nsev_event_t *nev;
+	nsev_header_t hdr;
 
 	VERIFY(!nsev_in_loop_thread());
 
+	nsev_copy_name(hdr.nsh_class, class, sizeof (hdr.nsh_class));
+	nsev_copy_name(hdr.nsh_subclass, subclass, sizeof (hdr.nsh_subclass));
+	nsev_copy_name(hdr.nsh_vendor, vendor, sizeof (hdr.nsh_vendor));
+	nsev_copy_name(hdr.nsh_publisher, publisher,
+	    sizeof (hdr.nsh_publisher));
+	hdr.nsh_pid = pid;
+	hdr.nsh_kernel = kernel;
+
+	if ((nev = nsev_pool_alloc(g_nsev_event_pool)) == NULL) {
+		/*
+		 * The pool is exhausted (or we are out of memory), so the
+		 * event must be dropped, unjournaled: packing it for the
+		 * journal would need memory we do not have.
+		 */
+		nsev_count_discard_header(&hdr);
+		return;
+	}
+	nev->nev_header = hdr;
+
+	nev->nev_cache = NULL;
+	nev->nev_cache_fini = NULL;
+
+	/*
+	 * Pack the event here, off the event loop thread.  An event that
+	 * cannot be packed must be dropped, as one that could not be
+	 * allocated is above.
+	 */
+	nev->nev_packed = NULL;
+	nev->nev_attrs = NULL;
+	if (nsev_event_pack(nev, nvl) != 0) {
+		nsev_count_discard_header(&hdr);
+		nsev_pool_free(g_nsev_event_pool, nev);
+		return;
+	}
+	nev->nev_refcnt = 1;
+
 	/*
-	 * Construct an nvlist_t that describes the event.
+	 * Journal every event we capture, before the overload policy has a
+	 * chance to discard it.  Events dropped above, because they could not
+	 * be captured at all, are counted but not journaled.
 	 */
-	VERIFY0(nvlist_alloc(&nvl0, NV_UNIQUE_NAME, 0));
-	VERIFY0(nvlist_add_string(nvl0, "class_name",
-	    sysevent_get_class_name(ev)));
-	VERIFY0(nvlist_add_string(nvl0, "subclass_name",
-	    sysevent_get_subclass_name(ev)));
-	VERIFY0(nvlist_add_string(nvl0, "vendor_name",
-	    sysevent_get_vendor_name(ev)));
-	VERIFY0(nvlist_add_string(nvl0, "publisher_name",
-	    sysevent_get_pub_name(ev)));
+	nsev_journal_event(nev->nev_packed);
+
+	(void) nsev_submit(nev);
+}
+
+/*
+ * Feed the packed event "npk", of "len" bytes, into the delivery path as if
+ * it had just been produced by the event source.  This is how recorded
+ * events are replayed (see "replay.c"), and is called on a thread other than
+ * the event loop thread, as it may block in "nsev_admit()".  Injected events
+ * are not journaled.  Returns -1 with EINVAL if "npk" is not a valid packed
+ * event (including one with nvlists nested more than NSEV_FLAT_MAXDEPTH
+ * deep), ENOMEM if it cannot be copied, or EAGAIN if it was discarded by the
+ * overload policy.
+ */
+int
+nsev_inject(const nsev_packed_t *npk, size_t len)
+{
+	nsev_event_t *nev;
+	nsev_header_t *nsh;
+	const char *str;
+
+	VERIFY(!nsev_in_loop_thread());
 
-	sysevent_get_pid(ev, &evpid);
-	VERIFY0(nvlist_add_string(nvl0, "source",
-	    (evpid == SE_KERN_PID) ? "kernel" : "user"));
-	VERIFY0(nvlist_add_int32(nvl0, "pid", evpid));
+	if (len < sizeof (*npk) || len > UINT32_MAX) {
+		errno = EINVAL;
+		return (-1);
+	}
+
+	if ((nev = nsev_pool_alloc(g_nsev_event_pool)) == NULL) {
+		errno = ENOMEM;
+		return (-1);
+	}
+	if ((nev->nev_packed = nsev_packed_alloc(len)) == NULL) {
+		nsev_pool_free(g_nsev_event_pool, nev);
+		errno = ENOMEM;
+		return (-1);
+	}
 
-	if (sysevent_get_attr_list(ev, &nvl1) != 0) {
-		nvl1 = NULL;
+	/*
+	 * The source may be a journal that is still being written, so the
+	 * copy is checked rather than the original.
+	 */
+	bcopy(npk, nev->nev_packed, len);
+	if (nsev_packed_check(nev->nev_packed, len) != 0) {
+		nsev_packed_rele(nev->nev_packed);
+		nsev_pool_free(g_nsev_event_pool, nev);
+		errno = EINVAL;
+		return (-1);
 	}
 
-	VERIFY0(crossthread_invoke(nsev_deliver, nvl0, nvl1));
+	/*
+	 * The four names follow the packed header, in header order.
+	 */
+	nsh = &nev->nev_header;
+	str = (const char *)(nev->nev_packed + 1);
+	nsev_copy_name(nsh->nsh_class, str, sizeof (nsh->nsh_class));
+	str += strlen(str) + 1;
+	nsev_copy_name(nsh->nsh_subclass, str, sizeof (nsh->nsh_subclass));
+	str += strlen(str) + 1;
+	nsev_copy_name(nsh->nsh_vendor, str, sizeof (nsh->nsh_vendor));
+	str += strlen(str) + 1;
+	nsev_copy_name(nsh->nsh_publisher, str, sizeof (nsh->nsh_publisher));
+
+	nsh->nsh_pid = nev->nev_packed->npk_pid;
+	nsh->nsh_kernel = (nev->nev_packed->npk_flags &
+	    NSEV_PACKED_F_KERNEL) != 0;
+
+	nev->nev_attrs = nsev_packed_attrs(nev->nev_packed);
+	nev->nev_cache = NULL;
+	nev->nev_cache_fini = NULL;
+	nev->nev_refcnt = 1;
+
+	if (nsev_submit(nev) != 0) {
+		errno = EAGAIN;
+		return (-1);
+	}
 
-	nvlist_free(nvl0);
-	nvlist_free(nvl1);
+	return (0);
 }
 
 int
@@ -128,60 +1609,393 @@ nsev_init(void)
 
 	list_create(&g_nsev_list, sizeof (node_sysevent_t),
 	    offsetof(node_sysevent_t, nse_node));
+	list_create(&g_nsev_backlog, sizeof (nsev_event_t),
+	    offsetof(nsev_event_t, nev_node));
+	VERIFY0(pthread_rwlock_init(&g_nsev_list_lock, NULL));
+	VERIFY0(pthread_rwlock_init(&g_nsev_journal_lock, NULL));
+	VERIFY0(pthread_mutex_init(&g_nsev_queue_mtx, NULL));
+	VERIFY0(pthread_cond_init(&g_nsev_queue_cv, NULL));
+
+	crossthread_set_drain_func(nsev_drain);
+
+	VERIFY0(uv_timer_init(uv_default_loop(), &g_nsev_journal_timer));
+	uv_unref((uv_handle_t *)&g_nsev_journal_timer);
+
+	VERIFY((g_nsev_event_pool = nsev_pool_create(sizeof (nsev_event_t),
+	    NSEV_POOL_DEFAULT_SIZE, NSEV_POOL_MALLOC)) != NULL);
+	VERIFY((g_nsev_packed_pool = nsev_pool_create(
+	    NSEV_PACKED_POOL_OBJSIZE, NSEV_POOL_DEFAULT_SIZE,
+	    NSEV_POOL_MALLOC)) != NULL);
+
+	return (0);
+}
+
+/*
+ * Resize the pools from which in-flight events are allocated: up to "size"
+ * events may be in flight before "policy" applies.  The pools are only
+ * replaced when no producer thread can be using them, so this fails with
+ * EBUSY if there are any subscribers, or any events still in flight.  Packed
+ * events still referred to by a Javascript Buffer count as in flight.
+ */
+int
+nsev_configure_pool(uint_t size, nsev_pool_policy_t policy)
+{
+	nsev_pool_stats_t nps, npps;
+	nsev_pool_t *np, *npp;
+
+	VERIFY(nsev_in_loop_thread());
+
+	nsev_pool_stats(g_nsev_event_pool, &nps);
+	nsev_pool_stats(g_nsev_packed_pool, &npps);
+	if (g_nsev_nactive > 0 || nps.nps_inuse > 0 || npps.nps_inuse > 0) {
+		errno = EBUSY;
+		return (-1);
+	}
+
+	if ((np = nsev_pool_create(sizeof (nsev_event_t), size,
+	    policy)) == NULL) {
+		errno = ENOMEM;
+		return (-1);
+	}
+	if ((npp = nsev_pool_create(NSEV_PACKED_POOL_OBJSIZE, size,
+	    policy)) == NULL) {
+		nsev_pool_destroy(np);
+		errno = ENOMEM;
+		return (-1);
+	}
+
+	if (crossthread_configure(size, policy) != 0) {
+		int e = errno;
+
+		nsev_pool_destroy(np);
+		nsev_pool_destroy(npp);
+		errno = e;
+		return (-1);
+	}
+
+	nsev_pool_destroy(g_nsev_event_pool);
+	g_nsev_event_pool = np;
+	nsev_pool_destroy(g_nsev_packed_pool);
+	g_nsev_packed_pool = npp;
+	return (0);
+}
+
+/*
+ * Set the queue limit and overload policy.  A "limit" of zero means the
+ * queue is unbounded.  This may be changed at any time.
+ */
+void
+nsev_configure_queue(uint_t limit, nsev_overload_t policy)
+{
+	VERIFY(nsev_in_loop_thread());
+	VERIFY(policy == NSEV_OVERLOAD_BLOCK ||
+	    policy == NSEV_OVERLOAD_DROP_NEWEST ||
+	    policy == NSEV_OVERLOAD_DROP_OLDEST ||
+	    policy == NSEV_OVERLOAD_COALESCE);
+
+	VERIFY0(pthread_mutex_lock(&g_nsev_queue_mtx));
+	g_nsev_queue_limit = limit;
+	g_nsev_overload = policy;
+	VERIFY0(pthread_cond_broadcast(&g_nsev_queue_cv));
+	VERIFY0(pthread_mutex_unlock(&g_nsev_queue_mtx));
+}
+
+void
+nsev_queue_report(nsev_queue_stats_t *nqs)
+{
+	VERIFY(nsev_in_loop_thread());
+
+	nqs->nqs_queued = g_nsev_queued;
+	nqs->nqs_limit = g_nsev_queue_limit;
+	nqs->nqs_dropped = g_nsev_dropped;
+	nqs->nqs_coalesced = g_nsev_coalesced;
+}
+
+static void
+#if NODE_VERSION_AT_LEAST(0, 11, 0)
+nsev_journal_timer_cb(uv_timer_t *timer _UNUSED)
+#else
+nsev_journal_timer_cb(uv_timer_t *timer _UNUSED, int status _UNUSED)
+#endif
+{
+	if (g_nsev_journal != NULL) {
+		nsev_journal_sync(g_nsev_journal, 0);
+	}
+}
+
+/*
+ * Start journaling events to the file at "path", with a record area of
+ * "size" bytes, scheduling a sync of the file every "sync" milliseconds (or
+ * never, if "sync" is 0).  If "path" is NULL, stop journaling.  Any journal
+ * already open is synced and closed.
+ */
+int
+nsev_configure_journal(const char *path, uint64_t size, uint_t sync)
+{
+	nsev_journal_t *nj = NULL, *old;
+
+	VERIFY(nsev_in_loop_thread());
+
+	if (path != NULL && nsev_journal_open(path, size, &nj) != 0) {
+		return (-1);
+	}
+
+	VERIFY0(pthread_rwlock_wrlock(&g_nsev_journal_lock));
+	old = g_nsev_journal;
+	g_nsev_journal = nj;
+	VERIFY0(pthread_rwlock_unlock(&g_nsev_journal_lock));
+
+	nsev_journal_close(old);
+
+	VERIFY0(uv_timer_stop(&g_nsev_journal_timer));
+	if (nj != NULL && sync > 0) {
+		VERIFY0(uv_timer_start(&g_nsev_journal_timer,
+		    nsev_journal_timer_cb, sync, sync));
+	}
+
+	return (0);
+}
+
+void
+nsev_journal_report(nsev_journal_stats_t *njs)
+{
+	VERIFY(nsev_in_loop_thread());
+
+	njs->njs_appended = g_nsev_journal_appended;
+	njs->njs_errors = g_nsev_journal_errors;
+}
+
+/*
+ * Choose where events come from; see "source.h".  The source is started when
+ * the first subscriber attaches, so it can only be changed while there are
+ * no subscribers; this fails with EBUSY otherwise.
+ */
+int
+nsev_configure_source(const nsev_source_ops_t *source)
+{
+	VERIFY(nsev_in_loop_thread());
+
+	if (g_nsev_nactive > 0) {
+		errno = EBUSY;
+		return (-1);
+	}
 
+	g_nsev_source = source;
 	return (0);
 }
 
+/*
+ * Report the delivery counters for the subscriber "nse".
+ */
+void
+nsev_stats(node_sysevent_t *nse, nsev_stats_t *nss)
+{
+	VERIFY(nsev_in_loop_thread());
+
+	nss->nss_delivered = nse->nse_delivered;
+	nss->nss_dropped = nse->nse_dropped;
+	nss->nss_coalesced = nse->nse_coalesced;
+	nss->nss_held = nse->nse_hold_count;
+}
+
+/*
+ * Report on the pools used for in-flight events.  Events that could not be
+ * allocated, or not handed to the event loop thread, were dropped.
+ */
+void
+nsev_pool_report(nsev_pool_stats_t *events, nsev_pool_stats_t *packed,
+    nsev_pool_stats_t *calls)
+{
+	VERIFY(nsev_in_loop_thread());
+
+	nsev_pool_stats(g_nsev_event_pool, events);
+	nsev_pool_stats(g_nsev_packed_pool, packed);
+	crossthread_pool_stats(calls);
+}
+
+/*
+ * Attach a new subscriber.  The "opts" nvlist describes the events the
+ * subscriber wants; see "filter.c" for the options.  The event source is
+ * started for the first subscriber, and is told the union of the classes
+ * wanted by all active subscribers.  Returns -1 with errno set on failure.
+ */
 int
-nsev_attach(nsev_callback_t *nsecb, void *arg, node_sysevent_t **nsep)
+nsev_attach(nsev_callback_t *nsecb, nsev_flush_t *nseflush, nvlist_t *opts,
+    void *arg, node_sysevent_t **nsep)
 {
 	node_sysevent_t *nse;
+	nvlist_t *classes, *coalesce;
+	int e;
 
 	VERIFY(nsev_in_loop_thread());
 
 	*nsep = NULL;
 
 	if ((nse = calloc(1, sizeof (*nse))) == NULL) {
+		errno = ENOMEM;
 		return (-1);
 	}
 
 	nse->nse_func = nsecb;
+	nse->nse_flush = nseflush;
 	nse->nse_func_arg = arg;
 
-	if (list_is_empty(&g_nsev_list)) {
-		const char *subclasses[] = {
-			EC_SUB_ALL,
-			NULL
-		};
-		VERIFY(g_nsev_handle == NULL);
-		VERIFY((g_nsev_handle = sysevent_bind_handle(
-		    nsev_handler)) != NULL);
-		VERIFY0(sysevent_subscribe_event(g_nsev_handle,
-		    EC_ALL, subclasses, 1));
+	nse->nse_hold_limit = NSEV_HOLD_DEFAULT;
+	if (opts != NULL) {
+		(void) nvlist_lookup_uint32(opts, "holdLimit",
+		    &nse->nse_hold_limit);
+	}
+	if (nse->nse_hold_limit > 0 && (nse->nse_hold = calloc(
+	    nse->nse_hold_limit, sizeof (nsev_held_t))) == NULL) {
+		free(nse);
+		errno = ENOMEM;
+		return (-1);
+	}
+
+	if (opts != NULL && nvlist_lookup_nvlist(opts, "coalesce",
+	    &coalesce) == 0 && nsev_coalesce_create(nse, coalesce) != 0) {
+		e = errno;
+		free(nse->nse_hold);
+		free(nse);
+		errno = e;
+		return (-1);
+	}
+
+	if (nsev_filter_compile(opts, &nse->nse_filter) != 0) {
+		e = errno;
+		nsev_coalesce_destroy(nse->nse_coalesce);
+		free(nse->nse_hold);
+		free(nse);
+		errno = e;
+		return (-1);
+	}
+
+	if (opts != NULL && nvlist_lookup_nvlist(opts, "classes",
+	    &classes) == 0 && (e = nvlist_dup(classes, &nse->nse_classes,
+	    0)) != 0) {
+		nsev_filter_free(nse->nse_filter);
+		nsev_coalesce_destroy(nse->nse_coalesce);
+		free(nse->nse_hold);
+		free(nse);
+		errno = e;
+		return (-1);
+	}
+
+	if (g_nsev_nactive == 0) {
+		VERIFY(!g_nsev_source_started);
+		if (g_nsev_source->nso_start != NULL &&
+		    g_nsev_source->nso_start() != 0) {
+			e = errno;
+			nvlist_free(nse->nse_classes);
+			nsev_filter_free(nse->nse_filter);
+			nsev_coalesce_destroy(nse->nse_coalesce);
+			free(nse->nse_hold);
+			free(nse);
+			errno = e;
+			return (-1);
+		}
+		g_nsev_source_started = 1;
 	}
+	VERIFY0(pthread_rwlock_wrlock(&g_nsev_list_lock));
 	list_insert_tail(&g_nsev_list, nse);
+	VERIFY0(pthread_rwlock_unlock(&g_nsev_list_lock));
+	g_nsev_nactive++;
+
+	nsev_resubscribe();
 
 	*nsep = nse;
 	return (0);
 }
 
+/*
+ * Stop passing events to "nse_func" for this subscriber; they are held in
+ * its hold ring until "nsev_resume()" is called.
+ */
+void
+nsev_pause(node_sysevent_t *nse)
+{
+	VERIFY(nsev_in_loop_thread());
+	VERIFY(!nse->nse_detached);
+
+	nse->nse_paused = 1;
+}
+
+/*
+ * Resume delivery to this subscriber.  Held events are delivered, in order,
+ * by the next drain, which is scheduled here rather than run directly:
+ * this is called from Javascript, which may itself be running within the
+ * subscriber's flush callback.
+ */
+void
+nsev_resume(node_sysevent_t *nse)
+{
+	VERIFY(nsev_in_loop_thread());
+	VERIFY(!nse->nse_detached);
+
+	if (!nse->nse_paused) {
+		return;
+	}
+	nse->nse_paused = 0;
+
+	if (nse->nse_hold_count > 0 || !list_is_empty(&g_nsev_backlog)) {
+		crossthread_wake();
+	}
+}
+
 void
 nsev_detach(node_sysevent_t *nse)
 {
+	nsev_event_t *nev;
+	uint_t count;
+
 	VERIFY(nsev_in_loop_thread());
 
 	if (nse == NULL) {
 		return;
 	}
 
+	nsev_coalesce_discard(nse->nse_coalesce);
+	while ((nev = nsev_hold_take(nse, &count)) != NULL) {
+		nsev_event_rele(nev);
+	}
+
 	VERIFY(list_link_active(&nse->nse_node));
-	list_remove(&g_nsev_list, nse);
+	VERIFY(!nse->nse_detached);
+	VERIFY0(pthread_rwlock_wrlock(&g_nsev_list_lock));
+	nse->nse_detached = 1;
+	VERIFY0(pthread_rwlock_unlock(&g_nsev_list_lock));
+
+	VERIFY(g_nsev_nactive > 0);
+	if (--g_nsev_nactive > 0) {
+		nsev_resubscribe();
+	} else {
+		/*
+		 * Stopping the source waits for its producer threads, which
+		 * may be waiting for us to make room in the queue.  Tell them
+		 * to give up while the source stops.
+		 */
+		VERIFY0(pthread_mutex_lock(&g_nsev_queue_mtx));
+		g_nsev_unblock = 1;
+		VERIFY0(pthread_cond_broadcast(&g_nsev_queue_cv));
+		VERIFY0(pthread_mutex_unlock(&g_nsev_queue_mtx));
+
+		if (g_nsev_source->nso_stop != NULL) {
+			g_nsev_source->nso_stop();
+		}
+		g_nsev_source_started = 0;
+
+		VERIFY0(pthread_mutex_lock(&g_nsev_queue_mtx));
+		g_nsev_unblock = 0;
+		VERIFY0(pthread_mutex_unlock(&g_nsev_queue_mtx));
+	}
 
-	if (list_is_empty(&g_nsev_list)) {
-		sysevent_unsubscribe_event(g_nsev_handle, EC_ALL);
-		sysevent_unbind_handle(g_nsev_handle);
-		g_nsev_handle = NULL;
+	if (!list_is_empty(&g_nsev_backlog)) {
+		/*
+		 * Events in the backlog may have been waiting for this
+		 * subscriber to resume.
+		 */
+		crossthread_wake();
 	}
 
-	free(nse);
+	nsev_reap();
 }
@@ -28,18 +28,116 @@
 
 #include <libnvpair.h>
 
+#include "flat.h"
+#include "pool.h"
+
 #ifdef	__cplusplus
 extern "C" {
 #endif
 
 typedef struct node_sysevent node_sysevent_t;
+typedef struct nsev_event nsev_event_t;
 
-typedef void (nsev_callback_t)(nvlist_t *, nvlist_t *, void *);
+/*
+ * Sizes of the name buffers in the event header.  These match the limits
+ * libsysevent places on class, subclass and publisher names; longer names
+ * are truncated.
+ */
+#define	NSEV_CLASS_LEN		64
+#define	NSEV_SUBCLASS_LEN	64
+#define	NSEV_VENDOR_LEN		64
+#define	NSEV_PUBLISHER_LEN	128
+
+/*
+ * The fixed part of every event, captured by value from the "sysevent_t" on
+ * the libsysevent delivery thread:
+ */
+typedef struct nsev_header {
+	char nsh_class[NSEV_CLASS_LEN];
+	char nsh_subclass[NSEV_SUBCLASS_LEN];
+	char nsh_vendor[NSEV_VENDOR_LEN];
+	char nsh_publisher[NSEV_PUBLISHER_LEN];
+	int32_t nsh_pid;
+	int nsh_kernel;		/* 1 if published by the kernel */
+} nsev_header_t;
+
+/*
+ * What happens to events that arrive while the queue is full:
+ */
+typedef enum nsev_overload {
+	NSEV_OVERLOAD_BLOCK = 1,	/* libsysevent waits for room */
+	NSEV_OVERLOAD_DROP_NEWEST,	/* discard the arriving event */
+	NSEV_OVERLOAD_DROP_OLDEST,	/* discard the oldest queued events */
+	NSEV_OVERLOAD_COALESCE		/* keep only the newest of each kind */
+} nsev_overload_t;
+
+typedef struct nsev_queue_stats {
+	uint32_t nqs_queued;
+	uint_t nqs_limit;
+	uint64_t nqs_dropped;
+	uint64_t nqs_coalesced;
+} nsev_queue_stats_t;
+
+typedef struct nsev_journal_stats {
+	uint64_t njs_appended;	/* events written to the journal */
+	uint64_t njs_errors;	/* events that could not be written */
+} nsev_journal_stats_t;
+
+/*
+ * The default interval between syncs of the journal, in milliseconds:
+ */
+#define	NSEV_JOURNAL_SYNC_DEFAULT	1000
+
+/*
+ * Per-subscriber counters:
+ */
+typedef struct nsev_stats {
+	uint64_t nss_delivered;
+	uint64_t nss_dropped;
+	uint64_t nss_coalesced;
+	uint_t nss_held;
+} nsev_stats_t;
+
+/*
+ * The default number of events held for a paused subscriber:
+ */
+#define	NSEV_HOLD_DEFAULT	1024
+
+/*
+ * The default coalescing window, in milliseconds:
+ */
+#define	NSEV_COALESCE_WINDOW_DEFAULT	100
+
+typedef void (nsev_callback_t)(nsev_event_t *, uint_t, void *);
+typedef void (nsev_cache_fini_t)(void *);
+typedef void (nsev_flush_t)(void *);
 
 int nsev_init(void);
+int nsev_configure_pool(uint_t, nsev_pool_policy_t);
+void nsev_configure_queue(uint_t, nsev_overload_t);
+void nsev_pool_report(nsev_pool_stats_t *, nsev_pool_stats_t *,
+    nsev_pool_stats_t *);
+void nsev_queue_report(nsev_queue_stats_t *);
+int nsev_configure_journal(const char *, uint64_t, uint_t);
+void nsev_journal_report(nsev_journal_stats_t *);
+int nsev_inject(const nsev_packed_t *, size_t);
 
-int nsev_attach(nsev_callback_t *, void *, node_sysevent_t **);
+int nsev_attach(nsev_callback_t *, nsev_flush_t *, nvlist_t *, void *,
+    node_sysevent_t **);
 void nsev_detach(node_sysevent_t *);
+void nsev_stats(node_sysevent_t *, nsev_stats_t *);
+void nsev_pause(node_sysevent_t *);
+void nsev_resume(node_sysevent_t *);
+
+const nsev_header_t *nsev_event_header(nsev_event_t *);
+const nsev_flat_t *nsev_event_attrs(nsev_event_t *);
+const nsev_packed_t *nsev_event_packed(nsev_event_t *);
+const nsev_packed_t *nsev_event_packed_hold(nsev_event_t *);
+void nsev_packed_rele(const nsev_packed_t *);
+void *nsev_event_cache(nsev_event_t *);
+void nsev_event_set_cache(nsev_event_t *, void *, nsev_cache_fini_t *);
+void nsev_event_hold(nsev_event_t *);
+void nsev_event_rele(nsev_event_t *);
 
 #ifdef	__cplusplus
 }
@@ -0,0 +1,204 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2022 Joyent, Inc.
+ */
+
+/*
+ * A bounded pool of fixed-size objects.  Every object in the pool is carved
+ * from a single slab allocated when the pool is created, and free objects are
+ * kept on a singly-linked free list threaded through the objects themselves.
+ * Allocation and release are then a few pointer operations under a mutex,
+ * rather than a trip through malloc(3C).
+ *
+ * If the pool is exhausted, the pool policy decides whether the allocation
+ * falls back to malloc(3C) or fails.  Objects that did not come from the slab
+ * are recognised by address when they are released.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <sys/debug.h>
+#include <pthread.h>
+
+#include "pool.h"
+
+typedef struct nsev_pool_obj {
+	struct nsev_pool_obj *npo_next;
+} nsev_pool_obj_t;
+
+struct nsev_pool {
+	pthread_mutex_t np_mtx;
+	nsev_pool_policy_t np_policy;
+	size_t np_objsize;
+	char *np_slab;
+	char *np_slab_end;
+	nsev_pool_obj_t *np_free;
+	nsev_pool_stats_t np_stats;
+};
+
+#define	NSEV_POOL_ALIGN		sizeof (uint64_t)
+
+/*
+ * Create a pool of "nobjs" objects of "objsize" bytes each.  Returns NULL if
+ * memory for the pool could not be allocated.
+ */
+nsev_pool_t *
+nsev_pool_create(size_t objsize, uint_t nobjs, nsev_pool_policy_t policy)
+{
+	nsev_pool_t *np;
+	uint_t i;
+
+	VERIFY(policy == NSEV_POOL_MALLOC || policy == NSEV_POOL_DROP);
+
+	if ((np = calloc(1, sizeof (*np))) == NULL) {
+		return (NULL);
+	}
+
+	if (objsize < sizeof (nsev_pool_obj_t)) {
+		objsize = sizeof (nsev_pool_obj_t);
+	}
+	objsize = (objsize + NSEV_POOL_ALIGN - 1) & ~(NSEV_POOL_ALIGN - 1);
+
+	if (nobjs > 0 && (np->np_slab = malloc(objsize * nobjs)) == NULL) {
+		free(np);
+		return (NULL);
+	}
+	np->np_slab_end = np->np_slab + objsize * nobjs;
+
+	/*
+	 * Thread every object onto the free list, lowest address first.
+	 */
+	for (i = nobjs; i > 0; i--) {
+		nsev_pool_obj_t *npo = (nsev_pool_obj_t *)(np->np_slab +
+		    objsize * (i - 1));
+
+		npo->npo_next = np->np_free;
+		np->np_free = npo;
+	}
+
+	VERIFY0(pthread_mutex_init(&np->np_mtx, NULL));
+	np->np_policy = policy;
+	np->np_objsize = objsize;
+	np->np_stats.nps_size = nobjs;
+
+	return (np);
+}
+
+/*
+ * Destroy the pool.  Every object allocated from it must have been released.
+ */
+void
+nsev_pool_destroy(nsev_pool_t *np)
+{
+	if (np == NULL) {
+		return;
+	}
+
+	VERIFY(np->np_stats.nps_inuse == 0);
+	VERIFY0(pthread_mutex_destroy(&np->np_mtx));
+	free(np->np_slab);
+	free(np);
+}
+
+/*
+ * Allocate an object.  The contents of the object are undefined.  Returns NULL
+ * if the pool is exhausted and its policy is NSEV_POOL_DROP, or if the
+ * fallback allocation failed.
+ */
+void *
+nsev_pool_alloc(nsev_pool_t *np)
+{
+	nsev_pool_obj_t *npo;
+
+	VERIFY0(pthread_mutex_lock(&np->np_mtx));
+	if ((npo = np->np_free) != NULL) {
+		np->np_free = npo->npo_next;
+		np->np_stats.nps_inuse++;
+		VERIFY0(pthread_mutex_unlock(&np->np_mtx));
+		return (npo);
+	}
+
+	if (np->np_policy == NSEV_POOL_DROP) {
+		np->np_stats.nps_failures++;
+		VERIFY0(pthread_mutex_unlock(&np->np_mtx));
+		return (NULL);
+	}
+	VERIFY0(pthread_mutex_unlock(&np->np_mtx));
+
+	/*
+	 * The pool is exhausted, so fall back to the heap.  The allocation
+	 * is made without holding the lock, and accounted for afterwards.
+	 */
+	npo = malloc(np->np_objsize);
+
+	VERIFY0(pthread_mutex_lock(&np->np_mtx));
+	if (npo == NULL) {
+		np->np_stats.nps_failures++;
+	} else {
+		np->np_stats.nps_fallbacks++;
+		np->np_stats.nps_inuse++;
+	}
+	VERIFY0(pthread_mutex_unlock(&np->np_mtx));
+
+	return (npo);
+}
+
+/*
+ * Release an object previously returned by "nsev_pool_alloc()".
+ */
+void
+nsev_pool_free(nsev_pool_t *np, void *obj)
+{
+	nsev_pool_obj_t *npo = obj;
+
+	if (npo == NULL) {
+		return;
+	}
+
+	if ((char *)npo < np->np_slab || (char *)npo >= np->np_slab_end) {
+		/*
+		 * This object was allocated when the pool was exhausted.
+		 */
+		free(npo);
+		VERIFY0(pthread_mutex_lock(&np->np_mtx));
+		VERIFY(np->np_stats.nps_inuse > 0);
+		np->np_stats.nps_inuse--;
+		VERIFY0(pthread_mutex_unlock(&np->np_mtx));
+		return;
+	}
+
+	VERIFY0(pthread_mutex_lock(&np->np_mtx));
+	VERIFY(np->np_stats.nps_inuse > 0);
+	np->np_stats.nps_inuse--;
+	npo->npo_next = np->np_free;
+	np->np_free = npo;
+	VERIFY0(pthread_mutex_unlock(&np->np_mtx));
+}
+
+void
+nsev_pool_stats(nsev_pool_t *np, nsev_pool_stats_t *nps)
+{
+	VERIFY0(pthread_mutex_lock(&np->np_mtx));
+	*nps = np->np_stats;
+	VERIFY0(pthread_mutex_unlock(&np->np_mtx));
+}
@@ -0,0 +1,65 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2022 Joyent, Inc.
+ */
+
+#ifndef	_POOL_H
+#define	_POOL_H
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+typedef struct nsev_pool nsev_pool_t;
+
+/*
+ * What "nsev_pool_alloc()" does once every preallocated object is in use:
+ */
+typedef enum nsev_pool_policy {
+	NSEV_POOL_MALLOC = 1,	/* fall back to malloc(3C) */
+	NSEV_POOL_DROP		/* fail the allocation */
+} nsev_pool_policy_t;
+
+typedef struct nsev_pool_stats {
+	uint_t nps_size;	/* number of preallocated objects */
+	uint_t nps_inuse;	/* objects allocated and not yet freed */
+	uint64_t nps_fallbacks;	/* allocations satisfied by malloc(3C) */
+	uint64_t nps_failures;	/* allocations that failed */
+} nsev_pool_stats_t;
+
+#define	NSEV_POOL_DEFAULT_SIZE	1024
+
+nsev_pool_t *nsev_pool_create(size_t, uint_t, nsev_pool_policy_t);
+void nsev_pool_destroy(nsev_pool_t *);
+void *nsev_pool_alloc(nsev_pool_t *);
+void nsev_pool_free(nsev_pool_t *, void *);
+void nsev_pool_stats(nsev_pool_t *, nsev_pool_stats_t *);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* !_POOL_H */
@@ -0,0 +1,272 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2022 Joyent, Inc.
+ */
+
+/*
+ * Replay of recorded events.  The events in an event journal (see
+ * "journal.c") are read back by a thread of our own and fed through
+ * "nsev_inject()", so that they take the same path through the overload
+ * policy, the queue and the subscriber filters as live events.  This allows
+ * a capture from one system to be replayed on another, with or without a
+ * libsysevent handle bound (see "nsev_configure_source()").
+ *
+ * Events are replayed at the rate at which they were journaled, scaled by
+ * "speed"; a speed of zero replays them as fast as they are admitted.  With
+ * the "block" overload policy, the queue limit then paces the replay thread
+ * exactly as it paces the libsysevent delivery threads.
+ *
+ * Only one replay runs at a time.  It is started and stopped on the event
+ * loop thread, and reports its result there, through "crossthread_invoke()".
+ * While a replay runs, it holds a reference on the event loop.
+ */
+
+#include <stddef.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/debug.h>
+#include <sys/time.h>
+
+#include "crossthread.h"
+#include "journal.h"
+#include "more.h"
+#include "replay.h"
+#include "source.h"
+
+#define	_UNUSED	__attribute__((__unused__))
+
+/*
+ * The longest a replay thread sleeps before checking whether it has been
+ * stopped, in nanoseconds:
+ */
+#define	NSEV_REPLAY_NAP		(100 * 1000 * 1000LL)
+
+typedef struct nsev_replay {
+	nsev_journal_reader_t *nrp_reader;
+	uint64_t nrp_from;
+	double nrp_speed;
+	volatile int nrp_stop;
+	int nrp_error;
+	uint64_t nrp_count;
+	nsev_replay_done_t *nrp_done;
+	void *nrp_arg;
+} nsev_replay_t;
+
+/*
+ * The running replay, if any.  This is only used on the event loop thread.
+ */
+static nsev_replay_t *g_nsev_replay = NULL;
+
+/*
+ * The event source for replay alone produces no events of its own.  A replay
+ * may also run alongside any other source.
+ */
+const nsev_source_ops_t nsev_source_replay = {
+	.nso_name = "replay",
+	.nso_start = NULL,
+	.nso_stop = NULL,
+	.nso_subscribe = NULL
+};
+
+/*
+ * Sleep until the gethrtime() value "when", or until the replay is stopped.
+ */
+static void
+nsev_replay_wait(nsev_replay_t *nrp, hrtime_t when)
+{
+	hrtime_t now;
+
+	while (!nrp->nrp_stop && (now = gethrtime()) < when) {
+		struct timespec ts;
+		hrtime_t nap = when - now;
+
+		if (nap > NSEV_REPLAY_NAP) {
+			nap = NSEV_REPLAY_NAP;
+		}
+		ts.tv_sec = nap / NANOSEC;
+		ts.tv_nsec = nap % NANOSEC;
+		(void) nanosleep(&ts, NULL);
+	}
+}
+
+/*
+ * Called on the event loop thread, through "crossthread_invoke()", when the
+ * replay thread is finished.
+ */
+static void
+nsev_replay_finish(void *arg0, void *arg1 _UNUSED)
+{
+	nsev_replay_t *nrp = arg0;
+
+	VERIFY(g_nsev_replay == nrp);
+	g_nsev_replay = NULL;
+
+	nsev_journal_reader_close(nrp->nrp_reader);
+	crossthread_release_hold();
+
+	nrp->nrp_done(nrp->nrp_error, nrp->nrp_count, nrp->nrp_arg);
+	free(nrp);
+}
+
+static void *
+nsev_replay_thread(void *arg)
+{
+	nsev_replay_t *nrp = arg;
+	const nsev_journal_rec_t *njr;
+	hrtime_t t0 = 0, w0 = 0, last = 0;
+	int started = 0;
+
+	while (!nrp->nrp_stop) {
+		/*
+		 * The reader returns a copy of each record, so a record
+		 * overwritten by the writer while we wait below is still
+		 * replayed as it was recorded.  A reader overtaken by the
+		 * writer reports ESTALE, so that a truncated replay is not
+		 * mistaken for a complete one.
+		 */
+		if ((njr = nsev_journal_reader_next(nrp->nrp_reader)) ==
+		    NULL) {
+			nrp->nrp_error = errno;
+			break;
+		}
+
+		if (njr->njr_seq < nrp->nrp_from) {
+			continue;
+		}
+
+		if (nrp->nrp_speed > 0) {
+			/*
+			 * Timestamps come from gethrtime() in the process
+			 * that wrote the journal, so they restart when the
+			 * journal spans a reboot.  Time is measured afresh
+			 * from any record that goes back in time.
+			 */
+			if (!started || njr->njr_time < last) {
+				t0 = njr->njr_time;
+				w0 = gethrtime();
+				started = 1;
+			}
+			last = njr->njr_time;
+			nsev_replay_wait(nrp, w0 +
+			    (hrtime_t)((njr->njr_time - t0) / nrp->nrp_speed));
+			if (nrp->nrp_stop) {
+				break;
+			}
+		}
+
+		if (nsev_inject((const nsev_packed_t *)(njr + 1),
+		    njr->njr_size - sizeof (*njr)) == 0) {
+			nrp->nrp_count++;
+		} else if (errno == EINVAL) {
+			/*
+			 * The record is corrupt; the rest of the journal
+			 * cannot be trusted.  Events discarded by the
+			 * overload policy (EAGAIN) are counted as drops, as
+			 * they would be for a live event; events for which
+			 * memory cannot be allocated (ENOMEM) are skipped,
+			 * and only counted by the event pool.
+			 */
+			nrp->nrp_error = EINVAL;
+			break;
+		}
+	}
+
+	if (nrp->nrp_stop && nrp->nrp_error == 0) {
+		nrp->nrp_error = ECANCELED;
+	}
+
+	VERIFY0(crossthread_invoke(nsev_replay_finish, nrp, NULL));
+	return (NULL);
+}
+
+/*
+ * Start replaying the records in the journal at "path" whose sequence
+ * numbers are at least "from".  "done" is called on the event loop thread
+ * when the replay ends.  Returns -1 with EBUSY if a replay is already
+ * running, or with the error from opening the journal.
+ */
+int
+nsev_replay_start(const char *path, uint64_t from, double speed,
+    nsev_replay_done_t *done, void *arg)
+{
+	nsev_replay_t *nrp;
+	pthread_attr_t attr;
+	pthread_t tid;
+	int e;
+
+	VERIFY(speed >= 0);
+
+	if (g_nsev_replay != NULL) {
+		errno = EBUSY;
+		return (-1);
+	}
+
+	if ((nrp = calloc(1, sizeof (*nrp))) == NULL) {
+		return (-1);
+	}
+	nrp->nrp_from = from;
+	nrp->nrp_speed = speed;
+	nrp->nrp_done = done;
+	nrp->nrp_arg = arg;
+
+	if (nsev_journal_reader_open(path, &nrp->nrp_reader) != 0) {
+		e = errno;
+		free(nrp);
+		errno = e;
+		return (-1);
+	}
+
+	VERIFY0(pthread_attr_init(&attr));
+	VERIFY0(pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED));
+	e = pthread_create(&tid, &attr, nsev_replay_thread, nrp);
+	VERIFY0(pthread_attr_destroy(&attr));
+	if (e != 0) {
+		nsev_journal_reader_close(nrp->nrp_reader);
+		free(nrp);
+		errno = e;
+		return (-1);
+	}
+
+	g_nsev_replay = nrp;
+	crossthread_take_hold();
+	return (0);
+}
+
+/*
+ * Ask the running replay to stop.  It stops after the event it is
+ * replaying, if any, and then reports ECANCELED.  Returns -1 with ESRCH if
+ * no replay is running.
+ */
+int
+nsev_replay_stop(void)
+{
+	if (g_nsev_replay == NULL) {
+		errno = ESRCH;
+		return (-1);
+	}
+
+	g_nsev_replay->nrp_stop = 1;
+	return (0);
+}
@@ -0,0 +1,52 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2022 Joyent, Inc.
+ */
+
+#ifndef	_REPLAY_H
+#define	_REPLAY_H
+
+#include <sys/types.h>
+#include <stdint.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * Called on the event loop thread when a replay ends, with 0 if every
+ * record was replayed, ECANCELED if the replay was stopped, ESTALE if the
+ * journal was overwritten faster than it could be replayed, or the error
+ * that ended it; and the number of events injected.
+ */
+typedef void (nsev_replay_done_t)(int, uint64_t, void *);
+
+int nsev_replay_start(const char *, uint64_t, double, nsev_replay_done_t *,
+    void *);
+int nsev_replay_stop(void);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* !_REPLAY_H */
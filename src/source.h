@@ -0,0 +1,122 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2022 Joyent, Inc.
+ */
+
+#ifndef	_SOURCE_H
+#define	_SOURCE_H
+
+#include <sys/types.h>
+#include <stdint.h>
+#include <libnvpair.h>
+
+#ifdef	__cplusplus
+extern "C" {
+#endif
+
+/*
+ * An event source produces events, on threads of its own, and passes each to
+ * "nsev_produce()".  The source is started when the first subscriber
+ * attaches and stopped when the last one detaches, both on the event loop
+ * thread.  "nso_stop" must not return until no thread of the source can call
+ * "nsev_produce()" again.  Producers may block in "nsev_produce()" under the
+ * "block" overload policy; they are released while the source is stopped.
+ *
+ * "nso_subscribe", if not NULL, is called on the event loop thread whenever
+ * the union of the class maps of the subscribers changes, with that union in
+ * the form passed to "sysevent_subscribe_event()": each class maps to a
+ * string array of subclasses, and EC_ALL or EC_SUB_ALL select everything.
+ * The source takes ownership of the nvlist.  A source need not honour it;
+ * subscriber filters are applied to every event regardless.
+ *
+ * Any of the functions may be NULL.
+ */
+typedef struct nsev_source_ops {
+	const char *nso_name;
+	int (*nso_start)(void);
+	void (*nso_stop)(void);
+	void (*nso_subscribe)(nvlist_t *);
+} nsev_source_ops_t;
+
+/*
+ * Live events from libsysevent; see "sysevent.c".  This is the default.
+ */
+extern const nsev_source_ops_t nsev_source_sysevent;
+uint64_t nsev_sysevent_subscribe_errors(void);
+
+/*
+ * Events made up by a pool of generator threads; see "synth.c".
+ */
+extern const nsev_source_ops_t nsev_source_synth;
+
+/*
+ * No events but those replayed from a journal; see "replay.c".
+ */
+extern const nsev_source_ops_t nsev_source_replay;
+
+/*
+ * The configuration of the synthetic source.  Each event is of a class and
+ * subclass chosen from "nsy_classes" in proportion to their weights, and has
+ * "nsy_attrs" attributes: a uint64 "seq" and an hrtime "time" (the
+ * gethrtime() value when the event was produced), then alternately strings
+ * of "nsy_strlen" characters and uint64 values.
+ *
+ * With "nsy_post", events are published with "sysevent_post_event()" and
+ * received by a handle bound as the "sysevent" source binds one, rather than
+ * passed straight to "nsev_produce()", so that they take the whole path of
+ * live events.  This is only supported on Linux, where the publisher is the
+ * bundled libsysevent shim; elsewhere it would publish system-wide events.
+ */
+typedef struct nsev_synth_class {
+	char *nsc_class;
+	char *nsc_subclass;
+	uint_t nsc_weight;
+} nsev_synth_class_t;
+
+typedef struct nsev_synth_config {
+	uint_t nsy_rate;	/* events/second, all threads; 0: no limit */
+	uint_t nsy_threads;	/* producer threads */
+	uint_t nsy_attrs;	/* attributes per event */
+	uint_t nsy_strlen;	/* length of each string attribute */
+	uint_t nsy_nclasses;
+	nsev_synth_class_t *nsy_classes;
+	int nsy_post;		/* publish through libsysevent */
+} nsev_synth_config_t;
+
+#define	NSEV_SYNTH_RATE_DEFAULT		1000
+#define	NSEV_SYNTH_THREADS_DEFAULT	1
+#define	NSEV_SYNTH_ATTRS_DEFAULT	8
+#define	NSEV_SYNTH_STRLEN_DEFAULT	16
+
+int nsev_configure_source(const nsev_source_ops_t *);
+int nsev_synth_configure(const nsev_synth_config_t *);
+
+void nsev_produce(const char *, const char *, const char *, const char *,
+    int32_t, int, nvlist_t *);
+int nsev_subclasses_within(char **, uint_t, char **, uint_t);
+
+#ifdef	__cplusplus
+}
+#endif
+
+#endif	/* !_SOURCE_H */
@@ -0,0 +1,439 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2022 Joyent, Inc.
+ */
+
+/*
+ * The synthetic event source, for exercising the delivery pipeline without
+ * libsysevent: on a system with no events of interest, or one without
+ * libsysevent at all.  A pool of producer threads makes up events at a
+ * configured rate, with a configured mix of classes and attribute lists of a
+ * configured size, and passes them to "nsev_produce()" just as the
+ * libsysevent handler does; or, on Linux, publishes them through the
+ * libsysevent shim, to be received by the libsysevent handler itself.
+ *
+ * Each thread builds one attribute list per class when the source starts,
+ * and only updates its "seq" and "time" attributes for each event, so that
+ * the cost of producing events is small next to the cost of delivering them.
+ * The "time" attribute allows the latency of delivery to be measured.
+ */
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <atomic.h>
+#include <sys/debug.h>
+#include <sys/time.h>
+#include <libnvpair.h>
+#include <libsysevent.h>
+
+#include "source.h"
+
+#define	NSEV_SYNTH_VENDOR	"synthetic"
+#define	NSEV_SYNTH_PUBLISHER	"node-sysevent:synth"
+
+/*
+ * The longest a producer thread sleeps before checking whether the source
+ * has been stopped, in nanoseconds:
+ */
+#define	NSEV_SYNTH_NAP		(100 * 1000 * 1000LL)
+
+typedef struct nsev_synth_thread {
+	pthread_t nst_tid;
+	uint64_t nst_rng;
+	nvlist_t **nst_nvls;	/* one attribute list per class */
+} nsev_synth_thread_t;
+
+static nsev_synth_class_t g_nsev_synth_default_class = {
+	"EC_synthetic", "ESC_synthetic", 1
+};
+
+/*
+ * The configuration is only changed while the source is stopped, so the
+ * producer threads read it without a lock.
+ */
+static nsev_synth_config_t g_nsev_synth = {
+	NSEV_SYNTH_RATE_DEFAULT,
+	NSEV_SYNTH_THREADS_DEFAULT,
+	NSEV_SYNTH_ATTRS_DEFAULT,
+	NSEV_SYNTH_STRLEN_DEFAULT,
+	1,
+	&g_nsev_synth_default_class,
+	0
+};
+static uint_t g_nsev_synth_weight = 1;
+
+static nsev_synth_thread_t *g_nsev_synth_threads = NULL;
+static volatile int g_nsev_synth_stop = 0;
+static volatile uint64_t g_nsev_synth_seq = 0;
+
+static void
+nsev_synth_classes_free(nsev_synth_class_t *classes, uint_t n)
+{
+	uint_t i;
+
+	if (classes == &g_nsev_synth_default_class) {
+		return;
+	}
+
+	for (i = 0; i < n; i++) {
+		free(classes[i].nsc_class);
+		free(classes[i].nsc_subclass);
+	}
+	free(classes);
+}
+
+/*
+ * Replace the configuration of the synthetic source with a copy of "nsy".
+ * Fails with EBUSY if the source is running, EINVAL if "nsy" has no
+ * producer threads or no class with a non-zero weight, or ENOTSUP if it
+ * asks to publish events on a system other than Linux.
+ */
+int
+nsev_synth_configure(const nsev_synth_config_t *nsy)
+{
+	nsev_synth_class_t *classes;
+	uint_t i, weight = 0;
+
+	if (g_nsev_synth_threads != NULL) {
+		errno = EBUSY;
+		return (-1);
+	}
+
+	for (i = 0; i < nsy->nsy_nclasses; i++) {
+		weight += nsy->nsy_classes[i].nsc_weight;
+	}
+	if (nsy->nsy_threads == 0 || weight == 0) {
+		errno = EINVAL;
+		return (-1);
+	}
+#ifndef	__linux__
+	if (nsy->nsy_post) {
+		errno = ENOTSUP;
+		return (-1);
+	}
+#endif
+
+	if ((classes = calloc(nsy->nsy_nclasses, sizeof (*classes))) == NULL) {
+		return (-1);
+	}
+	for (i = 0; i < nsy->nsy_nclasses; i++) {
+		classes[i].nsc_weight = nsy->nsy_classes[i].nsc_weight;
+		if ((classes[i].nsc_class = strdup(
+		    nsy->nsy_classes[i].nsc_class)) == NULL ||
+		    (classes[i].nsc_subclass = strdup(
+		    nsy->nsy_classes[i].nsc_subclass)) == NULL) {
+			nsev_synth_classes_free(classes, i + 1);
+			errno = ENOMEM;
+			return (-1);
+		}
+	}
+
+	nsev_synth_classes_free(g_nsev_synth.nsy_classes,
+	    g_nsev_synth.nsy_nclasses);
+	g_nsev_synth = *nsy;
+	g_nsev_synth.nsy_classes = classes;
+	g_nsev_synth_weight = weight;
+	return (0);
+}
+
+/*
+ * Build the attribute list for events of class "c".  The "seq" and "time"
+ * attributes are replaced for each event.
+ */
+static nvlist_t *
+nsev_synth_attrs(uint_t c)
+{
+	const nsev_synth_config_t *nsy = &g_nsev_synth;
+	char name[32];
+	char *str;
+	nvlist_t *nvl;
+	uint_t i;
+
+	if (nvlist_alloc(&nvl, NV_UNIQUE_NAME, 0) != 0) {
+		return (NULL);
+	}
+	if ((str = malloc(nsy->nsy_strlen + 1)) == NULL) {
+		nvlist_free(nvl);
+		return (NULL);
+	}
+	memset(str, 'a' + c % 26, nsy->nsy_strlen);
+	str[nsy->nsy_strlen] = '\0';
+
+	for (i = 0; i < nsy->nsy_attrs; i++) {
+		int r;
+
+		if (i == 0) {
+			r = nvlist_add_uint64(nvl, "seq", 0);
+		} else if (i == 1) {
+			r = nvlist_add_hrtime(nvl, "time", 0);
+		} else if (i % 2 == 0) {
+			(void) snprintf(name, sizeof (name), "str%u", i);
+			r = nvlist_add_string(nvl, name, str);
+		} else {
+			(void) snprintf(name, sizeof (name), "int%u", i);
+			r = nvlist_add_uint64(nvl, name, (uint64_t)i * c);
+		}
+		if (r != 0) {
+			free(str);
+			nvlist_free(nvl);
+			return (NULL);
+		}
+	}
+
+	free(str);
+	return (nvl);
+}
+
+/*
+ * Choose the class of the next event, in proportion to the class weights.
+ */
+static uint_t
+nsev_synth_pick(nsev_synth_thread_t *nst)
+{
+	const nsev_synth_config_t *nsy = &g_nsev_synth;
+	uint_t c, w;
+
+	/*
+	 * xorshift64; the quality of the sequence hardly matters here.
+	 */
+	nst->nst_rng ^= nst->nst_rng << 13;
+	nst->nst_rng ^= nst->nst_rng >> 7;
+	nst->nst_rng ^= nst->nst_rng << 17;
+
+	w = (uint_t)(nst->nst_rng % g_nsev_synth_weight);
+	for (c = 0; w >= nsy->nsy_classes[c].nsc_weight; c++) {
+		w -= nsy->nsy_classes[c].nsc_weight;
+	}
+
+	return (c);
+}
+
+/*
+ * Sleep until the gethrtime() value "when", or until the source is stopped.
+ */
+static void
+nsev_synth_wait(hrtime_t when)
+{
+	hrtime_t now;
+
+	while (!g_nsev_synth_stop && (now = gethrtime()) < when) {
+		struct timespec ts;
+		hrtime_t nap = when - now;
+
+		if (nap > NSEV_SYNTH_NAP) {
+			nap = NSEV_SYNTH_NAP;
+		}
+		ts.tv_sec = nap / NANOSEC;
+		ts.tv_nsec = nap % NANOSEC;
+		(void) nanosleep(&ts, NULL);
+	}
+}
+
+static void *
+nsev_synth_thread(void *arg)
+{
+	nsev_synth_thread_t *nst = arg;
+	const nsev_synth_config_t *nsy = &g_nsev_synth;
+	hrtime_t next, interval = 0;
+	pid_t pid = getpid();
+
+	/*
+	 * Each thread produces its share of the rate, on a fixed schedule: a
+	 * thread that falls behind (because it was blocked by the overload
+	 * policy, say) catches up in a burst.
+	 */
+	if (nsy->nsy_rate > 0) {
+		interval = (hrtime_t)NANOSEC * nsy->nsy_threads / nsy->nsy_rate;
+	}
+	next = gethrtime();
+
+	while (!g_nsev_synth_stop) {
+		uint_t c = nsev_synth_pick(nst);
+		nvlist_t *nvl = nst->nst_nvls[c];
+
+		if (interval > 0) {
+			nsev_synth_wait(next);
+			next += interval;
+			if (g_nsev_synth_stop) {
+				break;
+			}
+		}
+
+		if (nsy->nsy_attrs > 0) {
+			VERIFY0(nvlist_add_uint64(nvl, "seq",
+			    atomic_inc_64_nv(&g_nsev_synth_seq)));
+		}
+		if (nsy->nsy_attrs > 1) {
+			VERIFY0(nvlist_add_hrtime(nvl, "time", gethrtime()));
+		}
+
+		if (nsy->nsy_post) {
+			/*
+			 * An event that cannot be published is lost, as it
+			 * would be by a publisher using libsysevent.
+			 */
+			(void) sysevent_post_event(
+			    nsy->nsy_classes[c].nsc_class,
+			    nsy->nsy_classes[c].nsc_subclass,
+			    (char *)NSEV_SYNTH_VENDOR,
+			    (char *)NSEV_SYNTH_PUBLISHER, nvl, NULL);
+			continue;
+		}
+
+		nsev_produce(nsy->nsy_classes[c].nsc_class,
+		    nsy->nsy_classes[c].nsc_subclass, NSEV_SYNTH_VENDOR,
+		    NSEV_SYNTH_PUBLISHER, pid, 0, nvl);
+	}
+
+	return (NULL);
+}
+
+static void
+nsev_synth_threads_free(uint_t nthreads)
+{
+	uint_t i, c;
+
+	for (i = 0; i < nthreads; i++) {
+		nsev_synth_thread_t *nst = &g_nsev_synth_threads[i];
+
+		for (c = 0; nst->nst_nvls != NULL &&
+		    c < g_nsev_synth.nsy_nclasses; c++) {
+			nvlist_free(nst->nst_nvls[c]);
+		}
+		free(nst->nst_nvls);
+	}
+	free(g_nsev_synth_threads);
+	g_nsev_synth_threads = NULL;
+}
+
+/*
+ * Stop and reap the first "nthreads" producer threads.
+ */
+static void
+nsev_synth_join(uint_t nthreads)
+{
+	uint_t i;
+
+	g_nsev_synth_stop = 1;
+	for (i = 0; i < nthreads; i++) {
+		VERIFY0(pthread_join(g_nsev_synth_threads[i].nst_tid, NULL));
+	}
+	nsev_synth_threads_free(g_nsev_synth.nsy_threads);
+}
+
+static int
+nsev_synth_start(void)
+{
+	const nsev_synth_config_t *nsy = &g_nsev_synth;
+	uint_t i, c;
+	int e;
+
+	VERIFY(g_nsev_synth_threads == NULL);
+
+	/*
+	 * Published events are received by the "sysevent" source, which must
+	 * be ready for them before the producers start.
+	 */
+	if (nsy->nsy_post && nsev_source_sysevent.nso_start() != 0) {
+		return (-1);
+	}
+
+	if ((g_nsev_synth_threads = calloc(nsy->nsy_threads,
+	    sizeof (nsev_synth_thread_t))) == NULL) {
+		e = errno;
+		goto fail;
+	}
+
+	for (i = 0; i < nsy->nsy_threads; i++) {
+		nsev_synth_thread_t *nst = &g_nsev_synth_threads[i];
+
+		nst->nst_rng = 0x9e3779b97f4a7c15ULL * (i + 1);
+		if ((nst->nst_nvls = calloc(nsy->nsy_nclasses,
+		    sizeof (nvlist_t *))) == NULL) {
+			nsev_synth_threads_free(nsy->nsy_threads);
+			e = ENOMEM;
+			goto fail;
+		}
+		for (c = 0; c < nsy->nsy_nclasses; c++) {
+			if ((nst->nst_nvls[c] = nsev_synth_attrs(c)) == NULL) {
+				nsev_synth_threads_free(nsy->nsy_threads);
+				e = ENOMEM;
+				goto fail;
+			}
+		}
+	}
+
+	g_nsev_synth_stop = 0;
+	for (i = 0; i < nsy->nsy_threads; i++) {
+		if ((e = pthread_create(&g_nsev_synth_threads[i].nst_tid,
+		    NULL, nsev_synth_thread, &g_nsev_synth_threads[i])) != 0) {
+			nsev_synth_join(i);
+			goto fail;
+		}
+	}
+	return (0);
+
+fail:
+	if (nsy->nsy_post) {
+		nsev_source_sysevent.nso_stop();
+	}
+	errno = e;
+	return (-1);
+}
+
+static void
+nsev_synth_stop(void)
+{
+	VERIFY(g_nsev_synth_threads != NULL);
+
+	nsev_synth_join(g_nsev_synth.nsy_threads);
+	if (g_nsev_synth.nsy_post) {
+		nsev_source_sysevent.nso_stop();
+	}
+}
+
+/*
+ * Only published events are subject to subscriptions.
+ */
+static void
+nsev_synth_subscribe(nvlist_t *want)
+{
+	if (g_nsev_synth.nsy_post) {
+		nsev_source_sysevent.nso_subscribe(want);
+	} else {
+		nvlist_free(want);
+	}
+}
+
+const nsev_source_ops_t nsev_source_synth = {
+	.nso_name = "synthetic",
+	.nso_start = nsev_synth_start,
+	.nso_stop = nsev_synth_stop,
+	.nso_subscribe = nsev_synth_subscribe
+};
@@ -0,0 +1,196 @@
+/*
+ * CDDL HEADER START
+ *
+ * The contents of this file are subject to the terms of the
+ * Common Development and Distribution License, Version 1.0 only
+ * (the "License").  You may not use this file except in compliance
+ * with the License.
+ *
+ * You can obtain a copy of the license at usr/src/OPENSOLARIS.LICENSE
+ * or http://www.opensolaris.org/os/licensing.
+ * See the License for the specific language governing permissions
+ * and limitations under the License.
+ *
+ * When distributing Covered Code, include this CDDL HEADER in each
+ * file and include the License file at usr/src/OPENSOLARIS.LICENSE.
+ * If applicable, add the following below this CDDL HEADER, with the
+ * fields enclosed by brackets "[]" replaced with your own identifying
+ * information: Portions Copyright [yyyy] [name of copyright owner]
+ *
+ * CDDL HEADER END
+ */
+/*
+ * Copyright 2022 Joyent, Inc.
+ */
+
+/*
+ * The libsysevent event source.  A single sysevent handle is bound while
+ * there are subscribers, and subscribed to the union of the classes they
+ * want.  libsysevent calls "nsev_sysevent_handler()" on its own pool of
+ * delivery threads.
+ */
+
+#include <libsysevent.h>
+#include <atomic.h>
+#include <sys/debug.h>
+#include <sys/types.h>
+#include <libnvpair.h>
+
+#include "source.h"
+
+static sysevent_handle_t *g_nsev_handle = NULL;
+static nvlist_t *g_nsev_subscribed = NULL;
+static uint64_t g_nsev_subscribe_errors = 0;
+
+static void
+nsev_sysevent_handler(sysevent_t *ev)
+{
+	nvlist_t *nvl;
+	pid_t evpid;
+
+	/*
+	 * An event whose attribute list cannot be retrieved is delivered
+	 * without attributes.
+	 */
+	if (sysevent_get_attr_list(ev, &nvl) != 0) {
+		nvl = NULL;
+	}
+	sysevent_get_pid(ev, &evpid);
+
+	nsev_produce(sysevent_get_class_name(ev),
+	    sysevent_get_subclass_name(ev), sysevent_get_vendor_name(ev),
+	    sysevent_get_pub_name(ev), evpid, evpid == SE_KERN_PID, nvl);
+
+	nvlist_free(nvl);
+}
+
+/*
+ * Binding a handle may fail: with EPERM in a zone without the privilege to
+ * receive events, for instance.
+ */
+static int
+nsev_sysevent_start(void)
+{
+	VERIFY(g_nsev_handle == NULL);
+	VERIFY(g_nsev_subscribed == NULL);
+
+	if ((g_nsev_handle = sysevent_bind_handle(
+	    nsev_sysevent_handler)) == NULL) {
+		return (-1);
+	}
+
+	return (0);
+}
+
+/*
+ * Unbinding the handle waits for the libsysevent delivery threads.
+ */
+static void
+nsev_sysevent_stop(void)
+{
+	VERIFY(g_nsev_handle != NULL);
+
+	sysevent_unsubscribe_event(g_nsev_handle, EC_ALL);
+	sysevent_unbind_handle(g_nsev_handle);
+	g_nsev_handle = NULL;
+
+	nvlist_free(g_nsev_subscribed);
+	g_nsev_subscribed = NULL;
+}
+
+/*
+ * Bring the subscriptions on our sysevent handle into line with "want", the
+ * union of the class maps of all active subscribers.  Classes that are new,
+ * or that only gained subclasses, are subscribed without disturbing the
+ * existing subscription.  A class that loses subclasses must be unsubscribed
+ * and subscribed again, so events of that class published in between are
+ * missed.
+ *
+ * A class that cannot be subscribed is counted (see
+ * "nsev_sysevent_subscribe_errors()"), and left out of the record of what we
+ * have, so that the next change tries it again; events of that class are not
+ * received meanwhile.
+ */
+static void
+nsev_sysevent_subscribe(nvlist_t *want)
+{
+	nvlist_t *have = g_nsev_subscribed;
+	nvlist_t *failed;
+	nvpair_t *nvp;
+
+	VERIFY(g_nsev_handle != NULL);
+
+	if (have != NULL && nvlist_exists(have, EC_ALL) &&
+	    !nvlist_exists(want, EC_ALL)) {
+		/*
+		 * Unsubscribing from EC_ALL removes every class, so it must
+		 * happen before any narrower subscriptions are made.
+		 */
+		sysevent_unsubscribe_event(g_nsev_handle, EC_ALL);
+		nvlist_free(have);
+		have = NULL;
+	}
+
+	nvp = NULL;
+	while (have != NULL && (nvp = nvlist_next_nvpair(have, nvp)) != NULL) {
+		char **hsubs, **wsubs;
+		uint_t nhsubs, nwsubs;
+
+		VERIFY0(nvpair_value_string_array(nvp, &hsubs, &nhsubs));
+		if (nvlist_lookup_string_array(want, nvpair_name(nvp), &wsubs,
+		    &nwsubs) != 0 ||
+		    !nsev_subclasses_within(hsubs, nhsubs, wsubs, nwsubs)) {
+			sysevent_unsubscribe_event(g_nsev_handle,
+			    nvpair_name(nvp));
+		}
+	}
+
+	VERIFY0(nvlist_alloc(&failed, NV_UNIQUE_NAME, 0));
+	nvp = NULL;
+	while ((nvp = nvlist_next_nvpair(want, nvp)) != NULL) {
+		char **hsubs, **wsubs;
+		uint_t nhsubs, nwsubs;
+
+		VERIFY0(nvpair_value_string_array(nvp, &wsubs, &nwsubs));
+		if (have != NULL && nvlist_lookup_string_array(have,
+		    nvpair_name(nvp), &hsubs, &nhsubs) == 0 &&
+		    nsev_subclasses_within(hsubs, nhsubs, wsubs, nwsubs) &&
+		    nsev_subclasses_within(wsubs, nwsubs, hsubs, nhsubs)) {
+			/*
+			 * No change for this class.
+			 */
+			continue;
+		}
+
+		if (sysevent_subscribe_event(g_nsev_handle, nvpair_name(nvp),
+		    (const char **)wsubs, nwsubs) != 0) {
+			atomic_inc_64(&g_nsev_subscribe_errors);
+			VERIFY0(nvlist_add_boolean(failed, nvpair_name(nvp)));
+		}
+	}
+
+	nvp = NULL;
+	while ((nvp = nvlist_next_nvpair(failed, nvp)) != NULL) {
+		VERIFY0(nvlist_remove_all(want, nvpair_name(nvp)));
+	}
+	nvlist_free(failed);
+
+	nvlist_free(have);
+	g_nsev_subscribed = want;
+}
+
+/*
+ * The number of times a class could not be subscribed.
+ */
+uint64_t
+nsev_sysevent_subscribe_errors(void)
+{
+	return (g_nsev_subscribe_errors);
+}
+
+const nsev_source_ops_t nsev_source_sysevent = {
+	.nso_name = "sysevent",
+	.nso_start = nsev_sysevent_start,
+	.nso_stop = nsev_sysevent_stop,
+	.nso_subscribe = nsev_sysevent_subscribe
+};